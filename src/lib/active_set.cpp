@@ -0,0 +1,125 @@
+#include "active_set.hpp"
+
+#include <stdexcept>
+
+#include "parallel.hpp"
+
+void ActiveSet::Update(const TranslationGrid& x_translation_grid,
+                       const TranslationGrid& y_translation_grid,
+                       const TranslationGrid& z_translation_grid, const Eigen::MatrixX3d& X) {
+  const TranslationGrid* translation_grids[3]{&x_translation_grid, &y_translation_grid,
+                                              &z_translation_grid};
+  for (int g = 0; g < 3; g++) {
+    if (translation_grids[g]->num_grid_vals() != x_translation_grid.num_grid_vals() ||
+        translation_grids[g]->min_idx_adj() != g * x_translation_grid.num_grid_vals()) {
+      throw std::runtime_error("Translation grids must share their geometry!");
+    }
+  }
+  int num_nodes{x_translation_grid.num_grid_vals() / 8};
+
+  // Corner nodes of the voxels containing correspondences; all grids share the same nodes
+  std::vector<char> node_is_active(num_nodes, 0);
+  auto [X_voxel_idx, Xn_voxel]{x_translation_grid.GetGridReference(X)};
+  for (Eigen::Index i = 0; i < X_voxel_idx.rows(); i++) {
+    for (int corner = 0; corner < 8; corner++) {
+      node_is_active[x_translation_grid.NodeIdx(X_voxel_idx(i, 0) + (corner & 1),
+                                                X_voxel_idx(i, 1) + ((corner >> 1) & 1),
+                                                X_voxel_idx(i, 2) + ((corner >> 2) & 1))] = 1;
+    }
+  }
+
+  std::vector<int> active_unknowns;
+  active_unknowns.reserve(active_unknowns_.size());
+  for (int g = 0; g < 3; g++) {
+    for (int node = 0; node < num_nodes; node++) {
+      if (!node_is_active[node]) continue;
+      for (int param = 0; param < 8; param++) {
+        active_unknowns.push_back(g * 8 * num_nodes + 8 * node + param);
+      }
+    }
+  }
+
+  if (3 * 8 * num_nodes == num_unknowns_ && active_unknowns == active_unknowns_) return;
+  active_unknowns_changed_ = true;
+
+  num_unknowns_ = 3 * 8 * num_nodes;
+  active_unknowns_ = std::move(active_unknowns);
+  active_idx_.assign(num_unknowns_, -1);
+  for (size_t i = 0; i < active_unknowns_.size(); i++) active_idx_[active_unknowns_[i]] = i;
+}
+
+Eigen::SparseMatrix<double> ActiveSet::Restrict(const Eigen::SparseMatrix<double>& N,
+                                                const uint64_t& pattern_version) {
+  if (active_unknowns_changed_ || pattern_version != input_pattern_version_) {
+    pattern_version_++;
+    input_pattern_version_ = pattern_version;
+    active_unknowns_changed_ = false;
+  }
+
+  int num_active{num_active_unknowns()};
+  Eigen::SparseMatrix<double> N_active(num_active, num_active);  // returned
+
+  // The mapping to the active unknowns is monotonic, i.e. the row indices of each column stay
+  // sorted. The entries of each column are counted first and copied in a second pass.
+  std::vector<int> col_nnz(num_active);
+  ParallelFor(
+      0, num_active,
+      [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+        for (int64_t j = first; j < last; j++) {
+          int nnz{0};
+          for (Eigen::SparseMatrix<double>::InnerIterator it(N, active_unknowns_[j]); it; ++it) {
+            if (active_idx_[it.row()] >= 0) nnz++;
+          }
+          col_nnz[j] = nnz;
+        }
+      },
+      256);
+
+  auto outer{N_active.outerIndexPtr()};
+  outer[0] = 0;
+  for (int j = 0; j < num_active; j++) outer[j + 1] = outer[j] + col_nnz[j];
+  N_active.resizeNonZeros(outer[num_active]);
+
+  ParallelFor(
+      0, num_active,
+      [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+        for (int64_t j = first; j < last; j++) {
+          int value_idx{N_active.outerIndexPtr()[j]};
+          for (Eigen::SparseMatrix<double>::InnerIterator it(N, active_unknowns_[j]); it; ++it) {
+            if (active_idx_[it.row()] < 0) continue;
+            N_active.innerIndexPtr()[value_idx] = active_idx_[it.row()];
+            N_active.valuePtr()[value_idx] = it.value();
+            value_idx++;
+          }
+        }
+      },
+      256);
+
+  return N_active;
+}
+
+LinearOperator ActiveSet::Restrict(const LinearOperator& N) const {
+  return LinearOperator{num_active_unknowns(),
+                        [this, N](const Eigen::VectorXd& x_active, Eigen::VectorXd& y_active) {
+                          Eigen::VectorXd y;
+                          N.Apply(Prolong(x_active), y);
+                          y_active = Restrict(y);
+                        },
+                        Restrict(N.diagonal())};
+}
+
+Eigen::VectorXd ActiveSet::Restrict(const Eigen::VectorXd& v) const {
+  Eigen::VectorXd v_active(num_active_unknowns());  // returned
+  for (int i = 0; i < num_active_unknowns(); i++) v_active(i) = v(active_unknowns_[i]);
+  return v_active;
+}
+
+Eigen::VectorXd ActiveSet::Prolong(const Eigen::VectorXd& x_active) const {
+  Eigen::VectorXd x{Eigen::VectorXd::Zero(num_unknowns_)};  // returned
+  for (int i = 0; i < num_active_unknowns(); i++) x(active_unknowns_[i]) = x_active(i);
+  return x;
+}
+
+int ActiveSet::num_active_unknowns() const { return static_cast<int>(active_unknowns_.size()); }
+const int& ActiveSet::num_unknowns() const { return num_unknowns_; }
+const uint64_t& ActiveSet::pattern_version() const { return pattern_version_; }
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <cstdint>
+#include <vector>
+
+#include "linear_operator.hpp"
+#include "translation_grid.hpp"
+
+// Unknowns of the x, y and z translation grids in the column support of the Jacobian, i.e. the
+// unknowns of the nodes of all voxels containing correspondences. All other unknowns are only
+// constrained by their zero observations, i.e. they are zero in the solution of the normal
+// equations and can be eliminated before solving.
+class ActiveSet {
+ public:
+  // Determines the active unknowns for the correspondences at X. The grids must share their
+  // geometry and their unknowns must be ordered x, y, z.
+  void Update(const TranslationGrid& x_translation_grid, const TranslationGrid& y_translation_grid,
+              const TranslationGrid& z_translation_grid, const Eigen::MatrixX3d& X);
+
+  // Restriction of N to the rows and columns of the active unknowns. pattern_version identifies
+  // the sparsity pattern of N; see pattern_version for the one of the restricted matrix.
+  Eigen::SparseMatrix<double> Restrict(const Eigen::SparseMatrix<double>& N,
+                                       const uint64_t& pattern_version);
+  // Restriction of the linear operator N
+  LinearOperator Restrict(const LinearOperator& N) const;
+  // Entries of v of the active unknowns
+  Eigen::VectorXd Restrict(const Eigen::VectorXd& v) const;
+  // Vector of all unknowns with the values x_active for the active ones and zero for all others
+  Eigen::VectorXd Prolong(const Eigen::VectorXd& x_active) const;
+
+  // Getters
+  int num_active_unknowns() const;
+  const int& num_unknowns() const;
+  // Changes whenever the active unknowns or the sparsity pattern of the restricted N change
+  const uint64_t& pattern_version() const;
+
+ private:
+  int num_unknowns_{0};
+  // Sorted indices of the active unknowns
+  std::vector<int> active_unknowns_{};
+  // For each unknown: its index in active_unknowns_ or -1
+  std::vector<int> active_idx_{};
+  bool active_unknowns_changed_{true};
+  uint64_t input_pattern_version_{0};
+  uint64_t pattern_version_{0};
+};
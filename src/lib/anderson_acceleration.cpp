@@ -0,0 +1,54 @@
+#include "anderson_acceleration.hpp"
+
+void AndersonAcceleration::SetHistorySize(const int& history_size) {
+  history_size_ = history_size;
+  Reset();
+}
+
+void AndersonAcceleration::Reset() {
+  previous_x_.resize(0);
+  previous_f_.resize(0);
+  delta_x_.clear();
+  delta_f_.clear();
+  num_restarts_ = 0;
+}
+
+Eigen::VectorXd AndersonAcceleration::Extrapolate(const Eigen::VectorXd& x,
+                                                  const Eigen::VectorXd& g_x) {
+  if (history_size_ <= 0) return g_x;
+
+  Eigen::VectorXd f{g_x - x};
+  if (previous_f_.size() != f.size()) {
+    // First iterate or changed number of unknowns
+    delta_x_.clear();
+    delta_f_.clear();
+  } else if (f.norm() > previous_f_.norm()) {
+    // Safeguard: the last extrapolation increased the residual
+    delta_x_.clear();
+    delta_f_.clear();
+    num_restarts_++;
+  } else {
+    delta_x_.push_back(x - previous_x_);
+    delta_f_.push_back(f - previous_f_);
+    if (static_cast<int>(delta_x_.size()) > history_size_) {
+      delta_x_.pop_front();
+      delta_f_.pop_front();
+    }
+  }
+  previous_x_ = x;
+  previous_f_ = f;
+
+  if (delta_f_.empty()) return g_x;
+
+  // gamma = argmin ||f - dF*gamma||, x_next = g_x - (dX + dF)*gamma
+  int m{static_cast<int>(delta_f_.size())};
+  Eigen::MatrixXd dF(f.size(), m);
+  for (int j = 0; j < m; j++) dF.col(j) = delta_f_[j];
+  Eigen::VectorXd gamma{dF.colPivHouseholderQr().solve(f)};
+  Eigen::VectorXd x_next{g_x};  // returned
+  for (int j = 0; j < m; j++) x_next -= gamma(j) * (delta_x_[j] + delta_f_[j]);
+  return x_next;
+}
+
+int AndersonAcceleration::num_history() const { return static_cast<int>(delta_f_.size()); }
+const int& AndersonAcceleration::num_restarts() const { return num_restarts_; }
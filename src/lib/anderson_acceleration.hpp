@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <deque>
+
+// Anderson acceleration of a fixed-point iteration x_{k+1} = g(x_k), here the outer ICP iteration
+// which maps the grid values used for matching to the solution of the normal equations. The
+// differences of the last history_size iterates and of their residuals f_k = g(x_k) - x_k are
+// kept, and the next iterate is extrapolated with the combination of them which minimizes the
+// linearized residual. If the residual increases, the history is discarded and the plain
+// fixed-point step is taken instead.
+class AndersonAcceleration {
+ public:
+  // Number of kept differences; 0 disables the acceleration, i.e. Extrapolate returns g_x
+  void SetHistorySize(const int& history_size);
+  void Reset();
+
+  // Returns the next iterate from the iterate x and its image g_x = g(x)
+  Eigen::VectorXd Extrapolate(const Eigen::VectorXd& x, const Eigen::VectorXd& g_x);
+
+  // Getters
+  // Number of differences used by the last call of Extrapolate
+  int num_history() const;
+  // Number of times the history was discarded because the residual increased
+  const int& num_restarts() const;
+
+ private:
+  int history_size_{0};
+  Eigen::VectorXd previous_x_{};
+  Eigen::VectorXd previous_f_{};
+  std::deque<Eigen::VectorXd> delta_x_{};
+  std::deque<Eigen::VectorXd> delta_f_{};
+  int num_restarts_{0};
+};
@@ -0,0 +1,59 @@
+#include "block_sparse_matrix.hpp"
+
+#include <algorithm>
+
+#include "parallel.hpp"
+
+void BlockSparseMatrix::SetPattern(std::vector<int64_t> outer, std::vector<int> inner) {
+  outer_ = std::move(outer);
+  inner_ = std::move(inner);
+  values_.assign(9 * inner_.size(), 0.0);
+}
+
+void BlockSparseMatrix::SetZero() { std::fill(values_.begin(), values_.end(), 0.0); }
+
+void BlockSparseMatrix::Multiply(const Eigen::VectorXd& x, Eigen::VectorXd& y) const {
+  int n{num_block_rows()};
+  y.resize(3 * static_cast<int64_t>(n));
+  ParallelFor(0, n, [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+    for (int64_t i = first; i < last; i++) {
+      double y_x{0}, y_y{0}, y_z{0};
+      for (int64_t k = outer_[i]; k < outer_[i + 1]; k++) {
+        const double* block{values_.data() + 9 * k};
+        int64_t j{inner_[k]};
+        double x_x{x(j)}, x_y{x(n + j)}, x_z{x(2 * n + j)};
+        y_x += block[0] * x_x + block[1] * x_y + block[2] * x_z;
+        y_y += block[3] * x_x + block[4] * x_y + block[5] * x_z;
+        y_z += block[6] * x_x + block[7] * x_y + block[8] * x_z;
+      }
+      y(i) = y_x;
+      y(n + i) = y_y;
+      y(2 * n + i) = y_z;
+    }
+  });
+}
+
+Eigen::VectorXd BlockSparseMatrix::Diagonal() const {
+  int n{num_block_rows()};
+  Eigen::VectorXd diagonal{Eigen::VectorXd::Zero(3 * static_cast<int64_t>(n))};  // returned
+  for (int i = 0; i < n; i++) {
+    for (int64_t k = outer_[i]; k < outer_[i + 1]; k++) {
+      if (inner_[k] != i) continue;
+      for (int g = 0; g < 3; g++) diagonal(g * n + i) = values_[9 * k + 4 * g];
+    }
+  }
+  return diagonal;
+}
+
+int BlockSparseMatrix::rows() const { return 3 * num_block_rows(); }
+int BlockSparseMatrix::num_block_rows() const { return static_cast<int>(outer_.size()) - 1; }
+int64_t BlockSparseMatrix::num_blocks() const { return static_cast<int64_t>(inner_.size()); }
+const std::vector<int64_t>& BlockSparseMatrix::outer() const { return outer_; }
+const std::vector<int>& BlockSparseMatrix::inner() const { return inner_; }
+double* BlockSparseMatrix::values() { return values_.data(); }
+const double* BlockSparseMatrix::values() const { return values_.data(); }
+
+size_t BlockSparseMatrix::memory() const {
+  return outer_.size() * sizeof(int64_t) + inner_.size() * sizeof(int) +
+         values_.size() * sizeof(double);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+
+// Sparse matrix of 3x3 blocks for the unknowns of the x, y and z translation grids, which share
+// their geometry. With n unknowns per grid, block (i, j) holds the entries A(g*n+i, h*n+j) for
+// the grids g, h in {x, y, z}, i.e. the sparsity pattern of the 9 grid pairs is stored once with a
+// ninth of the indices of a scalar sparse matrix. The blocks are stored row by row (BSR) and the
+// values of a block in row-major order.
+class BlockSparseMatrix {
+ public:
+  // Sets the pattern: the blocks of block row i have the block columns
+  // inner[outer[i]] to inner[outer[i+1]-1]. All values are set to zero.
+  void SetPattern(std::vector<int64_t> outer, std::vector<int> inner);
+  void SetZero();
+
+  // Computes y = A*x for vectors of all 3*n unknowns; the block rows are processed in parallel
+  void Multiply(const Eigen::VectorXd& x, Eigen::VectorXd& y) const;
+  Eigen::VectorXd Diagonal() const;
+
+  // Getters
+  int rows() const;
+  int num_block_rows() const;
+  int64_t num_blocks() const;
+  const std::vector<int64_t>& outer() const;
+  const std::vector<int>& inner() const;
+  // The 9 values of block k start at values()[9*k]
+  double* values();
+  const double* values() const;
+  // Memory of the pattern and the values in bytes
+  size_t memory() const;
+
+ private:
+  std::vector<int64_t> outer_{0};
+  std::vector<int> inner_{};
+  std::vector<double> values_{};
+};
@@ -1,9 +1,8 @@
 #include "correspondences.hpp"
 
-#include <nanoflann.hpp>
 #include <numeric>
 
-const int LEAF_SIZE{200};
+#include "parallel.hpp"
 
 Correspondences::Correspondences(PtCloud& pc_fix, PtCloud& pc_mov)
     : pc_fix_{pc_fix}, pc_mov_{pc_mov} {}
@@ -12,15 +11,47 @@ void Correspondences::SelectPointsByRandomSampling(const uint32_t& num_correspon
   idx_pc_fix_ = RandInt(0, (int)pc_fix_.NumPts() - 1, num_correspondences);
 }
 
+void Correspondences::SelectMovablePointsByRandomSampling(const uint32_t& num_correspondences) {
+  idx_pc_mov_ = RandInt(0, (int)pc_mov_.NumPts() - 1, num_correspondences);
+}
+
 void Correspondences::MatchPointsByNearestNeighbor() {
   Eigen::MatrixXd pc_fix_X_sel{GetSelectedPoints_()};
 
   idx_pc_mov_ = std::vector<int>(num());
 
   Eigen::MatrixXi idx_nn(num(), 1);
-  idx_nn = KnnSearch(pc_mov_.Xt(), pc_fix_X_sel, 1);
+  if (pc_mov_.HasRegionOfInterest()) {
+    // Index only the points in the region of interest, as only these are transformed
+    Eigen::MatrixXd pc_mov_Xt_roi{pc_mov_.Xt()(pc_mov_.idx_roi(), Eigen::all)};
+    idx_nn = KnnSearch(pc_mov_Xt_roi, pc_fix_X_sel, 1);
+    for (int i = 0; i < idx_nn.rows(); i++) {
+      idx_pc_mov_[i] = pc_mov_.idx_roi()[idx_nn(i, 0)];
+    }
+  } else {
+    idx_nn = KnnSearch(pc_mov_.Xt(), pc_fix_X_sel, 1);
+    for (int i = 0; i < idx_nn.rows(); i++) {
+      idx_pc_mov_[i] = idx_nn(i, 0);
+    }
+  }
+
+  ComputeDists();
+}
+
+void Correspondences::MatchPointsByNearestNeighborInFixedPointCloud(const KdTree& pc_fix_index) {
+  Eigen::MatrixXd pc_mov_Xt_sel(idx_pc_mov_.size(), 3);
+  for (size_t i = 0; i < idx_pc_mov_.size(); i++) {
+    pc_mov_Xt_sel(i, 0) = pc_mov_.Xt()(idx_pc_mov_[i], 0);
+    pc_mov_Xt_sel(i, 1) = pc_mov_.Xt()(idx_pc_mov_[i], 1);
+    pc_mov_Xt_sel(i, 2) = pc_mov_.Xt()(idx_pc_mov_[i], 2);
+  }
+
+  idx_pc_fix_ = std::vector<int>(idx_pc_mov_.size());
+
+  Eigen::MatrixXi idx_nn(num(), 1);
+  idx_nn = pc_fix_index.KnnSearch(pc_mov_Xt_sel, 1);
   for (int i = 0; i < idx_nn.rows(); i++) {
-    idx_pc_mov_[i] = idx_nn(i, 0);
+    idx_pc_fix_[i] = idx_nn(i, 0);
   }
 
   ComputeDists();
@@ -126,6 +157,7 @@ CorrespondencesPointsWithAttributes Correspondences::GetCorrespondences() {
   X.pc_fix_nz = pc_fix_nz;
   X.pc_mov_X = pc_mov_X;
   X.pc_mov_Xt = pc_mov_Xt;
+  X.pc_mov_idx = idx_pc_mov_;
 
   return X;
 }
@@ -174,75 +206,67 @@ void Correspondences::ComputeDists() {
     throw std::runtime_error("Number of correspondences is zero!");
   }
 
-  for (int i = 0; i < X.num; i++) {
-    double dx{X.pc_mov_X(i, 0) - X.pc_fix_X(i, 0)};
-    double dy{X.pc_mov_X(i, 1) - X.pc_fix_X(i, 1)};
-    double dz{X.pc_mov_X(i, 2) - X.pc_fix_X(i, 2)};
-
-    double dxt{X.pc_mov_Xt(i, 0) - X.pc_fix_X(i, 0)};
-    double dyt{X.pc_mov_Xt(i, 1) - X.pc_fix_X(i, 1)};
-    double dzt{X.pc_mov_Xt(i, 2) - X.pc_fix_X(i, 2)};
-
-    double point_to_plane_dist{dx * X.pc_fix_nx(i) + dy * X.pc_fix_ny(i) + dz * X.pc_fix_nz(i)};
-    double point_to_plane_dist_t{dxt * X.pc_fix_nx(i) + dyt * X.pc_fix_ny(i) +
-                                 dzt * X.pc_fix_nz(i)};
-    double euclidean_dist{sqrt(pow(dx, 2) + pow(dy, 2) + pow(dz, 2))};
-    double euclidean_dist_t{sqrt(pow(dxt, 2) + pow(dyt, 2) + pow(dzt, 2))};
-
-    point_to_plane_dists_.dists(i) = point_to_plane_dist;
-    point_to_plane_dists_t_.dists(i) = point_to_plane_dist_t;
-    euclidean_dists_.dists(i) = euclidean_dist;
-    euclidean_dists_t_.dists(i) = euclidean_dist_t;
-  }
+  ParallelFor(0, X.num, [&](const int64_t& first, const int64_t& last, const int& /*chunk_idx*/) {
+    for (int64_t i = first; i < last; i++) {
+      double dx{X.pc_mov_X(i, 0) - X.pc_fix_X(i, 0)};
+      double dy{X.pc_mov_X(i, 1) - X.pc_fix_X(i, 1)};
+      double dz{X.pc_mov_X(i, 2) - X.pc_fix_X(i, 2)};
+
+      double dxt{X.pc_mov_Xt(i, 0) - X.pc_fix_X(i, 0)};
+      double dyt{X.pc_mov_Xt(i, 1) - X.pc_fix_X(i, 1)};
+      double dzt{X.pc_mov_Xt(i, 2) - X.pc_fix_X(i, 2)};
+
+      double point_to_plane_dist{dx * X.pc_fix_nx(i) + dy * X.pc_fix_ny(i) + dz * X.pc_fix_nz(i)};
+      double point_to_plane_dist_t{dxt * X.pc_fix_nx(i) + dyt * X.pc_fix_ny(i) +
+                                   dzt * X.pc_fix_nz(i)};
+      double euclidean_dist{sqrt(pow(dx, 2) + pow(dy, 2) + pow(dz, 2))};
+      double euclidean_dist_t{sqrt(pow(dxt, 2) + pow(dyt, 2) + pow(dzt, 2))};
+
+      point_to_plane_dists_.dists(i) = point_to_plane_dist;
+      point_to_plane_dists_t_.dists(i) = point_to_plane_dist_t;
+      euclidean_dists_.dists(i) = euclidean_dist;
+      euclidean_dists_t_.dists(i) = euclidean_dist_t;
+    }
+  });
 
   // Compute stats
-  point_to_plane_dists_.mean = point_to_plane_dists_.dists.mean();
-  point_to_plane_dists_.median = Median(point_to_plane_dists_.dists);
-  point_to_plane_dists_.std = Std(point_to_plane_dists_.dists);
-  point_to_plane_dists_.std_mad = 1.4826 * MAD(point_to_plane_dists_.dists);
-
-  point_to_plane_dists_t_.mean = point_to_plane_dists_t_.dists.mean();
-  point_to_plane_dists_t_.median = Median(point_to_plane_dists_t_.dists);
-  point_to_plane_dists_t_.std = Std(point_to_plane_dists_t_.dists);
-  point_to_plane_dists_t_.std_mad = 1.4826 * MAD(point_to_plane_dists_t_.dists);
-
-  euclidean_dists_.mean = euclidean_dists_.dists.mean();
-  euclidean_dists_.median = Median(euclidean_dists_.dists);
-  euclidean_dists_.std = Std(euclidean_dists_.dists);
-  euclidean_dists_.std_mad = 1.4826 * MAD(euclidean_dists_.dists);
-
-  euclidean_dists_t_.mean = euclidean_dists_t_.dists.mean();
-  euclidean_dists_t_.median = Median(euclidean_dists_t_.dists);
-  euclidean_dists_t_.std = Std(euclidean_dists_t_.dists);
-  euclidean_dists_t_.std_mad = 1.4826 * MAD(euclidean_dists_t_.dists);
+  auto set_stats = [this](Dists& d) {
+    auto statistics{ComputeStatistics(d.dists, statistics_mode_)};
+    d.mean = statistics.mean;
+    d.median = statistics.median;
+    d.std = statistics.std;
+    d.std_mad = 1.4826 * statistics.mad;
+  };
+  set_stats(point_to_plane_dists_);
+  set_stats(point_to_plane_dists_t_);
+  set_stats(euclidean_dists_);
+  set_stats(euclidean_dists_t_);
 }
 
 Eigen::MatrixXi KnnSearch(const Eigen::MatrixXd& X, const Eigen::MatrixXd& X_query, const int& k) {
-  // Create kd tree
-  typedef nanoflann::KDTreeEigenMatrixAdaptor<Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic>>
-      kd_tree;
-  kd_tree mat_index(X.cols(), std::cref(X), LEAF_SIZE);
-
-  // Iterate over all query points
-  Eigen::MatrixXi mat_idx_nn(X_query.rows(), k);
-  for (Eigen::Index i = 0; i < X_query.rows(); i++) {
-    // Query point
-    Eigen::VectorXd row = X_query.row(i);
-    std::vector<double> qp{row.data(), row.data() + row.size()};
-
-    // Search for nn of query point
-    std::vector<size_t> idx_nn(k);
-    std::vector<double> dists_nn(k);  // not used
-    nanoflann::KNNResultSet<double> resultSet(k);
-    resultSet.init(&idx_nn[0], &dists_nn[0]);
-    mat_index.index_->findNeighbors(resultSet, &qp[0], nanoflann::SearchParameters(10));
-
-    // Save indices of nn to matrix
-    for (int j = 0; j < k; j++) {
-      mat_idx_nn(i, j) = idx_nn[j];
-    }
+  KdTree kd_tree{X};
+  kd_tree.Build();
+  return kd_tree.KnnSearch(X_query, k);
+}
+
+double FractionOfChangedCorrespondences(const std::vector<int>& previous_idx_pc_fix,
+                                        const std::vector<int>& previous_idx_pc_mov,
+                                        const std::vector<int>& idx_pc_fix,
+                                        const std::vector<int>& idx_pc_mov) {
+  if (idx_pc_fix.empty()) return 0;
+  auto pairs{[](const std::vector<int>& idx_fix, const std::vector<int>& idx_mov) {
+    std::vector<std::pair<int, int>> pairs(idx_fix.size());  // returned
+    for (size_t i = 0; i < idx_fix.size(); i++) pairs[i] = {idx_fix[i], idx_mov[i]};
+    std::sort(pairs.begin(), pairs.end());
+    return pairs;
+  }};
+  auto previous_pairs{pairs(previous_idx_pc_fix, previous_idx_pc_mov)};
+  auto current_pairs{pairs(idx_pc_fix, idx_pc_mov)};
+  size_t num_changed{0};
+  for (const auto& pair : current_pairs) {
+    if (!std::binary_search(previous_pairs.begin(), previous_pairs.end(), pair)) num_changed++;
   }
-  return mat_idx_nn;
+  return static_cast<double>(num_changed) / current_pairs.size();
 }
 
 std::vector<int> RandInt(const int& min_val, const int& max_val, const uint32_t& n) {
@@ -267,36 +291,6 @@ std::vector<int> RandInt(const int& min_val, const int& max_val, const uint32_t&
   return v;
 }
 
-double Median(const Eigen::VectorXd& v) {
-  // VectorXd --> vector<double>
-  std::vector<double> vv(v.size());
-  for (int i = 1; i < v.size(); i++) {
-    vv[i] = v[i];
-  }
-
-  // Median
-  const auto median_it = vv.begin() + vv.size() / 2;
-  nth_element(vv.begin(), median_it, vv.end());
-  auto median = *median_it;
-
-  return median;
-}
-
-double MAD(const Eigen::VectorXd& v) {
-  auto med{Median(v)};
-  Eigen::VectorXd dmed(v.size());
-  for (int i = 1; i < v.size(); i++) {
-    dmed[i] = abs(v[i] - med);
-  }
-  auto mad{Median(dmed)};
-  return mad;
-}
-
-double Std(const Eigen::VectorXd& v) {
-  double std{sqrt((v.array() - v.mean()).square().sum() / ((double)v.size() - 1))};
-  return std;
-}
-
 template <typename T>
 std::vector<T> Range(T start, T stop, T step) {
   std::vector<T> vals;
@@ -313,9 +307,17 @@ const Dists& Correspondences::point_to_plane_dists_t() { return point_to_plane_d
 const Dists& Correspondences::euclidean_dists() { return euclidean_dists_; }
 const Dists& Correspondences::euclidean_dists_t() { return euclidean_dists_t_; }
 std::vector<int> Correspondences::GetSelectedPoints() { return idx_pc_fix_; }
+std::vector<int> Correspondences::GetSelectedMovablePoints() { return idx_pc_mov_; }
 void Correspondences::SetSelectedPoints(const std::vector<int> idx_pc_fix) {
   idx_pc_fix_ = idx_pc_fix;
 }
+void Correspondences::SetSelectedMovablePoints(const std::vector<int> idx_pc_mov) {
+  idx_pc_mov_ = idx_pc_mov;
+}
+
+void Correspondences::SetStatisticsMode(const StatisticsMode& statistics_mode) {
+  statistics_mode_ = statistics_mode;
+}
 
 void Correspondences::ExportCorrespondences(const std::string& filepath) {
   auto X{GetCorrespondences()};
@@ -4,7 +4,9 @@
 #include <fstream>
 #include <random>
 
+#include "kd_tree.hpp"
 #include "pt_cloud.hpp"
+#include "statistics.hpp"
 
 struct Dists {
   Eigen::VectorXd dists{};
@@ -22,19 +24,27 @@ struct CorrespondencesPointsWithAttributes {
   Eigen::VectorXd pc_fix_nz{};
   Eigen::MatrixX3d pc_mov_X{};
   Eigen::MatrixX3d pc_mov_Xt{};
+  // Indices of the movable points in pc_mov
+  std::vector<int> pc_mov_idx{};
 };
 
 class Correspondences {
  public:
   Correspondences(PtCloud& pc_fix, PtCloud& pc_mov);
   void SelectPointsByRandomSampling(const uint32_t& num_correspondences);
+  void SelectMovablePointsByRandomSampling(const uint32_t& num_correspondences);
   void MatchPointsByNearestNeighbor();
+  // Matches the selected points of the movable point cloud with their nearest neighbors in the
+  // fixed point cloud; pc_fix_index must be a kd tree built over pc_fix.X()
+  void MatchPointsByNearestNeighborInFixedPointCloud(const KdTree& pc_fix_index);
   void MatchPointsByCorrespondenceId();
   void RejectMaxEuclideanDistanceCriteria(const double& max_euclidean_distance);
   void RejectStdMadCriteria();
   CorrespondencesPointsWithAttributes GetCorrespondences();
   void ComputeDists();
   void SetSelectedPoints(std::vector<int> idx_pc_fix);
+  void SetSelectedMovablePoints(std::vector<int> idx_pc_mov);
+  void SetStatisticsMode(const StatisticsMode& statistics_mode);
   void ExportCorrespondences(const std::string& debug_file_name);
 
   uint64_t num();
@@ -46,6 +56,7 @@ class Correspondences {
   const Dists& euclidean_dists();
   const Dists& euclidean_dists_t();
   std::vector<int> GetSelectedPoints();
+  std::vector<int> GetSelectedMovablePoints();
 
  private:
   Eigen::MatrixXd GetSelectedPoints_();
@@ -59,6 +70,7 @@ class Correspondences {
   Dists point_to_plane_dists_t_;
   Dists euclidean_dists_;
   Dists euclidean_dists_t_;
+  StatisticsMode statistics_mode_{StatisticsMode::kExact};
 };
 
 Eigen::MatrixXi KnnSearch(const Eigen::MatrixXd& X, const Eigen::MatrixXd& X_query,
@@ -67,14 +79,14 @@ Eigen::MatrixXi KnnSearch(const Eigen::MatrixXd& X, const Eigen::MatrixXd& X_que
 template <typename T>
 std::vector<T> KeepSubsetOfVector(const std::vector<T>& old_vector, const std::vector<bool>& keep);
 
-std::vector<int> RandInt(const int& min_val, const int& max_val, const uint32_t& n);
-
-double Median(const Eigen::VectorXd& v);
+// Fraction of the correspondences (idx_pc_fix[i], idx_pc_mov[i]) which are not contained in the
+// previous correspondences (previous_idx_pc_fix[j], previous_idx_pc_mov[j])
+double FractionOfChangedCorrespondences(const std::vector<int>& previous_idx_pc_fix,
+                                        const std::vector<int>& previous_idx_pc_mov,
+                                        const std::vector<int>& idx_pc_fix,
+                                        const std::vector<int>& idx_pc_mov);
 
-// Median of absolute differences (mad) with respect to the median
-double MAD(const Eigen::VectorXd& v);
-
-double Std(const Eigen::VectorXd& v);
+std::vector<int> RandInt(const int& min_val, const int& max_val, const uint32_t& n);
 
 template <typename T>
 std::vector<T> Range(T start, T stop, T step = 1);
\ No newline at end of file
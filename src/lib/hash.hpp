@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// Fast non-cryptographic 64 bit hash of a memory block (FNV-1a over 8 byte words)
+inline uint64_t Hash64(const void* data, const size_t& num_bytes,
+                       uint64_t hash = 14695981039346656037ULL) {
+  const uint64_t prime{1099511628211ULL};
+  const auto* bytes{static_cast<const unsigned char*>(data)};
+
+  size_t num_words{num_bytes / sizeof(uint64_t)};
+  for (size_t i = 0; i < num_words; i++) {
+    uint64_t word{};
+    std::memcpy(&word, bytes + i * sizeof(uint64_t), sizeof(uint64_t));
+    hash = (hash ^ word) * prime;
+  }
+  for (size_t i = num_words * sizeof(uint64_t); i < num_bytes; i++) {
+    hash = (hash ^ bytes[i]) * prime;
+  }
+
+  return hash;
+}
@@ -1,33 +1,49 @@
 #include "io_utils.hpp"
 
-NamedColumnMatrix<Eigen::MatrixXd> ImportFileToMatrix(const std::string& path,
-                                                      const bool& with_normals,
-                                                      const bool& with_correspondence_id) {
-  // Extract extension
-  std::string extension = std::filesystem::path(path).extension().string();
+#include <cstdint>
+#include <limits>
+#include <utility>
 
-  // Check if pdal supports the file format
-  pdal::StageFactory factory;
+#include "native_reader.hpp"
+#include "parallel.hpp"
+#include "point_sampler.hpp"
+#include "pt_cloud_cache.hpp"
 
-  // Create pdal reader type based on suffix
-  std::string pdal_reader_type;
-  if (extension == ".las" || extension == ".laz") {
-    pdal_reader_type = "readers.las";
-  } else if (extension == ".ply") {
-    pdal_reader_type = "readers.ply";
-  } else if (extension == ".xyz" || extension == ".txt") {
-    pdal_reader_type = "readers.text";
-  } else {
+namespace {
+
+// Number of points per batch if the pointcloud is cropped or sampled during the import
+const pdal::point_count_t BATCH_NUM_PTS{65536};
+
+using ConsumeBatch = std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>;
+
+void CheckFileFormatsAreEqual(const std::string& extension_in, const std::string& extension_out) {
+  if (extension_in != extension_out) {
     std::string error_string;
-    error_string += "File format '" + extension + "' is not supported.\n";
+    error_string += "Input and output file formats are not the same!\n";
+    error_string += "Input file format: " + extension_in + "\n";
+    error_string += "Output file format: " + extension_out + "\n";
     throw std::runtime_error(error_string);
   }
+}
+
+// Names of the columns of the matrix, see ExtractMatrix
+std::vector<std::string> ColNames(const bool& with_normals, const bool& with_correspondence_id) {
+  std::vector<std::string> col_names{"x", "y", "z"};
+  if (with_normals) col_names.insert(col_names.end(), {"nx", "ny", "nz"});
+  if (with_correspondence_id) col_names.emplace_back("correspondence_id");
+  return col_names;
+}
+
+// Reads the pointcloud with the PDAL reader of its file format
+pdal::PointViewPtr ReadPointView(const std::string& path, pdal::StageFactory& factory,
+                                 pdal::PointTable& table) {
+  // Extract extension
+  std::string extension = std::filesystem::path(path).extension().string();
 
   // Check if a reader type is available
-  pdal::Stage* reader = factory.createStage(pdal_reader_type);
+  pdal::Stage* reader = factory.createStage(CreatePDALReaderType(extension));
 
   // Initialize PDAL reader
-  pdal::PointTable table;
   pdal::Options options;
   options.add("filename", path);
   reader->setOptions(options);
@@ -40,9 +56,274 @@ NamedColumnMatrix<Eigen::MatrixXd> ImportFileToMatrix(const std::string& path,
   pdal::PointViewPtr view = *view_set.begin();
 
   if (view->empty()) throw std::runtime_error("Point cloud is empty!");
+  return view;
+}
+
+// Calls f with a value of the C++ type of a PDAL dimension type; returns false if the type is not
+// numeric
+template <typename F>
+bool VisitDimensionType(const pdal::Dimension::Type& type, F&& f) {
+  switch (type) {
+    case pdal::Dimension::Type::Double:
+      f(double{});
+      return true;
+    case pdal::Dimension::Type::Float:
+      f(float{});
+      return true;
+    case pdal::Dimension::Type::Signed8:
+      f(int8_t{});
+      return true;
+    case pdal::Dimension::Type::Signed16:
+      f(int16_t{});
+      return true;
+    case pdal::Dimension::Type::Signed32:
+      f(int32_t{});
+      return true;
+    case pdal::Dimension::Type::Signed64:
+      f(int64_t{});
+      return true;
+    case pdal::Dimension::Type::Unsigned8:
+      f(uint8_t{});
+      return true;
+    case pdal::Dimension::Type::Unsigned16:
+      f(uint16_t{});
+      return true;
+    case pdal::Dimension::Type::Unsigned32:
+      f(uint32_t{});
+      return true;
+    case pdal::Dimension::Type::Unsigned64:
+      f(uint64_t{});
+      return true;
+    default:
+      return false;
+  }
+}
 
-  // Return 6D eigen matrix
-  return ExtractMatrix(view, with_normals, with_correspondence_id);
+// Copies the dimension dim of all points to column. The type of the dimension is resolved once and
+// the raw values are copied in parallel ranges of points.
+void ExtractColumn(const pdal::PointView& view, const pdal::Dimension::Id& dim, double* column) {
+  auto extract = [&](auto value_type) {
+    using T = decltype(value_type);
+    ParallelFor(0, view.size(),
+                [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+                  T value{};
+                  for (int64_t idx = first; idx < last; idx++) {
+                    view.getRawField(dim, idx, &value);
+                    column[idx] = static_cast<double>(value);
+                  }
+                });
+  };
+  if (!VisitDimensionType(view.table().layout()->dimType(dim), extract)) {
+    for (pdal::PointId idx = 0; idx < view.size(); idx++) {
+      column[idx] = view.getFieldAs<double>(dim, idx);
+    }
+  }
+}
+
+// Inverse of ExtractColumn. Floating point dimensions are written in parallel ranges of points;
+// integer dimensions are converted by PDAL, which rounds and checks the range of the values.
+void UpdateColumn(pdal::PointView& view, const pdal::Dimension::Id& dim, const double* column) {
+  pdal::Dimension::Type type{view.table().layout()->dimType(dim)};
+  auto update = [&](auto value_type) {
+    using T = decltype(value_type);
+    ParallelFor(0, view.size(),
+                [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+                  for (int64_t idx = first; idx < last; idx++) {
+                    T value{static_cast<T>(column[idx])};
+                    view.setField(dim, type, idx, &value);
+                  }
+                });
+  };
+  if (type == pdal::Dimension::Type::Double) {
+    update(double{});
+  } else if (type == pdal::Dimension::Type::Float) {
+    update(float{});
+  } else {
+    for (pdal::PointId idx = 0; idx < view.size(); idx++) view.setField(dim, idx, column[idx]);
+  }
+}
+
+// Keeps only the points within the box
+void CropRows(NamedColumnMatrix<Eigen::MatrixXd>& x, const BoundingBox& box) {
+  Eigen::Index x_col{x.namedColIndex("x")};
+  Eigen::Index y_col{x.namedColIndex("y")};
+  Eigen::Index z_col{x.namedColIndex("z")};
+  Eigen::Index num_kept{0};
+  for (Eigen::Index i = 0; i < x.rows(); i++) {
+    if (!box.Contains(x(i, x_col), x(i, y_col), x(i, z_col))) continue;
+    if (num_kept != i) x.row(num_kept) = x.row(i);
+    num_kept++;
+  }
+  x.conservativeResize(num_kept, Eigen::NoChange);
+}
+
+// Reads the pointcloud with a streamed PDAL pipeline and passes its points to consume_batch batch
+// by batch, i.e. the pointcloud is never loaded completely. No point is read if the bounds of the
+// file, e.g. from the header of a las file, do not overlap crop. Returns false if the pipeline is
+// not streamable or if the pointcloud does not have all fields required.
+bool StreamMatrixBatches(const std::string& path, const bool& with_normals,
+                         const bool& with_correspondence_id, const std::optional<BoundingBox>& crop,
+                         const ConsumeBatch& consume_batch) {
+  std::string extension = std::filesystem::path(path).extension().string();
+  pdal::StageFactory factory;
+  pdal::Stage* reader = factory.createStage(CreatePDALReaderType(extension));
+  pdal::Options options;
+  options.add("filename", path);
+  reader->setOptions(options);
+
+  if (crop) {
+    pdal::QuickInfo info = reader->preview();
+    if (info.valid() && (info.m_bounds.maxx < crop->min(0) || info.m_bounds.minx > crop->max(0) ||
+                         info.m_bounds.maxy < crop->min(1) || info.m_bounds.miny > crop->max(1) ||
+                         info.m_bounds.maxz < crop->min(2) || info.m_bounds.minz > crop->max(2))) {
+      return true;
+    }
+  }
+
+  // The stages of a streamed pipeline process the points batch by batch, see StreamTransformFile
+  std::vector<std::string> col_names{ColNames(with_normals, with_correspondence_id)};
+  std::vector<pdal::Dimension::Id> dims;
+  pdal::FixedPointTable table(BATCH_NUM_PTS);
+  pdal::StreamCallbackFilter batch_filter;
+  batch_filter.setCallback([&](pdal::PointRef& point) {
+    if (point.pointId() != 0) return true;
+    pdal::point_count_t batch_num_points{table.numPoints()};
+    pdal::PointRef batch_point(table, 0);
+    NamedColumnMatrix<Eigen::MatrixXd> X(
+        Eigen::MatrixXd(batch_num_points, static_cast<Eigen::Index>(dims.size())), col_names);
+    for (pdal::PointId idx = 0; idx < batch_num_points; idx++) {
+      batch_point.setPointId(idx);
+      for (size_t col = 0; col < dims.size(); col++) {
+        X(idx, col) = batch_point.getFieldAs<double>(dims[col]);
+      }
+    }
+    if (with_correspondence_id) {
+      // Rounded as by getFieldAs<int>
+      Eigen::Index col{X.namedColIndex("correspondence_id")};
+      X.col(col) = X.col(col).array().round();
+    }
+    consume_batch(std::move(X));
+    return true;
+  });
+  batch_filter.setInput(*reader);
+  if (!batch_filter.pipelineStreamable()) return false;
+
+  batch_filter.prepare(table);
+  dims = {pdal::Dimension::Id::X, pdal::Dimension::Id::Y, pdal::Dimension::Id::Z};
+  if (with_normals) {
+    dims.insert(dims.end(), {pdal::Dimension::Id::NormalX, pdal::Dimension::Id::NormalY,
+                             pdal::Dimension::Id::NormalZ});
+  }
+  if (with_correspondence_id) dims.push_back(table.layout()->findDim("CorrespondenceID"));
+  for (const auto& dim : dims) {
+    if (dim == pdal::Dimension::Id::Unknown || !table.layout()->hasDim(dim)) return false;
+  }
+  batch_filter.execute(table);
+  return true;
+}
+
+NamedColumnMatrix<Eigen::MatrixXd> ConcatenateBatches(
+    std::vector<NamedColumnMatrix<Eigen::MatrixXd>>& batches,
+    const std::vector<std::string>& col_names) {
+  if (batches.size() == 1) return std::move(batches[0]);
+  Eigen::Index num_pts{0};
+  for (const auto& batch : batches) num_pts += batch.rows();
+  NamedColumnMatrix<Eigen::MatrixXd> x(
+      Eigen::MatrixXd(num_pts, static_cast<Eigen::Index>(col_names.size())), col_names);
+  Eigen::Index first_row{0};
+  for (auto& batch : batches) {
+    x.middleRows(first_row, batch.rows()) = batch;
+    first_row += batch.rows();
+    batch.resize(0, 0);
+  }
+  return x;
+}
+
+}  // namespace
+
+bool BoundingBox::Contains(const double& x, const double& y, const double& z) const {
+  return x >= min(0) && x <= max(0) && y >= min(1) && y <= max(1) && z >= min(2) && z <= max(2);
+}
+
+NamedColumnMatrix<Eigen::MatrixXd> ImportFileToMatrix(const std::string& path,
+                                                      const bool& with_normals,
+                                                      const bool& with_correspondence_id,
+                                                      const ImportOptions& options) {
+  std::vector<std::string> col_names{ColNames(with_normals, with_correspondence_id)};
+
+  // The points are cropped and sampled batch by batch, otherwise the file is read at once
+  bool in_batches{options.crop.has_value() || options.num_samples > 0};
+  Eigen::Index batch_num_pts{in_batches ? static_cast<Eigen::Index>(BATCH_NUM_PTS)
+                                        : std::numeric_limits<Eigen::Index>::max()};
+  std::vector<NamedColumnMatrix<Eigen::MatrixXd>> batches;
+  std::optional<PointSampler> sampler;
+  auto reset = [&]() {
+    batches.clear();
+    if (options.num_samples > 0) {
+      sampler.emplace(options.num_samples, static_cast<Eigen::Index>(col_names.size()),
+                      options.sampling_voxel_size);
+    }
+  };
+  auto consume_batch = [&](NamedColumnMatrix<Eigen::MatrixXd>&& batch) {
+    if (options.crop) CropRows(batch, *options.crop);
+    if (sampler) {
+      sampler->Add(batch);
+    } else {
+      batches.push_back(std::move(batch));
+    }
+  };
+
+  // Use the cache of the pointcloud if it is fresh
+  reset();
+  bool is_read{
+      LoadPtCloudCache(path, with_normals, with_correspondence_id, batch_num_pts, consume_batch)};
+
+  // Parse text and binary ply files natively, PDAL is the fallback for all other files
+  if (!is_read) {
+    reset();
+    is_read = ReadPointcloudNatively(path, with_normals, with_correspondence_id, batch_num_pts,
+                                     consume_batch);
+  }
+  if (!is_read && in_batches) {
+    reset();
+    is_read = StreamMatrixBatches(path, with_normals, with_correspondence_id, options.crop,
+                                  consume_batch);
+  }
+  if (!is_read) {
+    reset();
+    pdal::StageFactory factory;
+    pdal::PointTable table;
+    pdal::PointViewPtr view = ReadPointView(path, factory, table);
+    consume_batch(ExtractMatrix(view, with_normals, with_correspondence_id));
+  }
+
+  NamedColumnMatrix<Eigen::MatrixXd> x{sampler ? NamedColumnMatrix<Eigen::MatrixXd>(
+                                                     sampler->Samples(), col_names)
+                                               : ConcatenateBatches(batches, col_names)};
+  if (x.rows() == 0) {
+    if (options.crop) {
+      throw std::runtime_error("Point cloud \"" + path + "\" has no points within the crop box!");
+    }
+    throw std::runtime_error("Point cloud is empty!");
+  }
+
+  return x;
+}
+
+NamedColumnMatrix<Eigen::MatrixXd> CachePointcloud(const std::string& path) {
+  pdal::StageFactory factory;
+  pdal::PointTable table;
+  pdal::PointViewPtr view = ReadPointView(path, factory, table);
+
+  // Cache all fields which are present
+  bool with_normals = view->hasDim(pdal::Dimension::Id::NormalX) &&
+                      view->hasDim(pdal::Dimension::Id::NormalY) &&
+                      view->hasDim(pdal::Dimension::Id::NormalZ);
+  bool with_correspondence_id =
+      view->table().layout()->findDim("CorrespondenceID") != pdal::Dimension::Id::Unknown;
+  auto x = ExtractMatrix(view, with_normals, with_correspondence_id);
+  SavePtCloudCache(x, path, with_normals, with_correspondence_id);
+  return x;
 }
 
 NamedColumnMatrix<Eigen::MatrixXd> ExtractMatrix(const pdal::PointViewPtr view,
@@ -107,18 +388,18 @@ NamedColumnMatrix<Eigen::MatrixXd> ExtractMatrix(const pdal::PointViewPtr view,
     correspondence_id_col = x.namedColIndex("correspondence_id");
   }
 
-  for (pdal::PointId idx = 0; idx < view->size(); idx++) {
-    x(idx, x_col) = view->getFieldAs<double>(pdal::Dimension::Id::X, idx);
-    x(idx, y_col) = view->getFieldAs<double>(pdal::Dimension::Id::Y, idx);
-    x(idx, z_col) = view->getFieldAs<double>(pdal::Dimension::Id::Z, idx);
-    if (with_normals) {
-      x(idx, nx_col) = view->getFieldAs<double>(pdal::Dimension::Id::NormalX, idx);
-      x(idx, ny_col) = view->getFieldAs<double>(pdal::Dimension::Id::NormalY, idx);
-      x(idx, nz_col) = view->getFieldAs<double>(pdal::Dimension::Id::NormalZ, idx);
-    }
-    if (with_correspondence_id) {
-      x(idx, correspondence_id_col) = view->getFieldAs<int>(correspondence_id_dimension, idx);
-    }
+  ExtractColumn(*view, pdal::Dimension::Id::X, x.col(x_col).data());
+  ExtractColumn(*view, pdal::Dimension::Id::Y, x.col(y_col).data());
+  ExtractColumn(*view, pdal::Dimension::Id::Z, x.col(z_col).data());
+  if (with_normals) {
+    ExtractColumn(*view, pdal::Dimension::Id::NormalX, x.col(nx_col).data());
+    ExtractColumn(*view, pdal::Dimension::Id::NormalY, x.col(ny_col).data());
+    ExtractColumn(*view, pdal::Dimension::Id::NormalZ, x.col(nz_col).data());
+  }
+  if (with_correspondence_id) {
+    // Rounded as by getFieldAs<int>
+    ExtractColumn(*view, correspondence_id_dimension, x.col(correspondence_id_col).data());
+    x.col(correspondence_id_col) = x.col(correspondence_id_col).array().round();
   }
 
   return x;
@@ -135,16 +416,20 @@ void UpdateTransformedPointcloud(const pdal::PointViewPtr view,
     throw std::runtime_error(error_string);
   }
 
+  // The matrix may come from the cache or the native reader instead of the point cloud read here
+  if (x_updated.rows() != static_cast<Eigen::Index>(view->size())) {
+    throw std::runtime_error("Point cloud has " + std::to_string(view->size()) + " points, but " +
+                             std::to_string(x_updated.rows()) + " transformed points are given!");
+  }
+
   // Get named column indices once
   Eigen::Index x_col, y_col, z_col;
   x_col = x_updated.namedColIndex("x");
   y_col = x_updated.namedColIndex("y");
   z_col = x_updated.namedColIndex("z");
-  for (pdal::PointId idx = 0; idx < view->size(); idx++) {
-    view->setField(pdal::Dimension::Id::X, idx, x_updated(idx, x_col));
-    view->setField(pdal::Dimension::Id::Y, idx, x_updated(idx, y_col));
-    view->setField(pdal::Dimension::Id::Z, idx, x_updated(idx, z_col));
-  }
+  UpdateColumn(*view, pdal::Dimension::Id::X, x_updated.col(x_col).data());
+  UpdateColumn(*view, pdal::Dimension::Id::Y, x_updated.col(y_col).data());
+  UpdateColumn(*view, pdal::Dimension::Id::Z, x_updated.col(z_col).data());
 }
 
 std::string PointcloudFieldsToString(const pdal::PointViewPtr view) {
@@ -170,14 +455,7 @@ void SaveMatrixToFile(const NamedColumnMatrix<Eigen::MatrixXd>& x_updated,
   std::string pdal_reader_type = CreatePDALReaderType(extension_in);
   std::string pdal_writer_type = CreatePDALWriterType(extension_out);
 
-  // Check if input and output file formats are the same
-  if (extension_in != extension_out) {
-    std::string error_string;
-    error_string += "Input and output file formats are not the same!\n";
-    error_string += "Input file format: " + extension_in + "\n";
-    error_string += "Output file format: " + extension_out + "\n";
-    throw std::runtime_error(error_string);
-  }
+  CheckFileFormatsAreEqual(extension_in, extension_out);
 
   // Create stage factory
   pdal::StageFactory factory;
@@ -220,6 +498,84 @@ void SaveMatrixToFile(const NamedColumnMatrix<Eigen::MatrixXd>& x_updated,
   writer->execute(table);
 }
 
+pdal::point_count_t StreamTransformFile(
+    const std::string& path_in, const std::string& path_out, const pdal::point_count_t& batch_size,
+    const std::function<void(Eigen::MatrixX3d&)>& transform_batch) {
+  // Extract extension
+  std::string extension_in = std::filesystem::path(path_in).extension().string();
+  std::string extension_out = std::filesystem::path(path_out).extension().string();
+  CheckFileFormatsAreEqual(extension_in, extension_out);
+
+  // Create stage factory
+  pdal::StageFactory factory;
+
+  // Initialize PDAL reader
+  pdal::Stage* reader = factory.createStage(CreatePDALReaderType(extension_in));
+  pdal::Options options;
+  options.add("filename", path_in);
+  reader->setOptions(options);
+
+  // The stages of a streamed pipeline process the points batch by batch: the reader fills the
+  // table, then each following stage processes all points of the table. Thus the whole batch is
+  // available at the first point of the batch and is transformed at once.
+  pdal::FixedPointTable table(batch_size);
+  Eigen::MatrixX3d X;
+  pdal::point_count_t num_points{0};
+  pdal::StreamCallbackFilter transform_filter;
+  transform_filter.setCallback([&](pdal::PointRef& point) {
+    if (point.pointId() != 0) return true;
+    pdal::point_count_t batch_num_points{table.numPoints()};
+    pdal::PointRef batch_point(table, 0);
+    X.resize(batch_num_points, 3);
+    for (pdal::PointId idx = 0; idx < batch_num_points; idx++) {
+      batch_point.setPointId(idx);
+      X(idx, 0) = batch_point.getFieldAs<double>(pdal::Dimension::Id::X);
+      X(idx, 1) = batch_point.getFieldAs<double>(pdal::Dimension::Id::Y);
+      X(idx, 2) = batch_point.getFieldAs<double>(pdal::Dimension::Id::Z);
+    }
+    transform_batch(X);
+    for (pdal::PointId idx = 0; idx < batch_num_points; idx++) {
+      batch_point.setPointId(idx);
+      batch_point.setField(pdal::Dimension::Id::X, X(idx, 0));
+      batch_point.setField(pdal::Dimension::Id::Y, X(idx, 1));
+      batch_point.setField(pdal::Dimension::Id::Z, X(idx, 2));
+    }
+    num_points += batch_num_points;
+    return true;
+  });
+  transform_filter.setInput(*reader);
+
+  // PDAL Writer
+  pdal::Stage* writer = factory.createStage(CreatePDALWriterType(extension_out));
+  pdal::Options writer_options = CreatePDALWriterOptions(extension_out);
+  writer_options.add("filename", path_out);
+  writer->setOptions(writer_options);
+  writer->setInput(transform_filter);
+
+  if (!writer->pipelineStreamable()) {
+    std::string error_string;
+    error_string += "File format '" + extension_in + "' does not support streaming.\n";
+    throw std::runtime_error(error_string);
+  }
+
+  // Prepare the writer
+  writer->prepare(table);
+  if (!table.layout()->hasDim(pdal::Dimension::Id::X) ||
+      !table.layout()->hasDim(pdal::Dimension::Id::Y) ||
+      !table.layout()->hasDim(pdal::Dimension::Id::Z)) {
+    std::string error_string;
+    error_string += "Point cloud does not have all required fields!\n";
+    error_string += "Fields required: X, Y, Z\n";
+    throw std::runtime_error(error_string);
+  }
+
+  // Execute the streamed pipeline
+  writer->execute(table);
+  if (num_points == 0) throw std::runtime_error("Point cloud is empty!");
+
+  return num_points;
+}
+
 std::string CreatePDALReaderType(const std::string& extension) {
   std::string pdal_reader_type;
   if (extension == ".las" || extension == ".laz") {
@@ -1,23 +1,56 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <optional>
 #include <pdal/Options.hpp>
 #include <pdal/PipelineManager.hpp>
+#include <pdal/PointRef.hpp>
 #include <pdal/PointTable.hpp>
 #include <pdal/PointView.hpp>
+#include <pdal/QuickInfo.hpp>
 #include <pdal/StageFactory.hpp>
+#include <pdal/filters/StreamCallbackFilter.hpp>
 #include <pdal/io/BufferReader.hpp>
 #include <pdal/io/LasReader.hpp>
 #include <pdal/io/LasWriter.hpp>
 
 #include "src/lib/named_column_matrix.hpp"
 
+// Axis-aligned box
+struct BoundingBox {
+  Eigen::RowVector3d min{};
+  Eigen::RowVector3d max{};
+
+  bool Contains(const double& x, const double& y, const double& z) const;
+};
+
+struct ImportOptions {
+  // Points outside of this box are dropped during the import
+  std::optional<BoundingBox> crop{};
+  // Number of points sampled during the import (0: all points), see PointSampler
+  uint32_t num_samples{0};
+  // Voxel size for stratified sampling (0: reservoir sampling)
+  double sampling_voxel_size{0};
+};
+
+// Uses the cache of the pointcloud if it is fresh, see CachePointcloud, and parses text and binary
+// ply files natively, see ReadPointcloudNatively
+// With options.crop or options.num_samples, the points are read batch by batch and all other files
+// are read with a streamed PDAL pipeline if possible, i.e. only the points within the box or the
+// sampled points are kept in memory, and files whose header bounds do not overlap the box are not
+// read at all; throws if no point is within the box
 NamedColumnMatrix<Eigen::MatrixXd> ImportFileToMatrix(const std::string& path,
                                                       const bool& with_normals,
-                                                      const bool& with_correspondence_id);
+                                                      const bool& with_correspondence_id,
+                                                      const ImportOptions& options = {});
+
+// Read pointcloud and save its cache with x, y, z and, if present, normals and correspondence ids
+NamedColumnMatrix<Eigen::MatrixXd> CachePointcloud(const std::string& path);
 
 // Matrix with x,y,z or x,y,z,nx,ny,nz
 NamedColumnMatrix<Eigen::MatrixXd> ExtractMatrix(const pdal::PointViewPtr view,
@@ -32,6 +65,16 @@ std::string PointcloudFieldsToString(const pdal::PointViewPtr view);
 void SaveMatrixToFile(const NamedColumnMatrix<Eigen::MatrixXd>& A, const std::string& path_in,
                       const std::string& path_out);
 
+// Stream pointcloud from path_in to path_out in batches of batch_size points, i.e. each point is
+// decoded once and the memory does not depend on the size of the pointcloud
+// transform_batch is called with the x, y, and z coordinates of each batch and overwrites them; all
+// other attributes remain unchanged
+// Throws if the reader or the writer of the file format does not support streaming
+// Returns the number of points
+pdal::point_count_t StreamTransformFile(
+    const std::string& path_in, const std::string& path_out, const pdal::point_count_t& batch_size,
+    const std::function<void(Eigen::MatrixX3d&)>& transform_batch);
+
 // Create PDAL reader signature from a file extension
 std::string CreatePDALReaderType(const std::string& extension);
 
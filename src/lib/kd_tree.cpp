@@ -0,0 +1,111 @@
+#include "kd_tree.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#include "hash.hpp"
+
+const int LEAF_SIZE{200};
+
+KdTree::KdTree(const Eigen::MatrixXd& X) : X_{X}, dataset_{X} {
+  index_ = std::make_unique<Index>(
+      X_.cols(), dataset_,
+      nanoflann::KDTreeSingleIndexAdaptorParams(
+          LEAF_SIZE, nanoflann::KDTreeSingleIndexAdaptorFlags::SkipInitialBuildIndex));
+}
+
+void KdTree::Build() { index_->buildIndex(); }
+
+void KdTree::Save(const std::string& filepath) {
+  auto write_value = [](std::ofstream& file, const auto& value) {
+    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  };
+
+  std::ofstream file{filepath, std::ios::out | std::ios::binary};
+  if (!file.is_open()) {
+    throw std::runtime_error("Cannot open file \"" + filepath + "\"!");
+  }
+
+  // Header identifies the point set the index was built for
+  KdTreeHeaderInfo header_info;
+  write_value(file, header_info.identifier);
+  write_value(file, header_info.fileversion);
+  write_value(file, static_cast<int64_t>(X_.rows()));
+  write_value(file, static_cast<int64_t>(X_.cols()));
+  write_value(file, HashOfPoints());
+
+  index_->saveIndex(file);
+
+  if (!file.good()) {
+    throw std::runtime_error("Error occurred writing file \"" + filepath + "\"!");
+  }
+}
+
+bool KdTree::Load(const std::string& filepath) {
+  auto read_value = [](std::ifstream& file, auto& var) {
+    file.read(reinterpret_cast<char*>(&var), sizeof(var));
+  };
+
+  if (!std::filesystem::exists(filepath)) return false;
+
+  std::ifstream file{filepath, std::ios::in | std::ios::binary};
+  if (!file.is_open()) {
+    throw std::runtime_error("Cannot open file \"" + filepath + "\"!");
+  }
+
+  KdTreeHeaderInfo header_info;
+  KdTreeHeaderInfo header_info_for_verification;
+  int64_t num_pts{};
+  int64_t num_dims{};
+  uint64_t hash{};
+  read_value(file, header_info.identifier);
+  read_value(file, header_info.fileversion);
+  read_value(file, num_pts);
+  read_value(file, num_dims);
+  read_value(file, hash);
+  if (!file.good() ||
+      strcmp(header_info.identifier, header_info_for_verification.identifier) != 0 ||
+      header_info.fileversion != header_info_for_verification.fileversion) {
+    throw std::runtime_error("File \"" + filepath + "\" is not a valid kd tree file!");
+  }
+
+  // Index was built for another point set
+  if (num_pts != X_.rows() || num_dims != X_.cols() || hash != HashOfPoints()) return false;
+
+  index_->loadIndex(file);
+
+  if (!file.good()) {
+    throw std::runtime_error("Error occurred reading file \"" + filepath + "\"!");
+  }
+  return true;
+}
+
+Eigen::MatrixXi KdTree::KnnSearch(const Eigen::MatrixXd& X_query, const int& k) const {
+  // Iterate over all query points
+  Eigen::MatrixXi mat_idx_nn(X_query.rows(), k);
+  for (Eigen::Index i = 0; i < X_query.rows(); i++) {
+    // Query point
+    Eigen::VectorXd row = X_query.row(i);
+    std::vector<double> qp{row.data(), row.data() + row.size()};
+
+    // Search for nn of query point
+    std::vector<size_t> idx_nn(k);
+    std::vector<double> dists_nn(k);  // not used
+    nanoflann::KNNResultSet<double> resultSet(k);
+    resultSet.init(&idx_nn[0], &dists_nn[0]);
+    index_->findNeighbors(resultSet, &qp[0], nanoflann::SearchParameters(10));
+
+    // Save indices of nn to matrix
+    for (int j = 0; j < k; j++) {
+      mat_idx_nn(i, j) = idx_nn[j];
+    }
+  }
+  return mat_idx_nn;
+}
+
+uint64_t KdTree::HashOfPoints() const {
+  return Hash64(X_.data(), static_cast<size_t>(X_.size()) * sizeof(double));
+}
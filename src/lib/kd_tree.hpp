@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <memory>
+#include <nanoflann.hpp>
+#include <string>
+
+// Adaptor to use the rows of an Eigen matrix as point set of a nanoflann kd tree
+struct KdTreeDataset {
+  const Eigen::MatrixXd& X;
+
+  size_t kdtree_get_point_count() const { return X.rows(); }
+  double kdtree_get_pt(const size_t idx, const size_t dim) const { return X(idx, dim); }
+  template <class BBOX>
+  bool kdtree_get_bbox(BBOX& /*bb*/) const {
+    return false;
+  }
+};
+
+// Kd tree over the rows of a matrix which can be saved to and loaded from a file. The matrix is
+// referenced, i.e. it must outlive the kd tree and must not be changed.
+class KdTree {
+ public:
+  KdTree(const Eigen::MatrixXd& X);
+  KdTree(const KdTree&) = delete;
+  KdTree& operator=(const KdTree&) = delete;
+
+  void Build();
+  void Save(const std::string& filepath);
+  // Returns false if the file does not exist or if it was not created for the referenced matrix
+  bool Load(const std::string& filepath);
+  Eigen::MatrixXi KnnSearch(const Eigen::MatrixXd& X_query, const int& k = 1) const;
+
+ private:
+  typedef nanoflann::KDTreeSingleIndexAdaptor<nanoflann::L2_Simple_Adaptor<double, KdTreeDataset>,
+                                              KdTreeDataset>
+      Index;
+
+  uint64_t HashOfPoints() const;
+
+  const Eigen::MatrixXd& X_;
+  KdTreeDataset dataset_;
+  std::unique_ptr<Index> index_;
+};
+
+struct KdTreeHeaderInfo {
+  char identifier[10]{"nricpkdt"};
+  int fileversion{1};
+};
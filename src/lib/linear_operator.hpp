@@ -0,0 +1,113 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <functional>
+
+class LinearOperator;
+
+namespace Eigen {
+namespace internal {
+// LinearOperator behaves like a sparse matrix in Eigen's expressions
+template <>
+struct traits<LinearOperator> : public Eigen::internal::traits<Eigen::SparseMatrix<double>> {};
+}  // namespace internal
+}  // namespace Eigen
+
+// Symmetric linear operator y = A*x which is only available as function, e.g. to solve linear
+// systems without assembling A. It can be used as matrix type of Eigen's iterative solvers together
+// with JacobiPreconditioner.
+class LinearOperator : public Eigen::EigenBase<LinearOperator> {
+ public:
+  typedef double Scalar;
+  typedef double RealScalar;
+  typedef int StorageIndex;
+  enum {
+    ColsAtCompileTime = Eigen::Dynamic,
+    MaxColsAtCompileTime = Eigen::Dynamic,
+    IsRowMajor = false
+  };
+  // Computes y = A*x; y is resized by the function
+  typedef std::function<void(const Eigen::VectorXd& x, Eigen::VectorXd& y)> ApplyFunction;
+
+  LinearOperator() = default;
+  LinearOperator(const Eigen::Index& size, ApplyFunction apply, const Eigen::VectorXd& diagonal)
+      : size_{size}, apply_{std::move(apply)}, diagonal_{diagonal} {}
+
+  Eigen::Index rows() const { return size_; }
+  Eigen::Index cols() const { return size_; }
+
+  template <typename Rhs>
+  Eigen::Product<LinearOperator, Rhs, Eigen::AliasFreeProduct> operator*(
+      const Eigen::MatrixBase<Rhs>& x) const {
+    return Eigen::Product<LinearOperator, Rhs, Eigen::AliasFreeProduct>(*this, x.derived());
+  }
+
+  void Apply(const Eigen::VectorXd& x, Eigen::VectorXd& y) const { apply_(x, y); }
+  const Eigen::VectorXd& diagonal() const { return diagonal_; }
+
+ private:
+  Eigen::Index size_{0};
+  ApplyFunction apply_{};
+  Eigen::VectorXd diagonal_{};
+};
+
+namespace Eigen {
+namespace internal {
+template <typename Rhs>
+struct generic_product_impl<LinearOperator, Rhs, SparseShape, DenseShape, GemvProduct>
+    : generic_product_impl_base<LinearOperator, Rhs,
+                                generic_product_impl<LinearOperator, Rhs>> {
+  typedef typename Product<LinearOperator, Rhs>::Scalar Scalar;
+
+  template <typename Dest>
+  static void scaleAndAddTo(Dest& dst, const LinearOperator& lhs, const Rhs& rhs,
+                            const Scalar& alpha) {
+    Eigen::VectorXd y;
+    lhs.Apply(rhs, y);
+    dst += alpha * y;
+  }
+};
+}  // namespace internal
+}  // namespace Eigen
+
+// Jacobi (diagonal) preconditioner for Eigen's iterative solvers using the diagonal of the matrix
+// type, i.e. it also works for LinearOperator
+class JacobiPreconditioner {
+ public:
+  JacobiPreconditioner() = default;
+
+  template <typename MatrixType>
+  explicit JacobiPreconditioner(const MatrixType& A) {
+    compute(A);
+  }
+
+  template <typename MatrixType>
+  JacobiPreconditioner& analyzePattern(const MatrixType& /*A*/) {
+    return *this;
+  }
+
+  template <typename MatrixType>
+  JacobiPreconditioner& factorize(const MatrixType& A) {
+    inv_diagonal_ = A.diagonal();
+    for (Eigen::Index i = 0; i < inv_diagonal_.size(); i++) {
+      inv_diagonal_(i) = inv_diagonal_(i) != 0 ? 1.0 / inv_diagonal_(i) : 1.0;
+    }
+    return *this;
+  }
+
+  template <typename MatrixType>
+  JacobiPreconditioner& compute(const MatrixType& A) {
+    return factorize(A);
+  }
+
+  template <typename Rhs>
+  Eigen::VectorXd solve(const Rhs& b) const {
+    return inv_diagonal_.cwiseProduct(b);
+  }
+
+  Eigen::ComputationInfo info() { return Eigen::Success; }
+
+ private:
+  Eigen::VectorXd inv_diagonal_{};
+};
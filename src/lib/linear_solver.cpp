@@ -0,0 +1,241 @@
+#include "linear_solver.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "memory_usage.hpp"
+#include "parallel.hpp"
+
+// Relative residual reduction of each inner solve of "mixed_cg", i.e. well above the precision of
+// float
+const float MIXED_CG_INNER_TOLERANCE{1e-4f};
+const int MIXED_CG_MAX_OUTER_ITERATIONS{50};
+
+SolverType SolverTypeFromString(const std::string& solver_type) {
+  if (solver_type == "bicgstab") return SolverType::kBiCGSTAB;
+  if (solver_type == "ldlt") return SolverType::kLDLT;
+  if (solver_type == "cg") return SolverType::kCG;
+  if (solver_type == "mf_cg") return SolverType::kMatrixFreeCG;
+  if (solver_type == "mg_cg") return SolverType::kMultigridCG;
+  if (solver_type == "schwarz") return SolverType::kSchwarz;
+  if (solver_type == "mixed_cg") return SolverType::kMixedCG;
+  if (solver_type == "cholmod") {
+#ifdef NRICP_WITH_CHOLMOD
+    return SolverType::kCholmod;
+#else
+    throw std::runtime_error("Solver \"cholmod\" is not available as CHOLMOD was not found!");
+#endif
+  }
+  throw std::runtime_error("Solver \"" + solver_type + "\" is not available!");
+}
+
+LinearSolver::LinearSolver(const SolverType& solver_type) : solver_type_{solver_type} {}
+
+bool LinearSolver::Compute(const Eigen::SparseMatrix<double>& N, const uint64_t& pattern_version) {
+  if (IsMatrixFree()) {
+    throw std::logic_error("Matrix-free solver requires a linear operator!");
+  }
+  N_ = &N;
+  uses_linear_operator_ = false;
+  if (IsDirect() && (!pattern_is_analyzed_ || pattern_version != analyzed_pattern_version_)) {
+    if (solver_type_ == SolverType::kLDLT) {
+      ldlt_.analyzePattern(N);
+    }
+#ifdef NRICP_WITH_CHOLMOD
+    if (solver_type_ == SolverType::kCholmod) {
+      cholmod_.analyzePattern(N);
+    }
+#endif
+    pattern_is_analyzed_ = true;
+    analyzed_pattern_version_ = pattern_version;
+  }
+
+  switch (solver_type_) {
+    case SolverType::kBiCGSTAB:
+      bicgstab_.compute(N);
+      return bicgstab_.info() == Eigen::Success;
+    case SolverType::kLDLT:
+      ldlt_.factorize(N);
+      return ldlt_.info() == Eigen::Success;
+    case SolverType::kCholmod:
+#ifdef NRICP_WITH_CHOLMOD
+      cholmod_.factorize(N);
+      return cholmod_.info() == Eigen::Success;
+#else
+      return false;
+#endif
+    case SolverType::kCG:
+      cg_.compute(N);
+      return cg_.info() == Eigen::Success;
+    case SolverType::kMatrixFreeCG:
+      break;
+    case SolverType::kMultigridCG:
+      mg_cg_.compute(N);
+      return mg_cg_.info() == Eigen::Success;
+    case SolverType::kSchwarz:
+      schwarz_.compute(N);
+      return schwarz_.info() == Eigen::Success;
+    case SolverType::kMixedCG:
+      if (N_float_.nonZeros() != N.nonZeros() || N_float_.rows() != N.rows() ||
+          pattern_version != N_float_pattern_version_ || !N.isCompressed()) {
+        N_float_ = N.cast<float>();
+        N_float_.makeCompressed();
+        N_float_pattern_version_ = pattern_version;
+      } else {
+        // Same pattern, i.e. only the values are converted
+        const double* values{N.valuePtr()};
+        float* values_float{N_float_.valuePtr()};
+        ParallelFor(0, N.nonZeros(),
+                    [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+                      for (int64_t k = first; k < last; k++) {
+                        values_float[k] = static_cast<float>(values[k]);
+                      }
+                    });
+      }
+      mixed_cg_.compute(N_float_);
+      return mixed_cg_.info() == Eigen::Success;
+  }
+  return false;
+}
+
+bool LinearSolver::Compute(const LinearOperator& N) {
+  if (!AcceptsLinearOperator()) {
+    throw std::logic_error("Solver requires an assembled matrix!");
+  }
+  N_operator_ = N;
+  uses_linear_operator_ = true;
+  mf_cg_.compute(N_operator_);
+  return mf_cg_.info() == Eigen::Success;
+}
+
+bool LinearSolver::Solve(const Eigen::VectorXd& n, Eigen::VectorXd& x,
+                         const bool& x_is_initial_guess) {
+  outer_iterations_ = 0;
+  auto solve_iterative = [&](auto& solver) {
+    x = x_is_initial_guess ? Eigen::VectorXd{solver.solveWithGuess(n, x)}
+                           : Eigen::VectorXd{solver.solve(n)};
+    iterations_ = static_cast<int>(solver.iterations());
+    error_ = solver.error();
+    return solver.info() == Eigen::Success;
+  };
+  auto solve_direct = [&](auto& solver) {
+    x = solver.solve(n);
+    iterations_ = 0;
+    double n_norm{n.norm()};
+    error_ = n_norm > 0 ? (*N_ * x - n).norm() / n_norm : 0;
+    return solver.info() == Eigen::Success;
+  };
+
+  if (uses_linear_operator_) return solve_iterative(mf_cg_);
+  switch (solver_type_) {
+    case SolverType::kBiCGSTAB:
+      return solve_iterative(bicgstab_);
+    case SolverType::kLDLT:
+      return solve_direct(ldlt_);
+    case SolverType::kCholmod:
+#ifdef NRICP_WITH_CHOLMOD
+      return solve_direct(cholmod_);
+#else
+      return false;
+#endif
+    case SolverType::kCG:
+      return solve_iterative(cg_);
+    case SolverType::kMatrixFreeCG:
+      return solve_iterative(mf_cg_);
+    case SolverType::kMultigridCG:
+      return solve_iterative(mg_cg_);
+    case SolverType::kSchwarz:
+      return solve_iterative(schwarz_);
+    case SolverType::kMixedCG:
+      return SolveMixedPrecision(n, x, x_is_initial_guess);
+  }
+  return false;
+}
+
+void LinearSolver::SetTolerance(const double& tolerance) {
+  double tolerance_or_default{tolerance > 0 ? tolerance : Eigen::NumTraits<double>::epsilon()};
+  bicgstab_.setTolerance(tolerance_or_default);
+  cg_.setTolerance(tolerance_or_default);
+  mf_cg_.setTolerance(tolerance_or_default);
+  mg_cg_.setTolerance(tolerance_or_default);
+  schwarz_.setTolerance(tolerance_or_default);
+  tolerance_ = tolerance_or_default;
+}
+
+void LinearSolver::SetGridSize(const int& x_num_voxels, const int& y_num_voxels,
+                               const int& z_num_voxels) {
+  mg_cg_.preconditioner().SetGridSize(x_num_voxels, y_num_voxels, z_num_voxels);
+  schwarz_.preconditioner().SetGridSize(x_num_voxels, y_num_voxels, z_num_voxels);
+}
+
+void LinearSolver::SetSchwarzTiling(const int& tile_num_nodes, const int& overlap) {
+  schwarz_.preconditioner().SetTiling(tile_num_nodes, overlap);
+}
+
+bool LinearSolver::IsDirect() const {
+  return solver_type_ == SolverType::kLDLT || solver_type_ == SolverType::kCholmod;
+}
+
+bool LinearSolver::SolveMixedPrecision(const Eigen::VectorXd& n, Eigen::VectorXd& x,
+                                       const bool& x_is_initial_guess) {
+  if (!x_is_initial_guess) x = Eigen::VectorXd::Zero(n.size());
+  iterations_ = 0;
+  double n_norm{n.norm()};
+  if (n_norm == 0) {
+    x.setZero();
+    error_ = 0;
+    return true;
+  }
+  Eigen::VectorXd r{n - *N_ * x};
+  error_ = r.norm() / n_norm;
+  bool stagnated{false};
+  while (error_ > tolerance_ && outer_iterations_ < MIXED_CG_MAX_OUTER_ITERATIONS) {
+    // Solve N*dx = r in single precision to the tolerance which is still missing, but at most to
+    // the precision of float
+    mixed_cg_.setTolerance(std::max(MIXED_CG_INNER_TOLERANCE,
+                                    static_cast<float>(tolerance_ / error_)));
+    Eigen::VectorXf dx{mixed_cg_.solve(r.cast<float>())};
+    iterations_ += static_cast<int>(mixed_cg_.iterations());
+    outer_iterations_++;
+    // A breakdown in single precision, e.g. an overflow of float, fails the solve; a correction
+    // which merely missed the inner tolerance is still applied
+    if (mixed_cg_.info() == Eigen::NumericalIssue || !dx.allFinite()) return false;
+    x += dx.cast<double>();
+    r = n - *N_ * x;
+    double error_previous{error_};
+    error_ = r.norm() / n_norm;
+    if (error_ >= error_previous) {
+      stagnated = true;
+      break;
+    }
+  }
+  // With the default tolerance, i.e. machine precision, the stagnation of the residual in double
+  // precision is accepted as convergence
+  return error_ <= tolerance_ ||
+         (stagnated && tolerance_ == Eigen::NumTraits<double>::epsilon());
+}
+
+bool LinearSolver::IsMatrixFree() const { return solver_type_ == SolverType::kMatrixFreeCG; }
+
+bool LinearSolver::AcceptsLinearOperator() const {
+  return solver_type_ == SolverType::kMatrixFreeCG || solver_type_ == SolverType::kCG;
+}
+
+const int& LinearSolver::iterations() const { return iterations_; }
+const int& LinearSolver::outer_iterations() const { return outer_iterations_; }
+const double& LinearSolver::error() const { return error_; }
+
+size_t LinearSolver::memory() const {
+  switch (solver_type_) {
+    case SolverType::kLDLT:
+      return MemoryUsage(ldlt_);
+    case SolverType::kMultigridCG:
+      return mg_cg_.preconditioner().memory();
+    case SolverType::kSchwarz:
+      return schwarz_.preconditioner().memory();
+    case SolverType::kMixedCG:
+      return MemoryUsage(N_float_);
+    default:
+      return 0;
+  }
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <Eigen/IterativeLinearSolvers>
+#include <Eigen/SparseCholesky>
+#include <cstdint>
+#include <string>
+
+#ifdef NRICP_WITH_CHOLMOD
+#include <Eigen/CholmodSupport>
+#endif
+
+#include "linear_operator.hpp"
+#include "multigrid_preconditioner.hpp"
+#include "schwarz_preconditioner.hpp"
+
+enum class SolverType {
+  kBiCGSTAB,
+  // Sparse LDLT decomposition with AMD ordering
+  kLDLT,
+  // Supernodal sparse Cholesky decomposition of CHOLMOD, only available if compiled with
+  // NRICP_WITH_CHOLMOD
+  kCholmod,
+  // Conjugate gradient with diagonal preconditioner
+  kCG,
+  // Conjugate gradient with diagonal preconditioner on a LinearOperator, i.e. without assembled
+  // matrix
+  kMatrixFreeCG,
+  // Conjugate gradient with geometric multigrid preconditioner, see MultigridPreconditioner
+  kMultigridCG,
+  // BiCGSTAB with restricted additive Schwarz preconditioner, i.e. the local systems of
+  // overlapping tiles of the grids are solved in parallel, see SchwarzPreconditioner
+  kSchwarz,
+  // Conjugate gradient with diagonal preconditioner in single precision on a copy of N, wrapped
+  // in iterative refinement of the solution with the residual computed in double precision
+  kMixedCG
+};
+
+// Parses "bicgstab", "ldlt", "cholmod", "cg", "mf_cg", "mg_cg", "schwarz" or "mixed_cg"; throws if
+// the solver is not available
+SolverType SolverTypeFromString(const std::string& solver_type);
+
+// Solver for the symmetric positive definite normal equations N*x = n
+class LinearSolver {
+ public:
+  LinearSolver(const SolverType& solver_type = SolverType::kBiCGSTAB);
+
+  // pattern_version identifies the sparsity pattern of N. The ordering and symbolic analysis of
+  // the direct solvers are only recomputed if it differs from the one of the previous call, i.e.
+  // only the numeric factorization is computed for each N.
+  // N is referenced until the next call of Compute, i.e. it must not be changed before Solve
+  bool Compute(const Eigen::SparseMatrix<double>& N, const uint64_t& pattern_version);
+  // Version of Compute for the matrix-free solvers. The solver "cg" also accepts a linear
+  // operator, e.g. for N in block format.
+  bool Compute(const LinearOperator& N);
+  // If x_is_initial_guess is true, the iterative solvers start from the passed x instead of zero
+  bool Solve(const Eigen::VectorXd& n, Eigen::VectorXd& x, const bool& x_is_initial_guess = false);
+  // Relative residual norm |N*x-n|/|n| at which the iterative solvers stop; 0 selects the default
+  // of Eigen, i.e. machine precision
+  void SetTolerance(const double& tolerance);
+
+  // Number of voxels of the translation grids, required by the multigrid and Schwarz solvers
+  void SetGridSize(const int& x_num_voxels, const int& y_num_voxels, const int& z_num_voxels);
+  // Number of nodes per axis of the tiles of the Schwarz solver and their overlap in nodes
+  void SetSchwarzTiling(const int& tile_num_nodes, const int& overlap);
+
+  bool IsMatrixFree() const;
+  // True if Compute accepts a linear operator
+  bool AcceptsLinearOperator() const;
+
+  // Getters for the last solve; iterations is 0 for the direct solvers and the total number of
+  // inner iterations for "mixed_cg"
+  const int& iterations() const;
+  // Number of refinement steps of "mixed_cg", 0 for all other solvers
+  const int& outer_iterations() const;
+  // Relative residual norm |N*x-n|/|n|
+  const double& error() const;
+  // Memory of the decomposition, the preconditioner or the copy of N of the solver in bytes; 0 for
+  // the solvers with diagonal preconditioner and for "cholmod", whose factor is not accessible
+  size_t memory() const;
+
+ private:
+  bool IsDirect() const;
+  bool SolveMixedPrecision(const Eigen::VectorXd& n, Eigen::VectorXd& x,
+                           const bool& x_is_initial_guess);
+
+  SolverType solver_type_;
+  const Eigen::SparseMatrix<double>* N_{nullptr};
+  // True if the last call of Compute passed a linear operator
+  bool uses_linear_operator_{false};
+  bool pattern_is_analyzed_{false};
+  uint64_t analyzed_pattern_version_{0};
+  int iterations_{0};
+  int outer_iterations_{0};
+  double error_{0};
+  double tolerance_{Eigen::NumTraits<double>::epsilon()};
+
+  Eigen::BiCGSTAB<Eigen::SparseMatrix<double>> bicgstab_{};
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt_{};
+  Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper> cg_{};
+#ifdef NRICP_WITH_CHOLMOD
+  Eigen::CholmodSupernodalLLT<Eigen::SparseMatrix<double>> cholmod_{};
+#endif
+  LinearOperator N_operator_{};
+  Eigen::ConjugateGradient<LinearOperator, Eigen::Lower | Eigen::Upper, JacobiPreconditioner>
+      mf_cg_{};
+  Eigen::ConjugateGradient<Eigen::SparseMatrix<double>, Eigen::Lower | Eigen::Upper,
+                           MultigridPreconditioner>
+      mg_cg_{};
+  Eigen::BiCGSTAB<Eigen::SparseMatrix<double>, SchwarzPreconditioner> schwarz_{};
+  // Single precision copy of N and its pattern version
+  Eigen::SparseMatrix<float> N_float_{};
+  uint64_t N_float_pattern_version_{0};
+  Eigen::ConjugateGradient<Eigen::SparseMatrix<float>, Eigen::Lower | Eigen::Upper> mixed_cg_{};
+};
@@ -0,0 +1,79 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filepath) {
+  file_handle_ = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file_handle_ == INVALID_HANDLE_VALUE) {
+    file_handle_ = nullptr;
+    throw std::runtime_error("Cannot open file \"" + filepath + "\"!");
+  }
+  LARGE_INTEGER file_size{};
+  if (!GetFileSizeEx(file_handle_, &file_size)) {
+    CloseHandle(file_handle_);
+    throw std::runtime_error("Cannot determine size of file \"" + filepath + "\"!");
+  }
+  size_ = static_cast<size_t>(file_size.QuadPart);
+  if (size_ == 0) return;
+  mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping_handle_ != nullptr) {
+    data_ = static_cast<const char*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  }
+  if (data_ == nullptr) {
+    if (mapping_handle_ != nullptr) CloseHandle(mapping_handle_);
+    CloseHandle(file_handle_);
+    throw std::runtime_error("Cannot map file \"" + filepath + "\"!");
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) UnmapViewOfFile(data_);
+  if (mapping_handle_ != nullptr) CloseHandle(mapping_handle_);
+  if (file_handle_ != nullptr) CloseHandle(file_handle_);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filepath) {
+  int fd{open(filepath.c_str(), O_RDONLY)};
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open file \"" + filepath + "\"!");
+  }
+  struct stat file_stat {};
+  if (fstat(fd, &file_stat) != 0) {
+    close(fd);
+    throw std::runtime_error("Cannot determine size of file \"" + filepath + "\"!");
+  }
+  size_ = static_cast<size_t>(file_stat.st_size);
+  if (size_ > 0) {
+    void* data{mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0)};
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("Cannot map file \"" + filepath + "\"!");
+    }
+    data_ = static_cast<const char*>(data);
+  }
+  // The mapping stays valid after closing the file descriptor
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (data_ != nullptr) munmap(const_cast<char*>(data_), size_);
+}
+
+#endif
+
+const char* MappedFile::data() const { return data_; }
+const size_t& MappedFile::size() const { return size_; }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file. The mapped pages are backed by the page cache, i.e. all
+// processes which map the same file share one copy of it in memory.
+class MappedFile {
+ public:
+  // Throws if the file cannot be opened or mapped
+  explicit MappedFile(const std::string& filepath);
+  ~MappedFile();
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Getters
+  const char* data() const;
+  const size_t& size() const;
+
+ private:
+  const char* data_{nullptr};
+  size_t size_{0};
+#ifdef _WIN32
+  void* file_handle_{nullptr};
+  void* mapping_handle_{nullptr};
+#endif
+};
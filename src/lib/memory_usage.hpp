@@ -0,0 +1,34 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <vector>
+
+// Allocated memory of the storage of dense and sparse Eigen objects and of vectors in bytes
+
+template <typename Derived>
+size_t MemoryUsage(const Eigen::PlainObjectBase<Derived>& A) {
+  return A.size() * sizeof(typename Derived::Scalar);
+}
+
+template <typename Scalar, int Options, typename StorageIndex>
+size_t MemoryUsage(const Eigen::SparseMatrix<Scalar, Options, StorageIndex>& A) {
+  size_t num_outer_indices{static_cast<size_t>(A.outerSize()) + 1};
+  if (!A.isCompressed()) num_outer_indices += A.outerSize();  // inner non zeros
+  return A.data().allocatedSize() * (sizeof(Scalar) + sizeof(StorageIndex)) +
+         num_outer_indices * sizeof(StorageIndex);
+}
+
+template <typename T>
+size_t MemoryUsage(const std::vector<T>& v) {
+  return v.capacity() * sizeof(T);
+}
+
+// Factor and diagonal of a sparse LDLT decomposition; 0 before the first decomposition
+template <typename MatrixType, int UpLo, typename Ordering>
+size_t MemoryUsage(const Eigen::SimplicialLDLT<MatrixType, UpLo, Ordering>& ldlt) {
+  if (ldlt.rows() == 0) return 0;
+  return MemoryUsage(ldlt.matrixL().nestedExpression()) + MemoryUsage(ldlt.vectorD()) +
+         2 * ldlt.rows() * sizeof(typename MatrixType::StorageIndex);  // permutations
+}
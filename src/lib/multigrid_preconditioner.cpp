@@ -0,0 +1,225 @@
+#include "multigrid_preconditioner.hpp"
+
+#include <stdexcept>
+
+#include "memory_usage.hpp"
+
+// Levels are added while the coarsest level has more unknowns than this
+const int MULTIGRID_MAX_COARSE_UNKNOWNS{5000};
+
+namespace {
+
+// Weights of the 1D cubic Hermite refinement: weight of the value (0) or derivative (1) of a coarse
+// node on the value or derivative of a fine node. Derivatives are with respect to the node spacing
+// of their own level, i.e. the derivatives of the coarse nodes are twice as long as fine ones.
+// clang-format off
+const double WEIGHTS_SAME_NODE[2][2]{{1.0, 0.0},
+                                     {0.0, 0.5}};
+const double WEIGHTS_LEFT_NODE[2][2]{{ 0.50,  0.125},
+                                     {-0.75, -0.125}};
+const double WEIGHTS_RIGHT_NODE[2][2]{{0.50, -0.125},
+                                      {0.75, -0.125}};
+// clang-format on
+
+// Derivative order along x, y and z of the 8 parameters f, fx, fy, fz, fxy, fxz, fyz, fxyz
+const int PARAM_DERIVATIVES[8][3]{{0, 0, 0}, {1, 0, 0}, {0, 1, 0}, {0, 0, 1},
+                                  {1, 1, 0}, {1, 0, 1}, {0, 1, 1}, {1, 1, 1}};
+
+// Coarse nodes contributing to fine node fine_node_idx along one axis and their weights
+int CoarseNodes1D(const int& fine_node_idx, int coarse_node_idx[2],
+                  const double (*weights[2])[2]) {
+  if (fine_node_idx % 2 == 0) {
+    coarse_node_idx[0] = fine_node_idx / 2;
+    weights[0] = WEIGHTS_SAME_NODE;
+    return 1;
+  }
+  coarse_node_idx[0] = (fine_node_idx - 1) / 2;
+  coarse_node_idx[1] = (fine_node_idx + 1) / 2;
+  weights[0] = WEIGHTS_LEFT_NODE;
+  weights[1] = WEIGHTS_RIGHT_NODE;
+  return 2;
+}
+
+int NumNodes(const int& x_num_voxels, const int& y_num_voxels, const int& z_num_voxels) {
+  return (x_num_voxels + 1) * (y_num_voxels + 1) * (z_num_voxels + 1);
+}
+
+}  // namespace
+
+void MultigridPreconditioner::SetGridSize(const int& x_num_voxels, const int& y_num_voxels,
+                                          const int& z_num_voxels) {
+  x_num_voxels_ = x_num_voxels;
+  y_num_voxels_ = y_num_voxels;
+  z_num_voxels_ = z_num_voxels;
+}
+
+int MultigridPreconditioner::num_levels() const { return static_cast<int>(levels_.size()); }
+
+void MultigridPreconditioner::Setup(const Eigen::Index& size, const Eigen::Index& nnz,
+                                    const int* outer, const int* inner, const double* values) {
+  if (size != 3 * 8 * NumNodes(x_num_voxels_, y_num_voxels_, z_num_voxels_)) {
+    throw std::runtime_error("Size of the normal equations does not match the grid size!");
+  }
+
+  // Hierarchy of the lattices; the prolongations are kept if the lattices did not change
+  std::vector<Level> levels(1);
+  levels[0].x_num_voxels = x_num_voxels_;
+  levels[0].y_num_voxels = y_num_voxels_;
+  levels[0].z_num_voxels = z_num_voxels_;
+  levels[0].size = static_cast<int>(size);
+  while (levels.back().size > MULTIGRID_MAX_COARSE_UNKNOWNS &&
+         (levels.back().x_num_voxels > 1 || levels.back().y_num_voxels > 1 ||
+          levels.back().z_num_voxels > 1)) {
+    Level coarse_level{};
+    coarse_level.x_num_voxels = (levels.back().x_num_voxels + 1) / 2;
+    coarse_level.y_num_voxels = (levels.back().y_num_voxels + 1) / 2;
+    coarse_level.z_num_voxels = (levels.back().z_num_voxels + 1) / 2;
+    coarse_level.size = 3 * 8 *
+                        NumNodes(coarse_level.x_num_voxels, coarse_level.y_num_voxels,
+                                 coarse_level.z_num_voxels);
+    levels.push_back(std::move(coarse_level));
+  }
+  for (size_t l = 0; l + 1 < levels.size(); l++) {
+    if (l + 1 < levels_.size() && levels_[l].x_num_voxels == levels[l].x_num_voxels &&
+        levels_[l].y_num_voxels == levels[l].y_num_voxels &&
+        levels_[l].z_num_voxels == levels[l].z_num_voxels) {
+      levels[l].P = std::move(levels_[l].P);
+    } else {
+      levels[l].P = Prolongation(levels[l].x_num_voxels, levels[l].y_num_voxels,
+                                 levels[l].z_num_voxels);
+    }
+  }
+  levels_ = std::move(levels);
+
+  // Matrices of the levels
+  levels_[0].nnz = nnz;
+  levels_[0].outer = outer;
+  levels_[0].inner = inner;
+  levels_[0].values = values;
+  for (size_t l = 1; l < levels_.size(); l++) {
+    Eigen::SparseMatrix<double> AP{Matrix(levels_[l - 1]) * levels_[l - 1].P};
+    levels_[l].A_coarse = levels_[l - 1].P.transpose() * AP;
+    levels_[l].A_coarse.makeCompressed();
+    levels_[l].nnz = levels_[l].A_coarse.nonZeros();
+    levels_[l].outer = levels_[l].A_coarse.outerIndexPtr();
+    levels_[l].inner = levels_[l].A_coarse.innerIndexPtr();
+    levels_[l].values = levels_[l].A_coarse.valuePtr();
+  }
+
+  for (auto& level : levels_) {
+    level.inv_diagonal.setZero(level.size);
+    for (int i = 0; i < level.size; i++) {
+      for (int k = level.outer[i]; k < level.outer[i + 1]; k++) {
+        if (level.inner[k] == i && level.values[k] != 0) {
+          level.inv_diagonal(i) = 1.0 / level.values[k];
+        }
+      }
+    }
+  }
+
+  coarse_solver_.compute(Matrix(levels_.back()));
+  info_ = coarse_solver_.info();
+}
+
+void MultigridPreconditioner::VCycle(const int& level_idx, const Eigen::VectorXd& b,
+                                     Eigen::VectorXd& x) const {
+  const Level& level{levels_[level_idx]};
+  if (level_idx + 1 == num_levels()) {
+    x = coarse_solver_.solve(b);
+    return;
+  }
+
+  SmoothGaussSeidel(level, b, x, true);
+
+  Eigen::VectorXd b_coarse{level.P.transpose() * Residual(level, b, x)};
+  Eigen::VectorXd x_coarse{Eigen::VectorXd::Zero(b_coarse.size())};
+  VCycle(level_idx + 1, b_coarse, x_coarse);
+  x += level.P * x_coarse;
+
+  SmoothGaussSeidel(level, b, x, false);
+}
+
+void MultigridPreconditioner::SmoothGaussSeidel(const Level& level, const Eigen::VectorXd& b,
+                                                Eigen::VectorXd& x, const bool& forward) {
+  // Column i of the symmetric matrix equals row i; the sum includes the diagonal entry, i.e. it is
+  // the residual of unknown i
+  for (int n = 0; n < level.size; n++) {
+    int i{forward ? n : level.size - 1 - n};
+    double sum{0};
+    for (int k = level.outer[i]; k < level.outer[i + 1]; k++) {
+      sum += level.values[k] * x(level.inner[k]);
+    }
+    x(i) += (b(i) - sum) * level.inv_diagonal(i);
+  }
+}
+
+Eigen::VectorXd MultigridPreconditioner::Residual(const Level& level, const Eigen::VectorXd& b,
+                                                  const Eigen::VectorXd& x) {
+  return b - Matrix(level) * x;
+}
+
+Eigen::SparseMatrix<double> MultigridPreconditioner::Prolongation(const int& x_num_voxels,
+                                                                  const int& y_num_voxels,
+                                                                  const int& z_num_voxels) {
+  int x_num_voxels_coarse{(x_num_voxels + 1) / 2};
+  int y_num_voxels_coarse{(y_num_voxels + 1) / 2};
+  int z_num_voxels_coarse{(z_num_voxels + 1) / 2};
+  int num_nodes{NumNodes(x_num_voxels, y_num_voxels, z_num_voxels)};
+  int num_nodes_coarse{NumNodes(x_num_voxels_coarse, y_num_voxels_coarse, z_num_voxels_coarse)};
+
+  // Up to 8 coarse nodes with up to 8 parameters each for each of the 8 parameters of a fine node
+  std::vector<Eigen::Triplet<double>> triplets;
+  triplets.reserve(static_cast<size_t>(3) * num_nodes * 8 * 27);
+
+  int x_coarse[2], y_coarse[2], z_coarse[2];
+  const double(*x_weights[2])[2];
+  const double(*y_weights[2])[2];
+  const double(*z_weights[2])[2];
+  for (int x = 0; x <= x_num_voxels; x++) {
+    int x_num_coarse{CoarseNodes1D(x, x_coarse, x_weights)};
+    for (int y = 0; y <= y_num_voxels; y++) {
+      int y_num_coarse{CoarseNodes1D(y, y_coarse, y_weights)};
+      for (int z = 0; z <= z_num_voxels; z++) {
+        int z_num_coarse{CoarseNodes1D(z, z_coarse, z_weights)};
+        int node{(x * (y_num_voxels + 1) + y) * (z_num_voxels + 1) + z};
+        for (int i = 0; i < x_num_coarse; i++)
+          for (int j = 0; j < y_num_coarse; j++)
+            for (int k = 0; k < z_num_coarse; k++) {
+              int node_coarse{(x_coarse[i] * (y_num_voxels_coarse + 1) + y_coarse[j]) *
+                                  (z_num_voxels_coarse + 1) +
+                              z_coarse[k]};
+              for (int p = 0; p < 8; p++)
+                for (int q = 0; q < 8; q++) {
+                  const int* dp{PARAM_DERIVATIVES[p]};
+                  const int* dq{PARAM_DERIVATIVES[q]};
+                  double weight{x_weights[i][dp[0]][dq[0]] * y_weights[j][dp[1]][dq[1]] *
+                                z_weights[k][dp[2]][dq[2]]};
+                  if (weight == 0) continue;
+                  for (int g = 0; g < 3; g++) {
+                    triplets.emplace_back(8 * (g * num_nodes + node) + p,
+                                          8 * (g * num_nodes_coarse + node_coarse) + q, weight);
+                  }
+                }
+            }
+      }
+    }
+  }
+
+  Eigen::SparseMatrix<double> P(3 * 8 * num_nodes, 3 * 8 * num_nodes_coarse);
+  P.setFromTriplets(triplets.begin(), triplets.end());
+  return P;
+}
+
+Eigen::Map<const Eigen::SparseMatrix<double>> MultigridPreconditioner::Matrix(const Level& level) {
+  return Eigen::Map<const Eigen::SparseMatrix<double>>(level.size, level.size, level.nnz,
+                                                       level.outer, level.inner, level.values);
+}
+
+size_t MultigridPreconditioner::memory() const {
+  size_t memory{MemoryUsage(coarse_solver_)};  // returned
+  for (const auto& level : levels_) {
+    memory += MemoryUsage(level.A_coarse) + MemoryUsage(level.inv_diagonal) +
+              MemoryUsage(level.P);
+  }
+  return memory;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <vector>
+
+// Geometric multigrid preconditioner for the normal equations of the x, y and z translation grids.
+// The node lattice is coarsened by 2 per level. The 8 Hermite parameters of the coarse nodes are
+// prolongated to the fine nodes by exact refinement of the tricubic interpolation, i.e. each
+// coarse grid spans a subspace of the finer grid. The coarse matrices are the Galerkin products
+// P'*A*P. One application of the preconditioner is one symmetric V-cycle with symmetric
+// Gauss-Seidel smoothing and a sparse LDLT decomposition on the coarsest level, i.e. it can be
+// used with the conjugate gradient method.
+class MultigridPreconditioner {
+ public:
+  MultigridPreconditioner() = default;
+
+  // Number of voxels of the translation grids, must be set before compute
+  void SetGridSize(const int& x_num_voxels, const int& y_num_voxels, const int& z_num_voxels);
+
+  template <typename MatrixType>
+  MultigridPreconditioner& analyzePattern(const MatrixType& /*A*/) {
+    return *this;
+  }
+
+  // A is referenced as finest level, i.e. it must not be changed before solve
+  template <typename MatrixType>
+  MultigridPreconditioner& factorize(const MatrixType& A) {
+    Setup(A.rows(), A.nonZeros(), A.outerIndexPtr(), A.innerIndexPtr(), A.valuePtr());
+    return *this;
+  }
+
+  template <typename MatrixType>
+  MultigridPreconditioner& compute(const MatrixType& A) {
+    return factorize(A);
+  }
+
+  template <typename Rhs>
+  Eigen::VectorXd solve(const Rhs& b) const {
+    Eigen::VectorXd x{Eigen::VectorXd::Zero(b.size())};
+    VCycle(0, b, x);
+    return x;
+  }
+
+  Eigen::ComputationInfo info() { return info_; }
+
+  // Memory of the coarse levels, the prolongations and the decomposition of the coarsest level in
+  // bytes
+  size_t memory() const;
+
+  // Number of levels including the finest one
+  int num_levels() const;
+
+ private:
+  struct Level {
+    int x_num_voxels{0};
+    int y_num_voxels{0};
+    int z_num_voxels{0};
+    // Compressed, symmetric matrix of the level with full storage. Only the coarse levels own
+    // their matrix in A_coarse; the finest level references the matrix passed to compute.
+    Eigen::SparseMatrix<double> A_coarse{};
+    int size{0};
+    int64_t nnz{0};
+    const int* outer{nullptr};
+    const int* inner{nullptr};
+    const double* values{nullptr};
+    Eigen::VectorXd inv_diagonal{};
+    // Prolongation from the next coarser level to this level
+    Eigen::SparseMatrix<double> P{};
+  };
+
+  void Setup(const Eigen::Index& size, const Eigen::Index& nnz, const int* outer,
+             const int* inner, const double* values);
+  void VCycle(const int& level_idx, const Eigen::VectorXd& b, Eigen::VectorXd& x) const;
+  // Gauss-Seidel sweep over the unknowns in ascending (forward) or descending order
+  static void SmoothGaussSeidel(const Level& level, const Eigen::VectorXd& b, Eigen::VectorXd& x,
+                                const bool& forward);
+  static Eigen::VectorXd Residual(const Level& level, const Eigen::VectorXd& b,
+                                  const Eigen::VectorXd& x);
+  // Prolongation of the unknowns of the x, y and z grids with the coarse numbers of voxels
+  // (ceil(n/2)) to the grids with the fine numbers of voxels n
+  static Eigen::SparseMatrix<double> Prolongation(const int& x_num_voxels, const int& y_num_voxels,
+                                                  const int& z_num_voxels);
+  static Eigen::Map<const Eigen::SparseMatrix<double>> Matrix(const Level& level);
+
+  int x_num_voxels_{0};
+  int y_num_voxels_{0};
+  int z_num_voxels_{0};
+  std::vector<Level> levels_{};
+  Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> coarse_solver_{};
+  Eigen::ComputationInfo info_{Eigen::Success};
+};
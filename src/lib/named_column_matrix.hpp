@@ -3,6 +3,7 @@
 #include <Eigen/Dense>
 #include <map>
 #include <stdexcept>
+#include <utility>
 
 template <typename T>
 class NamedColumnMatrix : public T {
@@ -16,6 +17,13 @@ class NamedColumnMatrix : public T {
     CheckNamedColsSize(col_names);
     AddColNames(col_names);
   }
+  // Move constructors, i.e. without copying the matrix
+  NamedColumnMatrix(NamedColumnMatrix&& other) noexcept
+      : T(std::move(other)), col_names_(std::move(other.col_names_)) {}
+  NamedColumnMatrix(T&& matrix, const std::vector<std::string>& col_names) : T(std::move(matrix)) {
+    CheckNamedColsSize(col_names);
+    AddColNames(col_names);
+  }
 
   // Overload = operator
   NamedColumnMatrix<T>& operator=(const NamedColumnMatrix<T>& other) {
@@ -25,6 +33,13 @@ class NamedColumnMatrix : public T {
     }
     return *this;
   }
+  NamedColumnMatrix<T>& operator=(NamedColumnMatrix<T>&& other) noexcept {
+    if (this != &other) {
+      this->T::operator=(std::move(other));
+      col_names_ = std::move(other.col_names_);
+    }
+    return *this;
+  }
 
   // Get column by name
   inline typename T::ColXpr namedCol(const std::string& col_name) {
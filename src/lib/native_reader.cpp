@@ -0,0 +1,392 @@
+#include "native_reader.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <optional>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Text files are parsed in blocks of about this size, each of which starts at the beginning of a
+// line
+const int64_t TEXT_BLOCK_SIZE{1 << 20};  // bytes
+
+using ConsumeBatch = std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>;
+
+// Names of the requested dimensions and of the corresponding matrix columns, see ExtractMatrix
+struct RequestedColumns {
+  std::vector<std::string> dim_names{};
+  std::vector<std::string> col_names{};
+};
+
+RequestedColumns GetRequestedColumns(const bool& with_normals, const bool& with_correspondence_id) {
+  RequestedColumns requested{{"X", "Y", "Z"}, {"x", "y", "z"}};
+  if (with_normals) {
+    requested.dim_names.insert(requested.dim_names.end(), {"NormalX", "NormalY", "NormalZ"});
+    requested.col_names.insert(requested.col_names.end(), {"nx", "ny", "nz"});
+  }
+  if (with_correspondence_id) {
+    requested.dim_names.emplace_back("CorrespondenceID");
+    requested.col_names.emplace_back("correspondence_id");
+  }
+  return requested;
+}
+
+bool EqualsIgnoreCase(const std::string& a, const std::string& b) {
+  return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char c, char d) {
+           return std::tolower(static_cast<unsigned char>(c)) ==
+                  std::tolower(static_cast<unsigned char>(d));
+         });
+}
+
+// Matrix column of each dimension of the file (-1 if not requested); empty if a requested dimension
+// is missing
+std::vector<int> GetColOfDims(const std::vector<std::string>& file_dim_names,
+                              const RequestedColumns& requested) {
+  std::vector<int> col_of_dim(file_dim_names.size(), -1);
+  for (size_t col = 0; col < requested.dim_names.size(); col++) {
+    auto it{std::find_if(file_dim_names.begin(), file_dim_names.end(),
+                         [&](const std::string& name) {
+                           return EqualsIgnoreCase(name, requested.dim_names[col]);
+                         })};
+    if (it == file_dim_names.end()) return {};
+    col_of_dim[it - file_dim_names.begin()] = static_cast<int>(col);
+  }
+  return col_of_dim;
+}
+
+// Rounded as by ExtractMatrix
+void RoundCorrespondenceIds(const RequestedColumns& requested,
+                            NamedColumnMatrix<Eigen::MatrixXd>& X) {
+  if (requested.col_names.back() == "correspondence_id") {
+    auto col{X.namedColIndex("correspondence_id")};
+    X.col(col) = X.col(col).array().round();
+  }
+}
+
+bool IsBlank(const char& c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+// Calls f(line_first, line_last) for each non-blank line of [first, last) until f returns false
+template <typename F>
+void ForEachLine(const char* first, const char* last, F&& f) {
+  while (first < last) {
+    const char* line_last{static_cast<const char*>(std::memchr(first, '\n', last - first))};
+    if (line_last == nullptr) line_last = last;
+    if (!std::all_of(first, line_last, IsBlank) && !f(first, line_last)) return;
+    first = line_last + 1;
+  }
+}
+
+// Splits a line into its fields; fields are separated by separator or, if it is ' ', by blanks
+template <typename F>
+int ForEachField(const char* first, const char* last, const char& separator, F&& f) {
+  int num_fields{0};
+  if (separator == ' ') {
+    while (true) {
+      while (first < last && IsBlank(*first)) first++;
+      if (first == last) return num_fields;
+      const char* field_last{std::find_if(first, last, IsBlank)};
+      if (!f(num_fields++, first, field_last)) return -1;
+      first = field_last;
+    }
+  }
+  while (true) {
+    const char* field_last{std::find(first, last, separator)};
+    const char* value_first{first};
+    const char* value_last{field_last};
+    while (value_first < value_last && IsBlank(*value_first)) value_first++;
+    while (value_last > value_first && IsBlank(*(value_last - 1))) value_last--;
+    if (!f(num_fields++, value_first, value_last)) return -1;
+    if (field_last == last) return num_fields;
+    first = field_last + 1;
+  }
+}
+
+bool ParseDouble(const char* first, const char* last, double& value) {
+  if (first < last && *first == '+') first++;
+  auto [ptr, ec] = std::from_chars(first, last, value);
+  return ec == std::errc() && ptr == last && first < last;
+}
+
+bool ReadText(const MappedFile& file, const RequestedColumns& requested,
+              const Eigen::Index& batch_num_pts, const ConsumeBatch& consume_batch) {
+  if (file.size() == 0) return false;
+  const char* first{file.data()};
+  const char* last{first + file.size()};
+
+  // Header with the dimension names
+  const char* header_last{static_cast<const char*>(std::memchr(first, '\n', file.size()))};
+  if (header_last == nullptr) return false;
+  char separator{std::find(first, header_last, ',') != header_last ? ',' : ' '};
+  std::vector<std::string> dim_names{};
+  ForEachField(first, header_last, separator, [&](const int&, const char* name_first,
+                                                  const char* name_last) {
+    dim_names.emplace_back(name_first, name_last);
+    return true;
+  });
+  for (const auto& name : dim_names) {
+    if (name.empty() || !std::all_of(name.begin(), name.end(), [](char c) {
+          return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+        })) {
+      return false;
+    }
+  }
+  std::vector<int> col_of_dim{GetColOfDims(dim_names, requested)};
+  if (col_of_dim.empty()) return false;
+  int num_dims{static_cast<int>(dim_names.size())};
+
+  // Split the points into blocks of lines
+  const char* body{header_last + 1};
+  int64_t num_blocks{std::max<int64_t>((last - body + TEXT_BLOCK_SIZE - 1) / TEXT_BLOCK_SIZE, 1)};
+  std::vector<const char*> block_first(num_blocks + 1, last);
+  block_first[0] = body;
+  for (int64_t b = 1; b < num_blocks; b++) {
+    const char* p{body + b * TEXT_BLOCK_SIZE - 1};
+    const char* line_last{static_cast<const char*>(std::memchr(p, '\n', last - p))};
+    block_first[b] = std::max(line_last != nullptr ? line_last + 1 : last, block_first[b - 1]);
+  }
+
+  // Count the points of each block to get the first row of each block
+  std::vector<Eigen::Index> block_first_row(num_blocks + 1, 0);
+  ParallelFor(
+      0, num_blocks,
+      [&](const int64_t& first_block, const int64_t& last_block, const int& /*chunk*/) {
+        for (int64_t b = first_block; b < last_block; b++) {
+          ForEachLine(block_first[b], block_first[b + 1], [&](const char*, const char*) {
+            block_first_row[b + 1]++;
+            return true;
+          });
+        }
+      },
+      1);
+  for (int64_t b = 0; b < num_blocks; b++) block_first_row[b + 1] += block_first_row[b];
+  Eigen::Index num_pts{block_first_row[num_blocks]};
+  if (num_pts == 0) return false;
+
+  // Parse the points in batches of consecutive blocks
+  for (int64_t batch_first_block = 0; batch_first_block < num_blocks;) {
+    int64_t batch_last_block{batch_first_block + 1};
+    while (batch_last_block < num_blocks &&
+           block_first_row[batch_last_block + 1] - block_first_row[batch_first_block] <=
+               batch_num_pts) {
+      batch_last_block++;
+    }
+    Eigen::Index batch_first_row{block_first_row[batch_first_block]};
+    NamedColumnMatrix<Eigen::MatrixXd> X(
+        Eigen::MatrixXd(block_first_row[batch_last_block] - batch_first_row,
+                        static_cast<Eigen::Index>(requested.col_names.size())),
+        requested.col_names);
+    std::vector<char> block_is_valid(num_blocks, 1);
+    ParallelFor(
+        batch_first_block, batch_last_block,
+        [&](const int64_t& first_block, const int64_t& last_block, const int& /*chunk*/) {
+          for (int64_t b = first_block; b < last_block; b++) {
+            Eigen::Index row{block_first_row[b] - batch_first_row};
+            ForEachLine(block_first[b], block_first[b + 1], [&](const char* line_first,
+                                                                const char* line_last) {
+              int num_fields{ForEachField(
+                  line_first, line_last, separator,
+                  [&](const int& dim, const char* value_first, const char* value_last) {
+                    if (dim >= num_dims) return false;
+                    if (col_of_dim[dim] < 0) return true;
+                    return ParseDouble(value_first, value_last, X(row, col_of_dim[dim]));
+                  })};
+              row++;
+              block_is_valid[b] = num_fields == num_dims;
+              return block_is_valid[b] != 0;
+            });
+          }
+        },
+        1);
+    if (std::find(block_is_valid.begin(), block_is_valid.end(), 0) != block_is_valid.end()) {
+      return false;
+    }
+
+    RoundCorrespondenceIds(requested, X);
+    if (X.rows() > 0) consume_batch(std::move(X));
+    batch_first_block = batch_last_block;
+  }
+  return true;
+}
+
+enum class PlyType { kInt8, kUint8, kInt16, kUint16, kInt32, kUint32, kFloat32, kFloat64 };
+
+std::optional<PlyType> PlyTypeFromString(const std::string& type) {
+  if (type == "char" || type == "int8") return PlyType::kInt8;
+  if (type == "uchar" || type == "uint8") return PlyType::kUint8;
+  if (type == "short" || type == "int16") return PlyType::kInt16;
+  if (type == "ushort" || type == "uint16") return PlyType::kUint16;
+  if (type == "int" || type == "int32") return PlyType::kInt32;
+  if (type == "uint" || type == "uint32") return PlyType::kUint32;
+  if (type == "float" || type == "float32") return PlyType::kFloat32;
+  if (type == "double" || type == "float64") return PlyType::kFloat64;
+  return std::nullopt;
+}
+
+size_t PlyTypeSize(const PlyType& type) {
+  switch (type) {
+    case PlyType::kInt8:
+    case PlyType::kUint8:
+      return 1;
+    case PlyType::kInt16:
+    case PlyType::kUint16:
+      return 2;
+    case PlyType::kInt32:
+    case PlyType::kUint32:
+    case PlyType::kFloat32:
+      return 4;
+    default:
+      return 8;
+  }
+}
+
+template <typename T>
+double ValueAs(const char* bytes) {
+  T value;
+  std::memcpy(&value, bytes, sizeof(T));
+  return static_cast<double>(value);
+}
+
+double ReadPlyValue(const char* src, const PlyType& type, const bool& swap_bytes) {
+  char bytes[8];
+  size_t size{PlyTypeSize(type)};
+  if (swap_bytes) {
+    std::reverse_copy(src, src + size, bytes);
+  } else {
+    std::memcpy(bytes, src, size);
+  }
+  switch (type) {
+    case PlyType::kInt8:
+      return ValueAs<int8_t>(bytes);
+    case PlyType::kUint8:
+      return ValueAs<uint8_t>(bytes);
+    case PlyType::kInt16:
+      return ValueAs<int16_t>(bytes);
+    case PlyType::kUint16:
+      return ValueAs<uint16_t>(bytes);
+    case PlyType::kInt32:
+      return ValueAs<int32_t>(bytes);
+    case PlyType::kUint32:
+      return ValueAs<uint32_t>(bytes);
+    case PlyType::kFloat32:
+      return ValueAs<float>(bytes);
+    default:
+      return ValueAs<double>(bytes);
+  }
+}
+
+bool HostIsLittleEndian() {
+  const uint16_t one{1};
+  char first_byte;
+  std::memcpy(&first_byte, &one, 1);
+  return first_byte == 1;
+}
+
+bool ReadBinaryPly(const MappedFile& file, const RequestedColumns& requested,
+                   const Eigen::Index& batch_num_pts, const ConsumeBatch& consume_batch) {
+  if (file.size() == 0) return false;
+  const char* first{file.data()};
+  const char* last{first + file.size()};
+
+  // Header with the vertex properties
+  bool is_little_endian{false};
+  Eigen::Index num_pts{-1};
+  std::vector<std::string> property_names{};
+  std::vector<PlyType> property_types{};
+  std::vector<size_t> property_offsets{};
+  size_t vertex_size{0};
+  int element_idx{-1};
+  const char* body{nullptr};
+  for (const char* line_first{first}; line_first < last && body == nullptr;) {
+    const char* line_last{
+        static_cast<const char*>(std::memchr(line_first, '\n', last - line_first))};
+    if (line_last == nullptr) return false;
+    std::istringstream line{std::string(line_first, line_last)};
+    std::string keyword;
+    line >> keyword;
+    if (line_first == first) {
+      if (keyword != "ply") return false;
+    } else if (keyword == "format") {
+      std::string format;
+      line >> format;
+      if (format != "binary_little_endian" && format != "binary_big_endian") return false;
+      is_little_endian = format == "binary_little_endian";
+    } else if (keyword == "element") {
+      element_idx++;
+      std::string name;
+      line >> name;
+      if (element_idx == 0) {
+        if (name != "vertex" || !(line >> num_pts)) return false;
+      }
+    } else if (keyword == "property" && element_idx == 0) {
+      std::string type, name;
+      line >> type >> name;
+      auto ply_type{PlyTypeFromString(type)};
+      if (!ply_type) return false;  // e.g. list properties
+      property_names.push_back(name);
+      property_types.push_back(*ply_type);
+      property_offsets.push_back(vertex_size);
+      vertex_size += PlyTypeSize(*ply_type);
+    } else if (keyword == "end_header") {
+      body = line_last + 1;
+    }
+    line_first = line_last + 1;
+  }
+  if (body == nullptr || num_pts <= 0 ||
+      static_cast<size_t>(last - body) < static_cast<size_t>(num_pts) * vertex_size) {
+    return false;
+  }
+  std::vector<int> col_of_property{GetColOfDims(property_names, requested)};
+  if (col_of_property.empty()) return false;
+
+  // Read the requested properties of the vertices in batches
+  bool swap_bytes{is_little_endian != HostIsLittleEndian()};
+  for (Eigen::Index batch_first_pt = 0; batch_first_pt < num_pts;) {
+    Eigen::Index batch_size{std::min(batch_num_pts, num_pts - batch_first_pt)};
+    NamedColumnMatrix<Eigen::MatrixXd> X(
+        Eigen::MatrixXd(batch_size, static_cast<Eigen::Index>(requested.col_names.size())),
+        requested.col_names);
+    for (size_t p = 0; p < property_names.size(); p++) {
+      if (col_of_property[p] < 0) continue;
+      double* col{X.col(col_of_property[p]).data()};
+      const char* src{body + batch_first_pt * vertex_size + property_offsets[p]};
+      ParallelFor(0, batch_size, [&](const int64_t& first_pt, const int64_t& last_pt, const int&) {
+        for (int64_t i = first_pt; i < last_pt; i++) {
+          col[i] = ReadPlyValue(src + i * vertex_size, property_types[p], swap_bytes);
+        }
+      });
+    }
+
+    RoundCorrespondenceIds(requested, X);
+    consume_batch(std::move(X));
+    batch_first_pt += batch_size;
+  }
+  return true;
+}
+
+}  // namespace
+
+bool ReadPointcloudNatively(
+    const std::string& path, const bool& with_normals, const bool& with_correspondence_id,
+    const Eigen::Index& batch_num_pts,
+    const std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>& consume_batch) {
+  std::string extension{std::filesystem::path(path).extension().string()};
+  if (extension != ".xyz" && extension != ".txt" && extension != ".ply") return false;
+  if (!std::filesystem::is_regular_file(path)) return false;
+
+  MappedFile file{path};
+  RequestedColumns requested{GetRequestedColumns(with_normals, with_correspondence_id)};
+  return extension == ".ply" ? ReadBinaryPly(file, requested, batch_num_pts, consume_batch)
+                             : ReadText(file, requested, batch_num_pts, consume_batch);
+}
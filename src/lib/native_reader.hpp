@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <functional>
+#include <string>
+
+#include "named_column_matrix.hpp"
+
+// Reads x, y, z and optionally the normals and the correspondence ids of a point cloud without
+// PDAL, i.e. from a memory mapping of the file which is parsed in parallel. Supported are
+// - text files (.xyz, .txt) with a header line of dimension names separated by whitespace or
+//   commas, as read by PDAL's readers.text, and
+// - binary PLY files (.ply) whose first element is the vertex element without list properties.
+// The dimensions X, Y, Z, NormalX, NormalY, NormalZ and CorrespondenceID are matched case
+// insensitively. The points are passed to consume_batch in batches of about batch_num_pts points in
+// the order of the file; the columns are named as by ExtractMatrix.
+// Returns false if the file is not supported or does not have all requested fields, or if it is
+// malformed or empty, i.e. PDAL is the fallback which also reports all errors. If a malformed line
+// is found after some batches were passed to consume_batch, these must be discarded.
+bool ReadPointcloudNatively(
+    const std::string& path, const bool& with_normals, const bool& with_correspondence_id,
+    const Eigen::Index& batch_num_pts,
+    const std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>& consume_batch);
@@ -0,0 +1,614 @@
+#include "normal_equations.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <numeric>
+#include <stdexcept>
+
+#include "memory_usage.hpp"
+#include "parallel.hpp"
+
+namespace {
+
+// Bit of the neighbour node at offset (dx,dy,dz), with dx,dy,dz in {-1,0,1}, in a node mask
+inline int NeighbourBit(const int& dx, const int& dy, const int& dz) {
+  return (dx + 1) * 9 + (dy + 1) * 3 + (dz + 1);
+}
+
+const int SELF_BIT{NeighbourBit(0, 0, 0)};
+
+// Offsets of the 8 corner nodes of a voxel, in the order used by TranslationGrid::Get_f
+inline int CornerDx(const int& corner) { return corner & 1; }
+inline int CornerDy(const int& corner) { return (corner >> 1) & 1; }
+inline int CornerDz(const int& corner) { return (corner >> 2) & 1; }
+
+// Voxels with the same color have no corner nodes in common
+inline int VoxelColor(const int& x_voxel_idx, const int& y_voxel_idx, const int& z_voxel_idx) {
+  return (x_voxel_idx & 1) | ((y_voxel_idx & 1) << 1) | ((z_voxel_idx & 1) << 2);
+}
+
+inline int PopCount(const uint32_t& mask) {
+  return static_cast<int>(std::bitset<32>(mask).count());
+}
+
+}  // namespace
+
+void NormalEquations::SetMatrixFormat(const MatrixFormat& matrix_format) {
+  matrix_format_ = matrix_format;
+  x_num_voxels_ = 0;
+  y_num_voxels_ = 0;
+  z_num_voxels_ = 0;
+}
+
+void NormalEquations::Assemble(const TranslationGrid& x_translation_grid,
+                               const TranslationGrid& y_translation_grid,
+                               const TranslationGrid& z_translation_grid,
+                               const CorrespondencesPointsWithAttributes& X,
+                               const Eigen::VectorXd& l, const double& weight_zero_observations) {
+  CheckTranslationGrids(x_translation_grid, y_translation_grid, z_translation_grid);
+  if (x_translation_grid.x_num_voxels() != x_num_voxels_ ||
+      x_translation_grid.y_num_voxels() != y_num_voxels_ ||
+      x_translation_grid.z_num_voxels() != z_num_voxels_) {
+    InitializeTopology(x_translation_grid);
+  }
+
+  // Sort correspondences by voxel
+  auto [X_voxel_idx, Xn_voxel]{GetGridReference(x_translation_grid, X)};
+  std::vector<int> idx_voxel(X.num);
+  for (int i = 0; i < X.num; i++) {
+    idx_voxel[i] = (X_voxel_idx(i, 0) * y_num_voxels_ + X_voxel_idx(i, 1)) * z_num_voxels_ +
+                   X_voxel_idx(i, 2);
+  }
+  std::vector<int> order(X.num);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](const int& a, const int& b) { return idx_voxel[a] < idx_voxel[b]; });
+
+  // Groups of correspondences within the same voxel, split by voxel color
+  std::vector<int> group_first{};
+  std::vector<int> group_voxels{};
+  for (int i = 0; i < X.num; i++) {
+    if (i == 0 || idx_voxel[order[i]] != idx_voxel[order[i - 1]]) {
+      group_first.push_back(i);
+      group_voxels.push_back(idx_voxel[order[i]]);
+    }
+  }
+  group_first.push_back(X.num);
+  std::vector<std::vector<int>> groups_of_color(8);
+  for (size_t group = 0; group < group_voxels.size(); group++) {
+    int x_voxel_idx{group_voxels[group] / (y_num_voxels_ * z_num_voxels_)};
+    int y_voxel_idx{(group_voxels[group] / z_num_voxels_) % y_num_voxels_};
+    int z_voxel_idx{group_voxels[group] % z_num_voxels_};
+    groups_of_color[VoxelColor(x_voxel_idx, y_voxel_idx, z_voxel_idx)].push_back(group);
+  }
+
+  UpdatePattern(group_voxels);
+
+  // Numeric refill
+  bool is_bsr{matrix_format_ == MatrixFormat::kBSR};
+  if (is_bsr) {
+    N_blocks_.SetZero();
+  } else {
+    std::fill(N_.valuePtr(), N_.valuePtr() + N_.nonZeros(), 0.0);
+  }
+  n_ = Eigen::VectorXd::Zero(num_unknowns_);
+
+  // Zero observations
+  // Todo Use weights_zero_observations[0] to weights_zero_observations[3] for observation of
+  // f,fx,fy,fz,...
+  ParallelFor(0, num_nodes_, [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+    for (int64_t node = first; node < last; node++) {
+      for (int g = 0; g < 3; g++)
+        for (int p = 0; p < 8; p++) {
+          if (is_bsr) {
+            int64_t first_block_idx{N_blocks_.outer()[8 * node + p]};
+            N_blocks_.values()[9 * BlockIdx(first_block_idx, node_mask_[node], SELF_BIT, p) +
+                               4 * g] += weight_zero_observations;
+            continue;
+          }
+          int64_t col{g * 8 * static_cast<int64_t>(num_nodes_) + 8 * node + p};
+          int64_t first_value_idx{N_.outerIndexPtr()[col]};
+          N_.valuePtr()[ValueIdx(first_value_idx, node_mask_[node], g, SELF_BIT, p)] +=
+              weight_zero_observations;
+        }
+    }
+  });
+
+  // Point-to-plane observations: accumulate per voxel, J of a correspondence is the stencil c
+  // (64 coefficients) scaled by nx, ny and nz for the unknowns of the x, y and z grid
+  const auto& inv_A{x_translation_grid.inv_A()};
+  auto accumulate_voxel = [&](const int& group) {
+    int first{group_first[group]};
+    int num{group_first[group + 1] - first};
+
+    std::vector<int> rows(num);
+    Eigen::MatrixX3d normals(num, 3);
+    Eigen::VectorXd l_voxel(num);
+    for (int r = 0; r < num; r++) {
+      int i{order[first + r]};
+      rows[r] = i;
+      normals(r, 0) = X.pc_fix_nx(i);
+      normals(r, 1) = X.pc_fix_ny(i);
+      normals(r, 2) = X.pc_fix_nz(i);
+      l_voxel(r) = l(i);
+    }
+    Eigen::Matrix<double, Eigen::Dynamic, 64> C{Stencils(rows, Xn_voxel, inv_A)};
+
+    // M[g][h] = sum of n_g*n_h*c*c' and r[g] = sum of n_g*l*c over the correspondences
+    Eigen::Matrix<double, 64, 64> M[3][3];
+    Vector64d r[3];
+    for (int g = 0; g < 3; g++) {
+      for (int h = g; h < 3; h++) {
+        Eigen::VectorXd w{normals.col(g).cwiseProduct(normals.col(h))};
+        M[g][h].noalias() = C.transpose() * w.asDiagonal() * C;
+      }
+      r[g].noalias() = C.transpose() * normals.col(g).cwiseProduct(l_voxel);
+    }
+
+    int x_voxel_idx{group_voxels[group] / (y_num_voxels_ * z_num_voxels_)};
+    int y_voxel_idx{(group_voxels[group] / z_num_voxels_) % y_num_voxels_};
+    int z_voxel_idx{group_voxels[group] % z_num_voxels_};
+    int corner_nodes[8];
+    for (int i = 0; i < 8; i++) {
+      corner_nodes[i] = x_translation_grid.NodeIdx(x_voxel_idx + CornerDx(i),
+                                                   y_voxel_idx + CornerDy(i),
+                                                   z_voxel_idx + CornerDz(i));
+    }
+
+    // Scatter into the columns of the unknowns of the corner nodes; coefficient 8*p+i of c
+    // belongs to param p of corner node i. In the block format, the column of unknown (g, node, p)
+    // is entry g of the block row of (node, p), as N is symmetric.
+    for (int i = 0; i < 8; i++) {
+      int64_t node{corner_nodes[i]};
+      for (int g = 0; g < 3; g++)
+        for (int p = 0; p < 8; p++) {
+          int64_t col{g * 8 * static_cast<int64_t>(num_nodes_) + 8 * node + p};
+          int64_t first_idx{is_bsr ? N_blocks_.outer()[8 * node + p] : N_.outerIndexPtr()[col]};
+          n_(col) += r[g](8 * p + i);
+          for (int j = 0; j < 8; j++) {
+            int neighbour_bit{NeighbourBit(CornerDx(j) - CornerDx(i), CornerDy(j) - CornerDy(i),
+                                           CornerDz(j) - CornerDz(i))};
+            for (int h = 0; h < 3; h++) {
+              const auto& M_gh{g <= h ? M[g][h] : M[h][g]};
+              if (is_bsr) {
+                double* values{N_blocks_.values() +
+                               9 * BlockIdx(first_idx, node_mask_[node], neighbour_bit, 0) +
+                               3 * g + h};
+                for (int q = 0; q < 8; q++) values[9 * q] += M_gh(8 * q + j, 8 * p + i);
+                continue;
+              }
+              double* values{N_.valuePtr() +
+                             ValueIdx(first_idx, node_mask_[node], h, neighbour_bit, 0)};
+              for (int q = 0; q < 8; q++) values[q] += M_gh(8 * q + j, 8 * p + i);
+            }
+          }
+        }
+    }
+  };
+
+  // Voxels of the same color do not share nodes, i.e. they can be accumulated concurrently
+  for (const auto& groups : groups_of_color) {
+    ParallelFor(
+        0, static_cast<int64_t>(groups.size()),
+        [&](const int64_t& first, const int64_t& last, const int& /*chunk_idx*/) {
+          for (int64_t k = first; k < last; k++) accumulate_voxel(groups[k]);
+        },
+        8);
+  }
+
+  if (is_bsr) diagonal_ = N_blocks_.Diagonal();
+}
+
+template <typename F>
+void NormalEquations::AccumulatePerChunk(F scatter, Eigen::VectorXd& y) const {
+  int64_t num{stencils_.rows()};
+  int num_chunks{NumParallelChunks(0, num)};
+  y_per_chunk_.resize(num_chunks);
+  for (auto& y_chunk : y_per_chunk_) y_chunk.setZero(num_unknowns_);
+
+  ParallelFor(0, num, [&](const int64_t& first, const int64_t& last, const int& chunk_idx) {
+    for (int64_t i = first; i < last; i++) scatter(i, y_per_chunk_[chunk_idx]);
+  });
+
+  y.setZero(num_unknowns_);
+  ParallelFor(0, num_unknowns_,
+              [&](const int64_t& first, const int64_t& last, const int& /*chunk_idx*/) {
+                for (const auto& y_chunk : y_per_chunk_) {
+                  y.segment(first, last - first) += y_chunk.segment(first, last - first);
+                }
+              });
+}
+
+void NormalEquations::AssembleMatrixFree(const TranslationGrid& x_translation_grid,
+                                         const TranslationGrid& y_translation_grid,
+                                         const TranslationGrid& z_translation_grid,
+                                         const CorrespondencesPointsWithAttributes& X,
+                                         const Eigen::VectorXd& l,
+                                         const double& weight_zero_observations) {
+  CheckTranslationGrids(x_translation_grid, y_translation_grid, z_translation_grid);
+  if (x_translation_grid.x_num_voxels() != x_num_voxels_ ||
+      x_translation_grid.y_num_voxels() != y_num_voxels_ ||
+      x_translation_grid.z_num_voxels() != z_num_voxels_) {
+    InitializeTopology(x_translation_grid);
+  }
+  weight_zero_observations_ = weight_zero_observations;
+
+  for (int i = 0; i < 8; i++) {
+    corner_node_offsets_[i] = x_translation_grid.NodeIdx(CornerDx(i), CornerDy(i), CornerDz(i));
+  }
+
+  // Stencils
+  auto [X_voxel_idx, Xn_voxel]{GetGridReference(x_translation_grid, X)};
+  stencils_.resize(X.num, 64);
+  stencil_normals_.resize(X.num, 3);
+  stencil_first_nodes_.resize(X.num);
+  const auto& inv_A{x_translation_grid.inv_A()};
+  ParallelFor(0, X.num, [&](const int64_t& first, const int64_t& last, const int& /*chunk_idx*/) {
+    std::vector<int> rows(last - first);
+    std::iota(rows.begin(), rows.end(), static_cast<int>(first));
+    stencils_.middleRows(first, last - first) = Stencils(rows, Xn_voxel, inv_A);
+    for (int64_t i = first; i < last; i++) {
+      stencil_normals_(i, 0) = X.pc_fix_nx(i);
+      stencil_normals_(i, 1) = X.pc_fix_ny(i);
+      stencil_normals_(i, 2) = X.pc_fix_nz(i);
+      stencil_first_nodes_[i] =
+          x_translation_grid.NodeIdx(X_voxel_idx(i, 0), X_voxel_idx(i, 1), X_voxel_idx(i, 2));
+    }
+  });
+
+  // Unknown of param p of corner node corner in grid g, and its coefficient in the stencil
+  int64_t num_grid_vals{8 * static_cast<int64_t>(num_nodes_)};
+  auto for_each_coeff = [&](const int64_t& i, auto f) {
+    for (int corner = 0; corner < 8; corner++) {
+      int64_t first_unknown{8 * static_cast<int64_t>(stencil_first_nodes_[i] +
+                                                     corner_node_offsets_[corner])};
+      for (int g = 0; g < 3; g++)
+        for (int p = 0; p < 8; p++) {
+          f(g * num_grid_vals + first_unknown + p,
+            stencil_normals_(i, g) * stencils_(i, 8 * p + corner));
+        }
+    }
+  };
+
+  // n = J'*P*l
+  AccumulatePerChunk(
+      [&](const int64_t& i, Eigen::VectorXd& y) {
+        for_each_coeff(i, [&](const int64_t& idx, const double& a) { y(idx) += a * l(i); });
+      },
+      n_);
+
+  // Diagonal of N
+  AccumulatePerChunk(
+      [&](const int64_t& i, Eigen::VectorXd& y) {
+        for_each_coeff(i, [&](const int64_t& idx, const double& a) { y(idx) += a * a; });
+      },
+      diagonal_);
+  diagonal_.array() += weight_zero_observations_;
+}
+
+void NormalEquations::Apply(const Eigen::VectorXd& x, Eigen::VectorXd& y) const {
+  int64_t num_grid_vals{8 * static_cast<int64_t>(num_nodes_)};
+  auto first_unknown = [&](const int64_t& i, const int& corner) {
+    return 8 * static_cast<int64_t>(stencil_first_nodes_[i] + corner_node_offsets_[corner]);
+  };
+
+  // y = J'*(J*x) + w*x, where J*x is computed per correspondence
+  AccumulatePerChunk(
+      [&](const int64_t& i, Eigen::VectorXd& y_chunk) {
+        double Jx{0};
+        for (int corner = 0; corner < 8; corner++)
+          for (int g = 0; g < 3; g++) {
+            const double* x_node{x.data() + g * num_grid_vals + first_unknown(i, corner)};
+            double sum{0};
+            for (int p = 0; p < 8; p++) sum += stencils_(i, 8 * p + corner) * x_node[p];
+            Jx += stencil_normals_(i, g) * sum;
+          }
+        for (int corner = 0; corner < 8; corner++)
+          for (int g = 0; g < 3; g++) {
+            double* y_node{y_chunk.data() + g * num_grid_vals + first_unknown(i, corner)};
+            double a{stencil_normals_(i, g) * Jx};
+            for (int p = 0; p < 8; p++) y_node[p] += a * stencils_(i, 8 * p + corner);
+          }
+      },
+      y);
+  y += weight_zero_observations_ * x;
+}
+
+void NormalEquations::AssembleFromJacobian(TranslationGrid& x_translation_grid,
+                                           TranslationGrid& y_translation_grid,
+                                           TranslationGrid& z_translation_grid,
+                                           const CorrespondencesPointsWithAttributes& X,
+                                           const Eigen::VectorXd& l,
+                                           const double& weight_zero_observations) {
+  int num_unknowns{x_translation_grid.num_grid_vals() + y_translation_grid.num_grid_vals() +
+                   z_translation_grid.num_grid_vals()};
+  int num_observations{X.num + num_unknowns};
+  if (stencil_cache_.enabled()) stencil_cache_.Update(x_translation_grid, X.pc_mov_idx, X.pc_mov_X);
+
+  // Triplets of the point-to-plane observations of the x, y and z grids, followed by the identity
+  // of the zero observations; the normal vector components are applied during generation
+  std::vector<Eigen::Triplet<double>> J_triplets(3 * 64 * static_cast<size_t>(X.num) +
+                                                 num_unknowns);
+  const TranslationGrid* translation_grids[3]{&x_translation_grid, &y_translation_grid,
+                                              &z_translation_grid};
+  const Eigen::VectorXd* normal_components[3]{&X.pc_fix_nx, &X.pc_fix_ny, &X.pc_fix_nz};
+  ParallelFor(
+      0, 3,
+      [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+        for (int64_t g = first; g < last; g++) {
+          auto* triplets{J_triplets.data() + g * 64 * static_cast<size_t>(X.num)};
+          if (stencil_cache_.enabled()) {
+            translation_grids[g]->J(stencil_cache_, *normal_components[g], triplets);
+          } else {
+            translation_grids[g]->J(X.pc_mov_X, *normal_components[g], triplets);
+          }
+        }
+      },
+      1);
+  size_t first_direct_obs_triplet{3 * 64 * static_cast<size_t>(X.num)};
+  for (int i = 0; i < num_unknowns; i++) {
+    J_triplets[first_direct_obs_triplet + i] = Eigen::Triplet<double>(X.num + i, i, 1.0);
+  }
+
+  Eigen::SparseMatrix<double> J(num_observations, num_unknowns);
+  SparseMatrixFromTriplets(J_triplets, J);
+  J_triplets = std::vector<Eigen::Triplet<double>>{};
+
+  Eigen::VectorXd p(num_observations);
+  // Todo Use weights_zero_observations[0] to weights_zero_observations[3] for observation of
+  // f,fx,fy,fz,...
+  p << Eigen::VectorXd::Ones(X.num), Eigen::VectorXd::Ones(num_unknowns) * weight_zero_observations;
+  auto P{p.asDiagonal()};
+
+  Eigen::VectorXd l_all(num_observations);
+  l_all << l, Eigen::VectorXd::Zero(num_unknowns);
+
+  N_ = J.transpose() * P * J;
+  n_ = J.transpose() * P * l_all;
+  pattern_version_++;
+
+  // The pattern of the direct assembly is not valid anymore
+  x_num_voxels_ = 0;
+  y_num_voxels_ = 0;
+  z_num_voxels_ = 0;
+}
+
+void NormalEquations::SetStencilCacheMemoryBudget(const size_t& memory_budget) {
+  stencil_cache_.SetMemoryBudget(memory_budget);
+}
+
+std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> NormalEquations::GetGridReference(
+    const TranslationGrid& translation_grid, const CorrespondencesPointsWithAttributes& X) {
+  if (!stencil_cache_.enabled()) return translation_grid.GetGridReference(X.pc_mov_X);
+
+  stencil_cache_.Update(translation_grid, X.pc_mov_idx, X.pc_mov_X);
+  Eigen::MatrixX3i X_voxel_idx(X.num, 3);
+  for (int i = 0; i < X.num; i++) X_voxel_idx.row(i) = stencil_cache_.voxel_idx(i);
+  return {X_voxel_idx, Eigen::MatrixX3d{}};
+}
+
+Eigen::Matrix<double, Eigen::Dynamic, 64> NormalEquations::Stencils(
+    const std::vector<int>& rows, const Eigen::MatrixX3d& Xn_voxel,
+    const Eigen::Matrix<double, 64, 64>& inv_A) const {
+  int num{static_cast<int>(rows.size())};
+  Eigen::Matrix<double, Eigen::Dynamic, 64> C(num, 64);  // returned
+  if (stencil_cache_.enabled()) {
+    for (int r = 0; r < num; r++) {
+      C.row(r) = Eigen::Map<const Eigen::Matrix<float, 1, 64>>(stencil_cache_.stencil(rows[r]))
+                     .cast<double>();
+    }
+    return C;
+  }
+
+  Eigen::MatrixX3d Xn(num, 3);
+  for (int r = 0; r < num; r++) Xn.row(r) = Xn_voxel.row(rows[r]);
+  C = TranslationGrid::Compute_X_power(Xn) * inv_A;
+  return C;
+}
+
+void NormalEquations::CheckTranslationGrids(const TranslationGrid& x_translation_grid,
+                                            const TranslationGrid& y_translation_grid,
+                                            const TranslationGrid& z_translation_grid) {
+  const TranslationGrid* translation_grids[3]{&x_translation_grid, &y_translation_grid,
+                                              &z_translation_grid};
+  for (int g = 0; g < 3; g++) {
+    if (translation_grids[g]->x_num_voxels() != x_translation_grid.x_num_voxels() ||
+        translation_grids[g]->y_num_voxels() != x_translation_grid.y_num_voxels() ||
+        translation_grids[g]->z_num_voxels() != x_translation_grid.z_num_voxels() ||
+        translation_grids[g]->min_idx_adj() != g * x_translation_grid.num_grid_vals()) {
+      throw std::runtime_error(
+          "Translation grids must share their geometry and their unknowns must be ordered x, y, "
+          "z!");
+    }
+  }
+}
+
+void NormalEquations::InitializeTopology(const TranslationGrid& translation_grid) {
+  x_num_voxels_ = translation_grid.x_num_voxels();
+  y_num_voxels_ = translation_grid.y_num_voxels();
+  z_num_voxels_ = translation_grid.z_num_voxels();
+  num_nodes_ = (x_num_voxels_ + 1) * (y_num_voxels_ + 1) * (z_num_voxels_ + 1);
+  num_unknowns_ = 3 * 8 * num_nodes_;
+  voxel_is_active_ = std::vector<bool>(x_num_voxels_ * y_num_voxels_ * z_num_voxels_, false);
+  node_mask_ = std::vector<uint32_t>(num_nodes_, 0);
+  N_ = Eigen::SparseMatrix<double>{};
+  N_blocks_ = BlockSparseMatrix{};
+}
+
+void NormalEquations::UpdatePattern(const std::vector<int>& idx_voxels) {
+  auto node_idx = [&](const int& x_node_idx, const int& y_node_idx, const int& z_node_idx) {
+    return (x_node_idx * (y_num_voxels_ + 1) + y_node_idx) * (z_num_voxels_ + 1) + z_node_idx;
+  };
+
+  bool pattern_changed{(matrix_format_ == MatrixFormat::kBSR ? N_blocks_.rows() : N_.rows()) !=
+                       num_unknowns_};
+  for (const auto& idx_voxel : idx_voxels) {
+    if (voxel_is_active_[idx_voxel]) continue;
+    voxel_is_active_[idx_voxel] = true;
+    pattern_changed = true;
+
+    int x_voxel_idx{idx_voxel / (y_num_voxels_ * z_num_voxels_)};
+    int y_voxel_idx{(idx_voxel / z_num_voxels_) % y_num_voxels_};
+    int z_voxel_idx{idx_voxel % z_num_voxels_};
+    for (int i = 0; i < 8; i++)
+      for (int j = 0; j < 8; j++) {
+        node_mask_[node_idx(x_voxel_idx + CornerDx(i), y_voxel_idx + CornerDy(i),
+                            z_voxel_idx + CornerDz(i))] |=
+            1u << NeighbourBit(CornerDx(j) - CornerDx(i), CornerDy(j) - CornerDy(i),
+                               CornerDz(j) - CornerDz(i));
+      }
+  }
+  if (!pattern_changed) return;
+
+  auto neighbour_node_idx = [&](const int64_t& node, const int& bit) {
+    return node + (((bit / 9 - 1) * (y_num_voxels_ + 1) + ((bit / 3) % 3 - 1)) *
+                       (z_num_voxels_ + 1) +
+                   (bit % 3 - 1));
+  };
+
+  if (matrix_format_ == MatrixFormat::kBSR) {
+    // Block rows of nodes without observations only contain the diagonal block, all other block
+    // rows contain the blocks of all coupled nodes
+    std::vector<int64_t> outer(8 * static_cast<size_t>(num_nodes_) + 1, 0);
+    for (int node = 0; node < num_nodes_; node++)
+      for (int p = 0; p < 8; p++) {
+        int64_t num_blocks{node_mask_[node] == 0 ? 1 : 8 * PopCount(node_mask_[node])};
+        outer[8 * node + p + 1] = outer[8 * node + p] + num_blocks;
+      }
+    std::vector<int> inner(outer.back());
+    ParallelFor(
+        0, num_nodes_, [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+          for (int64_t node = first; node < last; node++) {
+            uint32_t node_mask{node_mask_[node]};
+            for (int p = 0; p < 8; p++) {
+              int* row_inner{inner.data() + outer[8 * node + p]};
+              if (node_mask == 0) {
+                row_inner[0] = static_cast<int>(8 * node + p);
+                continue;
+              }
+              for (int bit = 0; bit < 27; bit++) {
+                if (!(node_mask & (1u << bit))) continue;
+                for (int q = 0; q < 8; q++) {
+                  *(row_inner++) = static_cast<int>(8 * neighbour_node_idx(node, bit) + q);
+                }
+              }
+            }
+          }
+        });
+    N_blocks_.SetPattern(std::move(outer), std::move(inner));
+    pattern_version_++;
+    return;
+  }
+
+  // Columns of unknowns of nodes without observations only contain the diagonal, all other columns
+  // contain the unknowns of the 3 grids for all coupled nodes
+  auto num_values_in_col = [&](const int& node) {
+    return node_mask_[node] == 0 ? 1 : 3 * 8 * PopCount(node_mask_[node]);
+  };
+
+  N_.resize(num_unknowns_, num_unknowns_);
+  auto* outer{N_.outerIndexPtr()};
+  outer[0] = 0;
+  for (int g = 0; g < 3; g++)
+    for (int node = 0; node < num_nodes_; node++)
+      for (int p = 0; p < 8; p++) {
+        int64_t col{g * 8 * static_cast<int64_t>(num_nodes_) + 8 * node + p};
+        outer[col + 1] = outer[col] + num_values_in_col(node);
+      }
+  N_.resizeNonZeros(outer[num_unknowns_]);
+
+  // Row indices, sorted as nodes are sorted by their linear index
+  auto* inner{N_.innerIndexPtr()};
+  ParallelFor(0, num_nodes_, [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+    for (int64_t node = first; node < last; node++) {
+      uint32_t node_mask{node_mask_[node]};
+      for (int g = 0; g < 3; g++)
+        for (int p = 0; p < 8; p++) {
+          int64_t col{g * 8 * static_cast<int64_t>(num_nodes_) + 8 * node + p};
+          auto* col_inner{inner + outer[col]};
+          if (node_mask == 0) {
+            col_inner[0] = col;
+            continue;
+          }
+          for (int h = 0; h < 3; h++)
+            for (int bit = 0; bit < 27; bit++) {
+              if (!(node_mask & (1u << bit))) continue;
+              int64_t neighbour_node{neighbour_node_idx(node, bit)};
+              for (int q = 0; q < 8; q++) {
+                *(col_inner++) = h * 8 * static_cast<int64_t>(num_nodes_) + 8 * neighbour_node + q;
+              }
+            }
+        }
+    }
+  });
+
+  pattern_version_++;
+}
+
+int64_t NormalEquations::ValueIdx(const int64_t& first_value_idx, const uint32_t& node_mask,
+                                  const int& grid_row, const int& neighbour_bit,
+                                  const int& param_row) {
+  if (node_mask == 0) return first_value_idx;
+  int rank{PopCount(node_mask & ((1u << neighbour_bit) - 1))};
+  return first_value_idx + (grid_row * PopCount(node_mask) + rank) * 8 + param_row;
+}
+
+int64_t NormalEquations::BlockIdx(const int64_t& first_block_idx, const uint32_t& node_mask,
+                                  const int& neighbour_bit, const int& param_row) {
+  if (node_mask == 0) return first_block_idx;
+  int rank{PopCount(node_mask & ((1u << neighbour_bit) - 1))};
+  return first_block_idx + rank * 8 + param_row;
+}
+
+void NormalEquations::SparseMatrixFromTriplets(
+    const std::vector<Eigen::Triplet<double>>& triplets, Eigen::SparseMatrix<double>& A) {
+  int64_t num_triplets{static_cast<int64_t>(triplets.size())};
+  int num_cols{static_cast<int>(A.cols())};
+  int num_chunks{NumParallelChunks(0, num_triplets)};
+
+  // Number of entries per column and chunk
+  std::vector<std::vector<int64_t>> col_counts(num_chunks);
+  ParallelFor(0, num_triplets, [&](const int64_t& first, const int64_t& last, const int& chunk) {
+    col_counts[chunk].assign(num_cols, 0);
+    for (int64_t k = first; k < last; k++) col_counts[chunk][triplets[k].col()]++;
+  });
+
+  // Prefix sum in the order (column, chunk): each chunk writes its entries of a column behind those
+  // of the previous chunks, i.e. the entries of a column keep the order of the triplets
+  A.setZero();
+  A.resizeNonZeros(num_triplets);
+  int64_t num_entries{0};
+  for (int col = 0; col < num_cols; col++) {
+    A.outerIndexPtr()[col] = static_cast<int>(num_entries);
+    for (int chunk = 0; chunk < num_chunks; chunk++) {
+      int64_t count{col_counts[chunk].empty() ? 0 : col_counts[chunk][col]};
+      if (!col_counts[chunk].empty()) col_counts[chunk][col] = num_entries;
+      num_entries += count;
+    }
+  }
+  A.outerIndexPtr()[num_cols] = static_cast<int>(num_entries);
+
+  ParallelFor(0, num_triplets, [&](const int64_t& first, const int64_t& last, const int& chunk) {
+    for (int64_t k = first; k < last; k++) {
+      int64_t value_idx{col_counts[chunk][triplets[k].col()]++};
+      A.innerIndexPtr()[value_idx] = triplets[k].row();
+      A.valuePtr()[value_idx] = triplets[k].value();
+    }
+  });
+}
+
+const Eigen::SparseMatrix<double>& NormalEquations::N() const { return N_; }
+const BlockSparseMatrix& NormalEquations::N_blocks() const { return N_blocks_; }
+const Eigen::VectorXd& NormalEquations::n() const { return n_; }
+const Eigen::VectorXd& NormalEquations::diagonal() const { return diagonal_; }
+const int& NormalEquations::num_unknowns() const { return num_unknowns_; }
+const uint64_t& NormalEquations::pattern_version() const { return pattern_version_; }
+
+size_t NormalEquations::memory() const {
+  size_t memory{MemoryUsage(N_) + N_blocks_.memory() + MemoryUsage(n_) + MemoryUsage(diagonal_)};
+  memory += voxel_is_active_.capacity() / 8 + MemoryUsage(node_mask_);
+  memory += MemoryUsage(stencils_) + MemoryUsage(stencil_normals_) +
+            MemoryUsage(stencil_first_nodes_);
+  for (const auto& y : y_per_chunk_) memory += MemoryUsage(y);
+  return memory + stencil_cache_.memory();
+}
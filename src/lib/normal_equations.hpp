@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Eigen/Sparse>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include "block_sparse_matrix.hpp"
+#include "correspondences.hpp"
+#include "stencil_cache.hpp"
+#include "translation_grid.hpp"
+
+enum class MatrixFormat {
+  // Compressed sparse columns, i.e. Eigen::SparseMatrix
+  kCSC,
+  // 3x3 blocks of the x, y and z grids, see BlockSparseMatrix
+  kBSR
+};
+
+// Normal equations N*x = n with N = J'*P*J and n = J'*P*l for the unknowns of the x, y and z
+// translation grids of the movable point cloud. Each correspondence is a point-to-plane
+// observation; each unknown additionally has a zero observation with weight
+// weight_zero_observations.
+class NormalEquations {
+ public:
+  // Storage of N used by Assemble: either N or N_blocks
+  void SetMatrixFormat(const MatrixFormat& matrix_format);
+  // Memory budget of the stencil cache in bytes, see StencilCache (0: no cache)
+  void SetStencilCacheMemoryBudget(const size_t& memory_budget);
+
+  // Accumulates the products of the tricubic stencils of the correspondences directly into N and n.
+  // The sparsity pattern of N is derived from the grid topology of the voxels containing
+  // correspondences. It is kept across calls and only extended if correspondences fall into new
+  // voxels, i.e. usually only the values of N are refilled. The grids must share their geometry
+  // and their unknowns must be ordered x, y, z.
+  void Assemble(const TranslationGrid& x_translation_grid,
+                const TranslationGrid& y_translation_grid,
+                const TranslationGrid& z_translation_grid,
+                const CorrespondencesPointsWithAttributes& X, const Eigen::VectorXd& l,
+                const double& weight_zero_observations);
+
+  // Builds the sparse Jacobian J from triplets and computes N and n as sparse products. The
+  // triplets of the x, y and z grids are generated concurrently and J is built by parallel
+  // counting sort.
+  void AssembleFromJacobian(TranslationGrid& x_translation_grid,
+                            TranslationGrid& y_translation_grid,
+                            TranslationGrid& z_translation_grid,
+                            const CorrespondencesPointsWithAttributes& X, const Eigen::VectorXd& l,
+                            const double& weight_zero_observations);
+
+  // Prepares the matrix-free application of N with Apply, i.e. N is not assembled. Only the
+  // stencils of the correspondences are stored, i.e. memory scales with the number of
+  // correspondences plus the number of unknowns.
+  void AssembleMatrixFree(const TranslationGrid& x_translation_grid,
+                          const TranslationGrid& y_translation_grid,
+                          const TranslationGrid& z_translation_grid,
+                          const CorrespondencesPointsWithAttributes& X, const Eigen::VectorXd& l,
+                          const double& weight_zero_observations);
+  // Computes y = N*x from the stencils stored by AssembleMatrixFree
+  void Apply(const Eigen::VectorXd& x, Eigen::VectorXd& y) const;
+
+  // Getters
+  const Eigen::SparseMatrix<double>& N() const;
+  const BlockSparseMatrix& N_blocks() const;
+  const Eigen::VectorXd& n() const;
+  // Diagonal of N, only computed by AssembleMatrixFree and by Assemble for MatrixFormat::kBSR
+  const Eigen::VectorXd& diagonal() const;
+  const int& num_unknowns() const;
+  // Changes whenever the sparsity pattern of N changes
+  const uint64_t& pattern_version() const;
+  // Memory of N, n, the sparsity pattern, the stored stencils and the stencil cache in bytes
+  size_t memory() const;
+
+ private:
+  static void CheckTranslationGrids(const TranslationGrid& x_translation_grid,
+                                    const TranslationGrid& y_translation_grid,
+                                    const TranslationGrid& z_translation_grid);
+  // Voxels of the correspondences and their normalized coordinates within the voxels; the latter
+  // are empty if the stencil cache is used
+  std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> GetGridReference(
+      const TranslationGrid& translation_grid, const CorrespondencesPointsWithAttributes& X);
+  // Stencils of the correspondences rows, either from the stencil cache or computed from Xn_voxel
+  Eigen::Matrix<double, Eigen::Dynamic, 64> Stencils(
+      const std::vector<int>& rows, const Eigen::MatrixX3d& Xn_voxel,
+      const Eigen::Matrix<double, 64, 64>& inv_A) const;
+  void InitializeTopology(const TranslationGrid& translation_grid);
+  void UpdatePattern(const std::vector<int>& idx_voxels);
+  // Position of the value of the unknown (grid_row, row node, param_row) in the column
+  // first_value_idx of a node with neighbour mask node_mask; row node is given by its neighbour bit
+  static int64_t ValueIdx(const int64_t& first_value_idx, const uint32_t& node_mask,
+                          const int& grid_row, const int& neighbour_bit, const int& param_row);
+  // Position of the block of (row node, param_row) in the block row first_block_idx, see ValueIdx
+  static int64_t BlockIdx(const int64_t& first_block_idx, const uint32_t& node_mask,
+                          const int& neighbour_bit, const int& param_row);
+
+  // Calls scatter(i, y_chunk) for all stored stencils i on parallel chunks and sums the per-chunk
+  // results y_chunk into y
+  template <typename F>
+  void AccumulatePerChunk(F scatter, Eigen::VectorXd& y) const;
+
+  // Builds the compressed matrix A, which must already have its final size, from triplets with
+  // parallel counting sort by column. In contrast to setFromTriplets, duplicate entries are not
+  // summed. The row indices of a column are sorted if the triplets are ordered by row within each
+  // column, which holds for the Jacobian.
+  static void SparseMatrixFromTriplets(const std::vector<Eigen::Triplet<double>>& triplets,
+                                       Eigen::SparseMatrix<double>& A);
+
+  // Topology of the grids
+  int x_num_voxels_{0};
+  int y_num_voxels_{0};
+  int z_num_voxels_{0};
+  int num_nodes_{0};
+  int num_unknowns_{0};
+  // For each voxel: true if it contained correspondences in any call of Assemble
+  std::vector<bool> voxel_is_active_{};
+  // For each node: bit NeighbourBit(dx,dy,dz) is set if the node is coupled in N with the node at
+  // offset (dx,dy,dz), i.e. if both are corners of an active voxel
+  std::vector<uint32_t> node_mask_{};
+
+  MatrixFormat matrix_format_{MatrixFormat::kCSC};
+  Eigen::SparseMatrix<double> N_{};
+  BlockSparseMatrix N_blocks_{};
+  Eigen::VectorXd n_{};
+  uint64_t pattern_version_{0};
+
+  // Matrix-free representation: for each correspondence the 64 coefficients of its stencil, its
+  // normal vector and the first node of its voxel
+  Eigen::Matrix<double, Eigen::Dynamic, 64, Eigen::RowMajor> stencils_{};
+  Eigen::MatrixX3d stencil_normals_{};
+  std::vector<int> stencil_first_nodes_{};
+  // Offsets of the 8 corner nodes of a voxel with respect to its first node
+  int corner_node_offsets_[8]{};
+  double weight_zero_observations_{0};
+  Eigen::VectorXd diagonal_{};
+  mutable std::vector<Eigen::VectorXd> y_per_chunk_{};
+
+  StencilCache stencil_cache_{};
+};
@@ -1,6 +1,21 @@
 #include "optimization.hpp"
 
-Optimization::Optimization() = default;
+#include <algorithm>
+#include <limits>
+
+#include "memory_usage.hpp"
+#include "timer.hpp"
+
+const double INEXACT_SOLVE_MAX_TOLERANCE{1e-2};
+const double INEXACT_SOLVE_FORCING_FACTOR{0.1};
+
+Optimization::Optimization(const OptimizationSettings& settings)
+    : settings_{settings}, linear_solver_{settings.solver_type} {
+  linear_solver_.SetSchwarzTiling(settings.schwarz_tile_num_nodes, settings.schwarz_overlap);
+  normal_equations_.SetMatrixFormat(settings.matrix_format);
+  normal_equations_.SetStencilCacheMemoryBudget(settings.stencil_cache_memory);
+  anderson_acceleration_.SetHistorySize(settings.anderson_history_size);
+}
 
 OptimizationResults Optimization::Solve(Correspondences& correspondences,
                                         const std::vector<double>& weights_zero_observations) {
@@ -8,84 +23,115 @@ OptimizationResults Optimization::Solve(Correspondences& correspondences,
 
   CorrespondencesPointsWithAttributes X{correspondences.GetCorrespondences()};
 
-  auto J_pc_mov_x_triplets{correspondences.pc_mov().x_translation_grid().J(X.pc_mov_X)};
-  auto J_pc_mov_y_triplets{correspondences.pc_mov().y_translation_grid().J(X.pc_mov_X)};
-  auto J_pc_mov_z_triplets{correspondences.pc_mov().z_translation_grid().J(X.pc_mov_X)};
-
-  auto J_pc_mov_x_nx_triplets{
-      Optimization::MultiplyWithComponentsOfNormalVectors(J_pc_mov_x_triplets, X.pc_fix_nx)};
-  auto J_pc_mov_y_ny_triplets{
-      Optimization::MultiplyWithComponentsOfNormalVectors(J_pc_mov_y_triplets, X.pc_fix_ny)};
-  auto J_pc_mov_z_nz_triplets{
-      Optimization::MultiplyWithComponentsOfNormalVectors(J_pc_mov_z_triplets, X.pc_fix_nz)};
-
-  J_pc_mov_x_triplets.clear();
-  J_pc_mov_y_triplets.clear();
-  J_pc_mov_z_triplets.clear();
-
   int num_unknowns{correspondences.pc_mov().x_translation_grid().num_grid_vals() +
                    correspondences.pc_mov().y_translation_grid().num_grid_vals() +
                    correspondences.pc_mov().z_translation_grid().num_grid_vals()};
 
-  auto J_direct_obs_triplets(Optimization::SparseIdentity(num_unknowns));
-
   int num_observations{X.num + num_unknowns};
 
-  std::vector<Eigen::Triplet<double>> J_triplets;
-  J_triplets.reserve(J_pc_mov_x_nx_triplets.size() + J_pc_mov_y_ny_triplets.size() +
-                     J_pc_mov_z_nz_triplets.size() + J_direct_obs_triplets.size());
-
-  // clang-format off
-  Optimization::AddSubblockTriplets(0,
-                      0,
-                      J_pc_mov_x_nx_triplets,
-                      J_triplets);
-  Optimization::AddSubblockTriplets(0,
-                      0,
-                      J_pc_mov_y_ny_triplets,
-                      J_triplets);
-  Optimization::AddSubblockTriplets(0,
-                      0,
-                      J_pc_mov_z_nz_triplets,
-                      J_triplets);
-  Optimization::AddSubblockTriplets(X.num,
-                      0,
-                      J_direct_obs_triplets,
-                      J_triplets);
-  // clang-format on
-
-  Eigen::SparseMatrix<double> J(num_observations, num_unknowns);
-  J.setFromTriplets(J_triplets.begin(), J_triplets.end());
-
-  Eigen::VectorXd p(num_observations);
-  // Todo Use weights_zero_observations[0] to weights_zero_observations[3] for observation of
-  // f,fx,fy,fz,...
-  p << Eigen::VectorXd::Ones(correspondences.num()),
-      Eigen::VectorXd::Ones(num_unknowns) * weights_zero_observations[0];
-  auto P{p.asDiagonal()};
-
-  Eigen::VectorXd b(num_observations);
-  Eigen::VectorXd b0(num_observations);
-  b = Eigen::VectorXd::Zero(num_observations);
-  b0 << correspondences.point_to_plane_dists().dists, Eigen::VectorXd::Zero(num_unknowns);
-  auto l{b - b0};
+  Eigen::VectorXd l{-correspondences.point_to_plane_dists().dists};
+
+  Timer timer{};
+  if (linear_solver_.IsMatrixFree()) {
+    normal_equations_.AssembleMatrixFree(correspondences.pc_mov().x_translation_grid(),
+                                         correspondences.pc_mov().y_translation_grid(),
+                                         correspondences.pc_mov().z_translation_grid(), X, l,
+                                         weights_zero_observations[0]);
+  } else if (settings_.assembly == Assembly::kDirect) {
+    normal_equations_.Assemble(correspondences.pc_mov().x_translation_grid(),
+                               correspondences.pc_mov().y_translation_grid(),
+                               correspondences.pc_mov().z_translation_grid(), X, l,
+                               weights_zero_observations[0]);
+  } else {
+    normal_equations_.AssembleFromJacobian(correspondences.pc_mov().x_translation_grid(),
+                                           correspondences.pc_mov().y_translation_grid(),
+                                           correspondences.pc_mov().z_translation_grid(), X, l,
+                                           weights_zero_observations[0]);
+  }
+
+  optimization_results.assembly_time = timer.elapsed();
 
   // Solve!
   Eigen::VectorXd xhat(num_unknowns);
-  Eigen::BiCGSTAB<Eigen::SparseMatrix<double>> solver;
-  solver.compute(J.transpose() * P * J);
-  if (solver.info() != Eigen::Success) {
+  if (settings_.warm_start) {
+    correspondences.pc_mov().x_translation_grid().WriteAllGridValsToVector(xhat);
+    correspondences.pc_mov().y_translation_grid().WriteAllGridValsToVector(xhat);
+    correspondences.pc_mov().z_translation_grid().WriteAllGridValsToVector(xhat);
+  }
+  optimization_results.solver_tolerance =
+      SolverTolerance(correspondences.point_to_plane_dists_t().std);
+  linear_solver_.SetTolerance(optimization_results.solver_tolerance);
+  timer.reset();
+  if (settings_.active_set) {
+    active_set_.Update(correspondences.pc_mov().x_translation_grid(),
+                       correspondences.pc_mov().y_translation_grid(),
+                       correspondences.pc_mov().z_translation_grid(), X.pc_mov_X);
+  }
+  linear_solver_.SetGridSize(correspondences.pc_mov().x_translation_grid().x_num_voxels(),
+                             correspondences.pc_mov().x_translation_grid().y_num_voxels(),
+                             correspondences.pc_mov().x_translation_grid().z_num_voxels());
+  bool computed{};
+  bool uses_blocks{!linear_solver_.IsMatrixFree() && settings_.assembly == Assembly::kDirect &&
+                   settings_.matrix_format == MatrixFormat::kBSR};
+  if (linear_solver_.IsMatrixFree() || uses_blocks) {
+    LinearOperator N{num_unknowns,
+                     [this, uses_blocks](const Eigen::VectorXd& x, Eigen::VectorXd& y) {
+                       if (uses_blocks) {
+                         normal_equations_.N_blocks().Multiply(x, y);
+                       } else {
+                         normal_equations_.Apply(x, y);
+                       }
+                     },
+                     normal_equations_.diagonal()};
+    computed = linear_solver_.Compute(settings_.active_set ? active_set_.Restrict(N) : N);
+    if (uses_blocks) {
+      optimization_results.num_nonzeros = 9 * normal_equations_.N_blocks().num_blocks();
+    }
+  } else if (settings_.active_set) {
+    N_active_ = active_set_.Restrict(normal_equations_.N(), normal_equations_.pattern_version());
+    computed = linear_solver_.Compute(N_active_, active_set_.pattern_version());
+    optimization_results.num_nonzeros = N_active_.nonZeros();
+  } else {
+    computed = linear_solver_.Compute(normal_equations_.N(), normal_equations_.pattern_version());
+    optimization_results.num_nonzeros = normal_equations_.N().nonZeros();
+  }
+  optimization_results.compute_time = timer.elapsed();
+  if (!computed) {
     optimization_results.success = false;
     return optimization_results;
   }
-  xhat = solver.solve(J.transpose() * P * l);
-  if (solver.info() != Eigen::Success) {
+  timer.reset();
+  bool solved{};
+  if (settings_.active_set) {
+    // The eliminated unknowns are zero in the solution
+    Eigen::VectorXd xhat_active{settings_.warm_start ? active_set_.Restrict(xhat)
+                                                     : Eigen::VectorXd{}};
+    solved = linear_solver_.Solve(active_set_.Restrict(normal_equations_.n()), xhat_active,
+                                  settings_.warm_start);
+    xhat = active_set_.Prolong(xhat_active);
+    num_unknowns = active_set_.num_active_unknowns();
+    num_observations = X.num + num_unknowns;
+  } else {
+    solved = linear_solver_.Solve(normal_equations_.n(), xhat, settings_.warm_start);
+  }
+  optimization_results.solve_time = timer.elapsed();
+  optimization_results.solver_iterations = linear_solver_.iterations();
+  optimization_results.solver_outer_iterations = linear_solver_.outer_iterations();
+  optimization_results.solver_error = linear_solver_.error();
+  if (!solved) {
     optimization_results.success = false;
     return optimization_results;
   }
   optimization_results.success = true;
 
-  // auto v{J * xhat - l};
+  Eigen::VectorXd xhat_previous(xhat.size());
+  correspondences.pc_mov().x_translation_grid().WriteAllGridValsToVector(xhat_previous);
+  correspondences.pc_mov().y_translation_grid().WriteAllGridValsToVector(xhat_previous);
+  correspondences.pc_mov().z_translation_grid().WriteAllGridValsToVector(xhat_previous);
+  optimization_results.rms_update = (xhat - xhat_previous).norm() / std::sqrt(xhat.size());
+  xhat = anderson_acceleration_.Extrapolate(xhat_previous, xhat);
+  optimization_results.anderson_num_history = anderson_acceleration_.num_history();
+  optimization_results.anderson_num_restarts = anderson_acceleration_.num_restarts();
 
   // Save estimated unknowns to translation grids
   correspondences.pc_mov().x_translation_grid().UpdateAllGridValsFromVector(xhat);
@@ -93,6 +139,10 @@ OptimizationResults Optimization::Solve(Correspondences& correspondences,
   correspondences.pc_mov().z_translation_grid().UpdateAllGridValsFromVector(xhat);
   correspondences.pc_mov().UpdateXt();
   correspondences.ComputeDists();
+  optimization_results.vTPv = correspondences.point_to_plane_dists_t().dists.squaredNorm() +
+                              weights_zero_observations[0] * xhat.squaredNorm();
+  optimization_results.memory = normal_equations_.memory() + linear_solver_.memory();
+  if (settings_.active_set) optimization_results.memory += MemoryUsage(N_active_);
 
   optimization_results.num_observations = num_observations;
   optimization_results.num_unknowns = num_unknowns;
@@ -100,36 +150,20 @@ OptimizationResults Optimization::Solve(Correspondences& correspondences,
   return optimization_results;
 }
 
-std::vector<Eigen::Triplet<double>> Optimization::SparseIdentity(const int& n) {
-  std::vector<Eigen::Triplet<double>> triplets;
-  triplets.reserve(n);
-  for (int i = 0; i < n; i++) {
-    triplets.emplace_back(i, i, 1.0);
-  }
-  return triplets;
-}
-
-std::vector<Eigen::Triplet<double>> Optimization::MultiplyWithComponentsOfNormalVectors(
-    const std::vector<Eigen::Triplet<double>>& triplets_in, const Eigen::VectorXd& n_component) {
-  std::vector<Eigen::Triplet<double>> triplets_out;
-  triplets_out.reserve(triplets_in.size());
-  for (auto const& triplet : triplets_in) {
-    int row{triplet.row()};
-    int col{triplet.col()};
-    double val{triplet.value() * n_component(triplet.row())};
-    triplets_out.emplace_back(row, col, val);
-  }
-
-  return triplets_out;
-}
-
-void Optimization::AddSubblockTriplets(const int& first_row, const int& first_col,
-                                       const std::vector<Eigen::Triplet<double>>& subblock_triplets,
-                                       std::vector<Eigen::Triplet<double>>& triplets) {
-  for (auto const& triplet : subblock_triplets) {
-    int row{first_row + triplet.row()};
-    int col{first_col + triplet.col()};
-    double val{triplet.value()};
-    triplets.emplace_back(row, col, val);
+double Optimization::SolverTolerance(const double& std_point_to_plane_dists) {
+  double tolerance{settings_.solver_tolerance};
+  if (settings_.inexact_solve) {
+    // A previous std of 0, i.e. a perfect fit, keeps the tolerance tight
+    double relative_change{0};
+    if (std::isnan(previous_std_point_to_plane_dists_)) {
+      relative_change = std::numeric_limits<double>::infinity();
+    } else if (previous_std_point_to_plane_dists_ > 0) {
+      relative_change = std::abs(std_point_to_plane_dists - previous_std_point_to_plane_dists_) /
+                        previous_std_point_to_plane_dists_;
+    }
+    tolerance = std::max(tolerance, std::min(INEXACT_SOLVE_MAX_TOLERANCE,
+                                             INEXACT_SOLVE_FORCING_FACTOR * relative_change));
   }
+  previous_std_point_to_plane_dists_ = std_point_to_plane_dists;
+  return tolerance > 0 ? tolerance : Eigen::NumTraits<double>::epsilon();
 }
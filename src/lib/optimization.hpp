@@ -2,25 +2,95 @@
 
 #include <Eigen/Sparse>
 
+#include "active_set.hpp"
+#include "anderson_acceleration.hpp"
 #include "correspondences.hpp"
+#include "linear_solver.hpp"
+#include "normal_equations.hpp"
+
+enum class Assembly {
+  // Normal equations are accumulated directly from the stencils of the correspondences
+  kDirect,
+  // Normal equations are computed from the sparse Jacobian
+  kJacobian
+};
+
+struct OptimizationSettings {
+  Assembly assembly{Assembly::kDirect};
+  // Storage of N for Assembly::kDirect. MatrixFormat::kBSR requires a solver which accepts a
+  // linear operator, see LinearSolver::AcceptsLinearOperator.
+  MatrixFormat matrix_format{MatrixFormat::kCSC};
+  // Memory budget of the cache of the stencils of the movable points in bytes (0: no cache), see
+  // StencilCache
+  size_t stencil_cache_memory{0};
+  SolverType solver_type{SolverType::kBiCGSTAB};
+  // Start the iterative solvers from the current grid values instead of zero
+  bool warm_start{false};
+  // Tolerance of the iterative solvers, see LinearSolver::SetTolerance
+  double solver_tolerance{0};
+  // Loose tolerance in early iterations which tightens as the std of the point-to-plane distances
+  // stabilizes: max(solver_tolerance, min(1e-2, 0.1 * relative change of std))
+  bool inexact_solve{false};
+  // Solve only for the unknowns of the nodes of voxels containing correspondences, see ActiveSet.
+  // num_unknowns of the results is then the number of these unknowns.
+  bool active_set{false};
+  // Tiling of the Schwarz solver, see LinearSolver::SetSchwarzTiling
+  int schwarz_tile_num_nodes{16};
+  int schwarz_overlap{1};
+  // Number of previous iterations used for the Anderson acceleration of the outer iteration
+  // (0: no acceleration), see AndersonAcceleration
+  int anderson_history_size{0};
+};
 
 struct OptimizationResults {
   bool success{};
   int num_observations{};
   int num_unknowns{};
+  int solver_iterations{};
+  // Refinement steps of the mixed precision solver, see LinearSolver::outer_iterations
+  int solver_outer_iterations{};
+  double solver_tolerance{};
+  double solver_error{};
+  // Wall times in seconds of the assembly of the normal equations, of the analysis, factorization
+  // or preconditioner setup of the linear solver and of the solve
+  double assembly_time{};
+  double compute_time{};
+  double solve_time{};
+  // Number of stored nonzeros of the normal equation matrix passed to the solver; 0 if it is not
+  // assembled
+  int64_t num_nonzeros{};
+  // Weighted sum of squared residuals v'*P*v of the correspondences and zero observations for the
+  // estimated grid values
+  double vTPv{};
+  // Memory of the normal equations and the linear solver in bytes
+  size_t memory{};
+  // Root mean square of the change of the estimated grid values, i.e. of the translations and
+  // their derivatives
+  double rms_update{};
+  // Number of previous iterations used by the Anderson acceleration in this call and number of its
+  // restarts in all calls so far, see AndersonAcceleration
+  int anderson_num_history{};
+  int anderson_num_restarts{};
 };
 
+// The normal equations and the symbolic analysis of the linear solver are kept between calls of
+// Solve, i.e. an Optimization object should be used for all iterations of a matching
 class Optimization {
  public:
-  Optimization();
-  static OptimizationResults Solve(Correspondences& correspondences,
-                                   const std::vector<double>& weights_zero_observations);
+  Optimization(const OptimizationSettings& settings = OptimizationSettings{});
+  OptimizationResults Solve(Correspondences& correspondences,
+                            const std::vector<double>& weights_zero_observations);
 
  private:
-  static std::vector<Eigen::Triplet<double>> SparseIdentity(const int& n);
-  static std::vector<Eigen::Triplet<double>> MultiplyWithComponentsOfNormalVectors(
-      const std::vector<Eigen::Triplet<double>>& triplets_in, const Eigen::VectorXd& n_component);
-  static void AddSubblockTriplets(const int& first_row, const int& first_col,
-                                  const std::vector<Eigen::Triplet<double>>& subblock_triplets,
-                                  std::vector<Eigen::Triplet<double>>& triplets);
-};
\ No newline at end of file
+  double SolverTolerance(const double& std_point_to_plane_dists);
+
+  OptimizationSettings settings_;
+  NormalEquations normal_equations_{};
+  LinearSolver linear_solver_;
+  ActiveSet active_set_{};
+  AndersonAcceleration anderson_acceleration_{};
+  // Restriction of N to the active set
+  Eigen::SparseMatrix<double> N_active_{};
+  // Std of the point-to-plane distances at the previous call of Solve
+  double previous_std_point_to_plane_dists_{NAN};
+};
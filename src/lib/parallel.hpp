@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Number of threads used for parallel loops (0: number of hardware threads)
+inline unsigned int& NumThreads() {
+  static unsigned int num_threads{0};
+  return num_threads;
+}
+
+// Number of chunks the range [first, last) is split into by ParallelFor
+inline int NumParallelChunks(const int64_t& first, const int64_t& last,
+                             const int64_t& min_chunk_size = 4096) {
+  unsigned int num_threads{NumThreads() > 0 ? NumThreads() : std::thread::hardware_concurrency()};
+  int64_t num_chunks{(last - first) / std::max(min_chunk_size, int64_t{1})};
+  return static_cast<int>(std::clamp(num_chunks, int64_t{1}, int64_t{std::max(num_threads, 1u)}));
+}
+
+// Splits the range [first, last) into NumParallelChunks contiguous chunks and calls
+// f(chunk_first, chunk_last, chunk_idx) for each chunk on its own thread. chunk_idx can be used to
+// address per-chunk accumulators. Exceptions thrown by f are rethrown in the calling thread.
+template <typename F>
+void ParallelFor(const int64_t& first, const int64_t& last, F&& f,
+                 const int64_t& min_chunk_size = 4096) {
+  if (last <= first) return;
+
+  int num_chunks{NumParallelChunks(first, last, min_chunk_size)};
+  int64_t chunk_size{(last - first + num_chunks - 1) / num_chunks};
+
+  if (num_chunks == 1) {
+    f(first, last, 0);
+    return;
+  }
+
+  std::vector<std::exception_ptr> exceptions(num_chunks);
+  std::vector<std::thread> threads;
+  threads.reserve(num_chunks - 1);
+  auto run_chunk = [&](const int& chunk_idx) {
+    int64_t chunk_first{first + chunk_idx * chunk_size};
+    int64_t chunk_last{std::min(chunk_first + chunk_size, last)};
+    try {
+      if (chunk_first < chunk_last) f(chunk_first, chunk_last, chunk_idx);
+    } catch (...) {
+      exceptions[chunk_idx] = std::current_exception();
+    }
+  };
+  for (int chunk_idx = 1; chunk_idx < num_chunks; chunk_idx++) {
+    threads.emplace_back(run_chunk, chunk_idx);
+  }
+  run_chunk(0);
+  for (auto& thread : threads) thread.join();
+
+  for (const auto& exception : exceptions) {
+    if (exception) std::rethrow_exception(exception);
+  }
+}
@@ -0,0 +1,115 @@
+#include "point_sampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+PointSampler::PointSampler(const uint32_t& num_samples, const Eigen::Index& num_cols,
+                           const double& voxel_size)
+    : num_samples_{num_samples},
+      num_cols_{num_cols},
+      voxel_size_{voxel_size},
+      capacity_{num_samples} {
+  if (voxel_size_ <= 0) reservoirs_.emplace_back();
+}
+
+void PointSampler::Add(const Eigen::MatrixXd& X) {
+  for (Eigen::Index i = 0; i < X.rows(); i++) {
+    if (voxel_size_ <= 0) {
+      AddToReservoir(reservoirs_[0], X, i);
+    } else {
+      std::array<int64_t, 3> voxel{static_cast<int64_t>(std::floor(X(i, 0) / voxel_size_)),
+                                   static_cast<int64_t>(std::floor(X(i, 1) / voxel_size_)),
+                                   static_cast<int64_t>(std::floor(X(i, 2) / voxel_size_))};
+      auto [it, is_new_voxel] =
+          reservoir_of_voxel_.try_emplace(voxel, static_cast<int>(reservoirs_.size()));
+      if (is_new_voxel) reservoirs_.emplace_back();
+      AddToReservoir(reservoirs_[it->second], X, i);
+      // Halving the capacity keeps more than num_samples points, i.e. the final allocation of the
+      // samples to the voxels is the same as without a capacity
+      while (capacity_ > 1 && num_stored_ > 2 * size_t{num_samples_}) {
+        capacity_ = (capacity_ + 1) / 2;
+        for (auto& reservoir : reservoirs_) ShrinkReservoir(reservoir, capacity_);
+      }
+    }
+    num_added_++;
+  }
+}
+
+Eigen::MatrixXd PointSampler::Samples() {
+  // Number of samples of each reservoir: all reservoirs get the same number of samples, except for
+  // those which do not have that many and a random subset which gets one more
+  std::vector<size_t> sizes(reservoirs_.size());
+  for (size_t r = 0; r < reservoirs_.size(); r++) sizes[r] = reservoirs_[r].positions.size();
+  std::vector<size_t> sorted_sizes{sizes};
+  std::sort(sorted_sizes.begin(), sorted_sizes.end());
+  size_t num_remaining{num_samples_};
+  size_t num_reservoirs_left{sorted_sizes.size()};
+  for (const auto& size : sorted_sizes) {
+    if (size > num_remaining / num_reservoirs_left) break;
+    num_remaining -= size;
+    num_reservoirs_left--;
+  }
+  if (num_reservoirs_left > 0) {
+    size_t level{num_remaining / num_reservoirs_left};
+    std::vector<size_t> larger;
+    for (size_t r = 0; r < sizes.size(); r++) {
+      if (sizes[r] > level) larger.push_back(r);
+    }
+    std::shuffle(larger.begin(), larger.end(), rng_);
+    for (size_t k = 0; k < larger.size(); k++) {
+      sizes[larger[k]] = level + (k < num_remaining % num_reservoirs_left ? 1 : 0);
+    }
+  }
+
+  // Collect the samples in the order of the stream
+  std::vector<std::pair<int64_t, const double*>> samples;
+  for (size_t r = 0; r < reservoirs_.size(); r++) {
+    ShrinkReservoir(reservoirs_[r], sizes[r]);
+    for (size_t k = 0; k < sizes[r]; k++) {
+      samples.emplace_back(reservoirs_[r].positions[k], reservoirs_[r].rows.data() + k * num_cols_);
+    }
+  }
+  std::sort(samples.begin(), samples.end());
+  Eigen::MatrixXd X(static_cast<Eigen::Index>(samples.size()), num_cols_);
+  for (size_t k = 0; k < samples.size(); k++) {
+    for (Eigen::Index c = 0; c < num_cols_; c++) X(k, c) = samples[k].second[c];
+  }
+  return X;
+}
+
+void PointSampler::AddToReservoir(Reservoir& reservoir, const Eigen::MatrixXd& X,
+                                  const Eigen::Index& i) {
+  // Algorithm R: the point replaces a random sample with probability capacity/num_added
+  size_t slot{reservoir.positions.size()};
+  if (slot >= capacity_) {
+    std::uniform_int_distribution<int64_t> distribution(0, reservoir.num_added);
+    slot = static_cast<size_t>(distribution(rng_));
+  }
+  reservoir.num_added++;
+  if (slot >= capacity_) return;
+  if (slot == reservoir.positions.size()) {
+    reservoir.positions.push_back(num_added_);
+    reservoir.rows.resize(reservoir.rows.size() + num_cols_);
+    num_stored_++;
+  }
+  reservoir.positions[slot] = num_added_;
+  for (Eigen::Index c = 0; c < num_cols_; c++) reservoir.rows[slot * num_cols_ + c] = X(i, c);
+}
+
+void PointSampler::ShrinkReservoir(Reservoir& reservoir, const size_t& num) {
+  size_t size{reservoir.positions.size()};
+  if (size <= num) return;
+  // Partial Fisher-Yates shuffle, i.e. the first num samples are a uniform sample of all samples
+  for (size_t k = 0; k < num; k++) {
+    std::uniform_int_distribution<size_t> distribution(k, size - 1);
+    size_t l{distribution(rng_)};
+    if (l == k) continue;
+    std::swap(reservoir.positions[k], reservoir.positions[l]);
+    std::swap_ranges(reservoir.rows.begin() + k * num_cols_,
+                     reservoir.rows.begin() + (k + 1) * num_cols_,
+                     reservoir.rows.begin() + l * num_cols_);
+  }
+  reservoir.positions.resize(num);
+  reservoir.rows.resize(num * num_cols_);
+  num_stored_ -= size - num;
+}
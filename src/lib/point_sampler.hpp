@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <vector>
+
+// Samples a fixed number of points from a stream of points in a single pass, i.e. only the sampled
+// points are kept in memory.
+// Without a voxel size, the points are sampled by reservoir sampling, i.e. each point of the
+// stream is sampled with the same probability. With a voxel size, the points are stratified by the
+// voxels of a grid with this edge length, i.e. the samples are distributed as evenly as possible
+// over all occupied voxels and the points of each voxel are sampled with the same probability. The
+// memory is then O(num_samples + number of occupied voxels).
+class PointSampler {
+ public:
+  PointSampler(const uint32_t& num_samples, const Eigen::Index& num_cols,
+               const double& voxel_size = 0);
+
+  // Adds the rows of X, whose first three columns are x, y and z
+  void Add(const Eigen::MatrixXd& X);
+
+  // Sampled rows in the order in which they were added
+  Eigen::MatrixXd Samples();
+
+ private:
+  // Uniform sample of the points of a stratum
+  struct Reservoir {
+    // Number of points of the stratum added so far
+    int64_t num_added{0};
+    // Sampled rows and their positions in the stream
+    std::vector<double> rows{};
+    std::vector<int64_t> positions{};
+  };
+
+  void AddToReservoir(Reservoir& reservoir, const Eigen::MatrixXd& X, const Eigen::Index& i);
+  // Reduces the sample of a reservoir to a uniform sample of num points
+  void ShrinkReservoir(Reservoir& reservoir, const size_t& num);
+
+  uint32_t num_samples_;
+  Eigen::Index num_cols_;
+  double voxel_size_;
+  int64_t num_added_{0};
+  // Maximum number of points per reservoir; with a voxel size it is halved whenever all reservoirs
+  // together hold more than twice num_samples points
+  size_t capacity_;
+  size_t num_stored_{0};
+  std::vector<Reservoir> reservoirs_{};
+  std::map<std::array<int64_t, 3>, int> reservoir_of_voxel_{};
+  std::default_random_engine rng_{};
+};
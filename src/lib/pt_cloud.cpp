@@ -1,7 +1,226 @@
 #include "pt_cloud.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <memory>
+#include <unordered_set>
+
+#include "mapped_file.hpp"
+
+namespace {
+
+// Alignment of the tiles in tiled transform files in bytes
+const uint64_t TILE_ALIGNMENT{4096};
+
+// Grid values of the nodes of a box of voxels, VALS_PER_NODE per node in the order of
+// TranslationGrid::NodeIdx within the box
+struct GridValsBox {
+  int first_voxel[3]{};
+  int num_voxels[3]{};
+  std::shared_ptr<std::vector<double>> grid_vals{};
+};
+
+uint64_t AlignToTiles(const uint64_t& offset) {
+  return (offset + TILE_ALIGNMENT - 1) / TILE_ALIGNMENT * TILE_ALIGNMENT;
+}
+
+// Size of the data of a tile with num_nodes nodes in bytes
+uint64_t TileSize(const uint64_t& num_nodes, const GridValsQuantization& quantization) {
+  if (quantization == GridValsQuantization::kInt16) {
+    return VALS_PER_NODE * (sizeof(double) + num_nodes * sizeof(int16_t));
+  }
+  return num_nodes * VALS_PER_NODE * sizeof(double);
+}
+
+// Number of tiles per axis
+void GetNumTiles(const HeaderInfoV2& header_info_v2, const HeaderInfoTiles& header_info_tiles,
+                 int (&num_tiles)[3]) {
+  const int& tile_num_voxels{header_info_tiles.tile_num_voxels};
+  for (int i = 0; i < 3; i++) {
+    num_tiles[i] = (header_info_v2.num_voxels[i] + tile_num_voxels - 1) / tile_num_voxels;
+  }
+}
+
+// First node and number of nodes per axis of a tile
+void GetTileNodes(const int (&tile_idx)[3], const HeaderInfoV2& header_info_v2,
+                  const HeaderInfoTiles& header_info_tiles, int (&first_node)[3],
+                  int (&num_nodes)[3]) {
+  const int& tile_num_voxels{header_info_tiles.tile_num_voxels};
+  for (int i = 0; i < 3; i++) {
+    first_node[i] = tile_idx[i] * tile_num_voxels;
+    num_nodes[i] = std::min(tile_num_voxels, header_info_v2.num_voxels[i] - first_node[i]) + 1;
+  }
+}
+
+// Writes the tile index and the tiles of a tiled transform file and returns the maximum
+// quantization error
+double WriteTiles(const TranslationGrid* const (&translation_grids)[3],
+                  const HeaderInfoV2& header_info_v2, const HeaderInfoTiles& header_info_tiles,
+                  std::ofstream& file) {
+  auto quantization{static_cast<GridValsQuantization>(header_info_tiles.quantization)};
+  int num_tiles[3]{};
+  GetNumTiles(header_info_v2, header_info_tiles, num_tiles);
+  std::vector<TileIndexEntry> tile_index(static_cast<size_t>(num_tiles[0]) * num_tiles[1] *
+                                         num_tiles[2]);
+  uint64_t offset{header_info_v2.data_offset};
+  auto write_padding = [&](const uint64_t& new_offset) {
+    std::vector<char> padding(new_offset - offset, 0);
+    file.write(padding.data(), padding.size());
+    offset = new_offset;
+  };
+  write_padding(offset + tile_index.size() * sizeof(TileIndexEntry));  // written below
+
+  std::vector<double> tile_vals{};
+  std::vector<int16_t> tile_int16_vals{};
+  double max_quantization_error{0};
+  size_t tile{0};
+  int tile_idx[3]{};
+  for (tile_idx[0] = 0; tile_idx[0] < num_tiles[0]; tile_idx[0]++) {
+    for (tile_idx[1] = 0; tile_idx[1] < num_tiles[1]; tile_idx[1]++) {
+      for (tile_idx[2] = 0; tile_idx[2] < num_tiles[2]; tile_idx[2]++, tile++) {
+        // Collect the grid values of the nodes of the tile
+        int first_node[3]{}, num_nodes[3]{};
+        GetTileNodes(tile_idx, header_info_v2, header_info_tiles, first_node, num_nodes);
+        uint64_t tile_num_nodes{static_cast<uint64_t>(num_nodes[0]) * num_nodes[1] * num_nodes[2]};
+        tile_vals.resize(tile_num_nodes * VALS_PER_NODE);
+        double* vals{tile_vals.data()};
+        for (int x = first_node[0]; x < first_node[0] + num_nodes[0]; x++) {
+          for (int y = first_node[1]; y < first_node[1] + num_nodes[1]; y++) {
+            for (int z = first_node[2]; z < first_node[2] + num_nodes[2]; z++) {
+              int node_idx{translation_grids[0]->NodeIdx(x, y, z)};
+              for (const auto* translation_grid : translation_grids) {
+                const double* node_grid_vals{translation_grid->NodeGridVals(node_idx)};
+                vals = std::copy(node_grid_vals, node_grid_vals + 8, vals);
+              }
+            }
+          }
+        }
+
+        // Write the tile page-aligned
+        write_padding(AlignToTiles(offset));
+        tile_index[tile] = {offset, TileSize(tile_num_nodes, quantization)};
+        if (quantization == GridValsQuantization::kNone) {
+          file.write(reinterpret_cast<const char*>(tile_vals.data()),
+                     tile_vals.size() * sizeof(double));
+        } else {
+          double scales[VALS_PER_NODE]{};
+          for (size_t k = 0; k < tile_vals.size(); k++) {
+            scales[k % VALS_PER_NODE] = std::max(scales[k % VALS_PER_NODE], std::abs(tile_vals[k]));
+          }
+          for (double& scale : scales) scale /= std::numeric_limits<int16_t>::max();
+          tile_int16_vals.resize(tile_vals.size());
+          for (size_t k = 0; k < tile_vals.size(); k++) {
+            const double& scale{scales[k % VALS_PER_NODE]};
+            tile_int16_vals[k] = scale > 0 ? static_cast<int16_t>(std::lround(tile_vals[k] / scale))
+                                           : int16_t{0};
+            double quantization_error{std::abs(tile_vals[k] - tile_int16_vals[k] * scale)};
+            max_quantization_error = std::max(max_quantization_error, quantization_error);
+          }
+          file.write(reinterpret_cast<const char*>(scales), sizeof(scales));
+          file.write(reinterpret_cast<const char*>(tile_int16_vals.data()),
+                     tile_int16_vals.size() * sizeof(int16_t));
+        }
+        offset += tile_index[tile].size;
+      }
+    }
+  }
+
+  file.seekp(header_info_v2.data_offset);
+  file.write(reinterpret_cast<const char*>(tile_index.data()),
+             tile_index.size() * sizeof(TileIndexEntry));
+  return max_quantization_error;
+}
+
+// Reads the tiles of a tiled transform file which contain the voxels first_voxel to last_voxel
+GridValsBox ReadTiles(const MappedFile& file, const std::string& filepath,
+                      const HeaderInfoV2& header_info_v2, const HeaderInfoTiles& header_info_tiles,
+                      const int (&first_voxel)[3], const int (&last_voxel)[3]) {
+  auto quantization{static_cast<GridValsQuantization>(header_info_tiles.quantization)};
+  const int& tile_num_voxels{header_info_tiles.tile_num_voxels};
+  int num_tiles[3]{};
+  if (tile_num_voxels > 0) GetNumTiles(header_info_v2, header_info_tiles, num_tiles);
+  uint64_t num_tiles_total{static_cast<uint64_t>(num_tiles[0]) * num_tiles[1] * num_tiles[2]};
+  if (tile_num_voxels <= 0 || header_info_v2.num_vals_per_node != VALS_PER_NODE ||
+      (quantization != GridValsQuantization::kNone &&
+       quantization != GridValsQuantization::kInt16) ||
+      header_info_v2.data_offset + num_tiles_total * sizeof(TileIndexEntry) > file.size()) {
+    std::cerr << "Error importing \"" << filepath << "\"!" << std::endl;
+    std::cerr << "Tile index does not match the grid size of the header!" << std::endl;
+    exit(1);
+  }
+
+  // Box of the voxels of the tiles
+  GridValsBox box;
+  int first_tile[3]{}, last_tile[3]{};
+  for (int i = 0; i < 3; i++) {
+    first_tile[i] = first_voxel[i] / tile_num_voxels;
+    last_tile[i] = last_voxel[i] / tile_num_voxels;
+    box.first_voxel[i] = first_tile[i] * tile_num_voxels;
+    box.num_voxels[i] = std::min((last_tile[i] + 1) * tile_num_voxels,
+                                 header_info_v2.num_voxels[i]) -
+                        box.first_voxel[i];
+  }
+  box.grid_vals = std::make_shared<std::vector<double>>(static_cast<size_t>(box.num_voxels[0] + 1) *
+                                                        (box.num_voxels[1] + 1) *
+                                                        (box.num_voxels[2] + 1) * VALS_PER_NODE);
+
+  int tile_idx[3]{};
+  for (tile_idx[0] = first_tile[0]; tile_idx[0] <= last_tile[0]; tile_idx[0]++) {
+    for (tile_idx[1] = first_tile[1]; tile_idx[1] <= last_tile[1]; tile_idx[1]++) {
+      for (tile_idx[2] = first_tile[2]; tile_idx[2] <= last_tile[2]; tile_idx[2]++) {
+        uint64_t tile{(static_cast<uint64_t>(tile_idx[0]) * num_tiles[1] + tile_idx[1]) *
+                          num_tiles[2] +
+                      tile_idx[2]};
+        TileIndexEntry tile_index_entry;
+        std::memcpy(&tile_index_entry,
+                    file.data() + header_info_v2.data_offset + tile * sizeof(TileIndexEntry),
+                    sizeof(TileIndexEntry));
+        int first_node[3]{}, num_nodes[3]{};
+        GetTileNodes(tile_idx, header_info_v2, header_info_tiles, first_node, num_nodes);
+        uint64_t tile_num_nodes{static_cast<uint64_t>(num_nodes[0]) * num_nodes[1] * num_nodes[2]};
+        if (tile_index_entry.size != TileSize(tile_num_nodes, quantization) ||
+            tile_index_entry.offset % sizeof(double) != 0 ||
+            tile_index_entry.offset + tile_index_entry.size > file.size()) {
+          std::cerr << "Error importing \"" << filepath << "\"!" << std::endl;
+          std::cerr << "Tile " << tile << " does not match the grid size of the header!"
+                    << std::endl;
+          exit(1);
+        }
+
+        // Copy the grid values of the nodes of the tile to the box
+        const auto* vals{reinterpret_cast<const double*>(file.data() + tile_index_entry.offset)};
+        const auto* int16_vals{reinterpret_cast<const int16_t*>(vals + VALS_PER_NODE)};
+        for (int x = first_node[0]; x < first_node[0] + num_nodes[0]; x++) {
+          for (int y = first_node[1]; y < first_node[1] + num_nodes[1]; y++) {
+            for (int z = first_node[2]; z < first_node[2] + num_nodes[2]; z++) {
+              size_t box_node_idx{(static_cast<size_t>(x - box.first_voxel[0]) *
+                                       (box.num_voxels[1] + 1) +
+                                   (y - box.first_voxel[1])) *
+                                      (box.num_voxels[2] + 1) +
+                                  (z - box.first_voxel[2])};
+              double* box_vals{box.grid_vals->data() + box_node_idx * VALS_PER_NODE};
+              if (quantization == GridValsQuantization::kNone) {
+                std::copy(vals, vals + VALS_PER_NODE, box_vals);
+                vals += VALS_PER_NODE;
+              } else {
+                // vals holds the scales
+                for (int k = 0; k < VALS_PER_NODE; k++) box_vals[k] = int16_vals[k] * vals[k];
+                int16_vals += VALS_PER_NODE;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+  return box;
+}
+
+}  // namespace
 
 PtCloud::PtCloud(Eigen::MatrixXd X) : X_{X} {}
 
@@ -17,8 +236,9 @@ void PtCloud::SetCorrespondenceId(Eigen::VectorXd correspondence_id) {
 
 long PtCloud::NumPts() { return X_.rows(); }
 
-void PtCloud::InitializeTranslationGrids(const double& voxel_size, const uint32_t& buffer_voxels,
-                                         const std::vector<double>& grid_limits) {
+std::vector<double> PtCloud::GridLimitsWithBuffer(const double& voxel_size,
+                                                  const uint32_t& buffer_voxels,
+                                                  const std::vector<double>& grid_limits) {
   // Check if grid_limits elements are all zero
   bool grid_limits_are_not_set =
       std::all_of(grid_limits.begin(), grid_limits.end(), [](int i) { return i == 0; });
@@ -50,6 +270,14 @@ void PtCloud::InitializeTranslationGrids(const double& voxel_size, const uint32_
     grid_limits_with_buffer[5] = grid_limits[5] + buffer_voxels * voxel_size;
   }
 
+  return grid_limits_with_buffer;
+}
+
+void PtCloud::InitializeTranslationGrids(const double& voxel_size, const uint32_t& buffer_voxels,
+                                         const std::vector<double>& grid_limits) {
+  std::vector<double> grid_limits_with_buffer{
+      GridLimitsWithBuffer(voxel_size, buffer_voxels, grid_limits)};
+
   // ToDo Conversion double to int
   int x_num_voxels = (grid_limits_with_buffer[3] - grid_limits_with_buffer[0]) / voxel_size;
   int y_num_voxels = (grid_limits_with_buffer[4] - grid_limits_with_buffer[1]) / voxel_size;
@@ -73,11 +301,14 @@ void PtCloud::InitializeTranslationGrids(const double& voxel_size, const uint32_
   Xt_ = X_;
 }
 
-void PtCloud::ExportTranslationGrids(const std::string& filepath) {
-  auto write_value = [](std::ofstream& file, const auto& value) {
-    file.write(reinterpret_cast<const char*>(&value), sizeof(value));
-  };
+GridValsQuantization GridValsQuantizationFromString(const std::string& quantization) {
+  if (quantization == "none") return GridValsQuantization::kNone;
+  if (quantization == "int16") return GridValsQuantization::kInt16;
+  throw std::runtime_error("Quantization \"" + quantization + "\" is not available!");
+}
 
+void PtCloud::ExportTranslationGrids(const std::string& filepath,
+                                     const TransformFileLayout& layout) {
   // Open file
   std::ofstream file{filepath, std::ios::out | std::ios::binary};
   if (!file.is_open()) {
@@ -85,53 +316,57 @@ void PtCloud::ExportTranslationGrids(const std::string& filepath) {
     exit(1);
   }
 
-  // Write header
+  // Header
+  bool tiled{layout.tile_num_voxels > 0};
   HeaderInfo header_info;
-  write_value(file, header_info.identifier);
-  write_value(file, header_info.fileversion);
-  write_value(file, x_translation_grid_.grid_origin()(0));
-  write_value(file, x_translation_grid_.grid_origin()(1));
-  write_value(file, x_translation_grid_.grid_origin()(2));
-  write_value(file, x_translation_grid_.x_num_voxels());
-  write_value(file, x_translation_grid_.y_num_voxels());
-  write_value(file, x_translation_grid_.z_num_voxels());
-  write_value(file, x_translation_grid_.voxel_size());
-  file.seekp(header_info.length);
+  if (tiled) header_info.fileversion = TILED_FILEVERSION;
+  HeaderInfoV2 header_info_v2;
+  for (int i = 0; i < 3; i++) header_info_v2.grid_origin[i] = x_translation_grid_.grid_origin()(i);
+  header_info_v2.num_voxels[0] = x_translation_grid_.x_num_voxels();
+  header_info_v2.num_voxels[1] = x_translation_grid_.y_num_voxels();
+  header_info_v2.num_voxels[2] = x_translation_grid_.z_num_voxels();
+  header_info_v2.voxel_size = x_translation_grid_.voxel_size();
+  HeaderInfoTiles header_info_tiles{layout.tile_num_voxels,
+                                    static_cast<int32_t>(layout.quantization)};
+  std::vector<char> header(header_info_v2.data_offset, 0);
+  file.write(header.data(), header.size());  // written below
 
   // Write data
-  for (int x_voxel_idx = 0; x_voxel_idx < x_translation_grid_.x_num_voxels() + 1; x_voxel_idx++)
-    for (int y_voxel_idx = 0; y_voxel_idx < x_translation_grid_.y_num_voxels() + 1; y_voxel_idx++)
-      for (int z_voxel_idx = 0; z_voxel_idx < x_translation_grid_.z_num_voxels() + 1;
-           z_voxel_idx++) {
-        // clang-format off
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].f);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz);
-        write_value(file, x_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz);
-
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].f);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz);
-        write_value(file, y_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz);
-
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].f);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz);
-        write_value(file, z_translation_grid_.grid_vals()[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz);
-        // clang-format on
+  const TranslationGrid* translation_grids[3]{&x_translation_grid_, &y_translation_grid_,
+                                              &z_translation_grid_};
+  if (tiled) {
+    header_info_tiles.max_quantization_error =
+        WriteTiles(translation_grids, header_info_v2, header_info_tiles, file);
+  } else {
+    // Blocks of nodes
+    int num_nodes{x_translation_grid_.num_grid_vals() / 8};
+    const int block_num_nodes{1 << 16};
+    std::vector<double> block(static_cast<size_t>(block_num_nodes) * VALS_PER_NODE);
+    for (int first_node_idx = 0; first_node_idx < num_nodes; first_node_idx += block_num_nodes) {
+      int block_end{std::min(first_node_idx + block_num_nodes, num_nodes)};
+      double* block_vals{block.data()};
+      for (int node_idx = first_node_idx; node_idx < block_end; node_idx++) {
+        for (const auto* translation_grid : translation_grids) {
+          const double* node_grid_vals{translation_grid->NodeGridVals(node_idx)};
+          block_vals = std::copy(node_grid_vals, node_grid_vals + 8, block_vals);
+        }
       }
+      file.write(reinterpret_cast<const char*>(block.data()),
+                 (block_vals - block.data()) * sizeof(double));
+    }
+  }
+
+  // Write header
+  std::memcpy(header.data(), header_info.identifier, sizeof(header_info.identifier));
+  std::memcpy(header.data() + sizeof(header_info.identifier), &header_info.fileversion,
+              sizeof(header_info.fileversion));
+  std::memcpy(header.data() + header_info.length, &header_info_v2, sizeof(header_info_v2));
+  if (tiled) {
+    std::memcpy(header.data() + header_info.length + sizeof(header_info_v2), &header_info_tiles,
+                sizeof(header_info_tiles));
+  }
+  file.seekp(0);
+  file.write(header.data(), header.size());
 
   // Final check and close file
   if (!file.good()) {
@@ -141,130 +376,205 @@ void PtCloud::ExportTranslationGrids(const std::string& filepath) {
   file.close();
 }
 
-void PtCloud::ImportTranslationGrids(const std::string& filepath) {
-  auto read_value = [](std::ifstream& file, auto& var) {
-    file.read(reinterpret_cast<char*>(&var), sizeof(var));
-  };
+void PtCloud::ImportTranslationGrids(const std::string& filepath, const bool& only_tiles_of_pts) {
+  ImportTranslationGrids(std::make_shared<const MappedFile>(filepath), filepath, only_tiles_of_pts);
+}
 
-  // Open file
-  std::ifstream file{filepath, std::ios::in | std::ios::binary};
-  if (!file.is_open()) {
-    std::cerr << "Cannot open file \"" << filepath << "\"!" << std::endl;
-    exit(1);
-  }
+void PtCloud::ImportTranslationGrids(const std::shared_ptr<const MappedFile>& file,
+                                     const std::string& filepath, const bool& only_tiles_of_pts) {
+  // The grids of untiled files are evaluated directly on the mapped grid values, which are shared
+  // by the grids
+  auto read_value = [&](const size_t& offset, auto& var) {
+    if (offset + sizeof(var) > file->size()) {
+      std::cerr << "File \"" << filepath << "\" is truncated!" << std::endl;
+      exit(1);
+    }
+    std::memcpy(&var, file->data() + offset, sizeof(var));
+  };
 
   // Read header
   HeaderInfo header_info;
-  Eigen::RowVector3d grid_origin(3);
-  int x_num_voxels{};
-  int y_num_voxels{};
-  int z_num_voxels{};
-  double voxel_size{};
-  read_value(file, header_info.identifier);
-  if (strcmp(header_info.identifier, "nricp") != 0) {  // check identifier
+  char identifier[sizeof(header_info.identifier)]{};
+  int fileversion{};
+  read_value(0, identifier);
+  identifier[sizeof(identifier) - 1] = '\0';
+  if (strcmp(identifier, header_info.identifier) != 0) {  // check identifier
     std::cerr << "Header of \"" << filepath << "\" does not start with char \"nricp\"!"
               << std::endl;
     exit(1);
   }
-  int current_fileversion{header_info.fileversion};  // save file version for check
-  read_value(file, header_info.fileversion);
-  if (header_info.fileversion != current_fileversion) {  // check file version
-    std::cerr << "File version of \"" << filepath << "\" is \"" << header_info.fileversion
-              << "\", but should be \"" << current_fileversion << "\"!" << std::endl;
+  read_value(sizeof(identifier), fileversion);
+  HeaderInfoV2 header_info_v2;
+  HeaderInfoTiles header_info_tiles;
+  if (fileversion == 1) {
+    // Unaligned header fields following the file version
+    size_t offset{sizeof(identifier) + sizeof(fileversion)};
+    for (int i = 0; i < 3; i++) {
+      read_value(offset, header_info_v2.grid_origin[i]);
+      offset += sizeof(double);
+    }
+    for (int i = 0; i < 3; i++) {
+      read_value(offset, header_info_v2.num_voxels[i]);
+      offset += sizeof(int);
+    }
+    read_value(offset, header_info_v2.voxel_size);
+    header_info_v2.data_offset = header_info.length;
+  } else if (fileversion == header_info.fileversion) {
+    read_value(header_info.length, header_info_v2);
+  } else if (fileversion == TILED_FILEVERSION) {
+    read_value(header_info.length, header_info_v2);
+    read_value(header_info.length + sizeof(header_info_v2), header_info_tiles);
+  } else {  // check file version
+    std::cerr << "File version of \"" << filepath << "\" is \"" << fileversion
+              << "\", but should be \"1\", \"" << header_info.fileversion << "\" or \""
+              << TILED_FILEVERSION << "\"!" << std::endl;
     exit(1);
   }
-  read_value(file, grid_origin(0));
-  read_value(file, grid_origin(1));
-  read_value(file, grid_origin(2));
-  read_value(file, x_num_voxels);
-  read_value(file, y_num_voxels);
-  read_value(file, z_num_voxels);
-  read_value(file, voxel_size);
-  file.seekg(header_info.length);
-
-  // Verify header
-  HeaderInfo header_info_for_verification;
-  if (strcmp(header_info.identifier, header_info_for_verification.identifier) != 0) {
-    std::cerr << "Error importing \"" << filepath << "\"!" << std::endl;
-    std::cerr << "Header identifier is \"" << header_info.identifier << "\" but must be \""
-              << header_info_for_verification.identifier << "\"!" << std::endl;
-  }
-  if (header_info.fileversion != header_info_for_verification.fileversion) {
-    std::cerr << "Error importing \"" << filepath << "\"!" << std::endl;
-    std::cerr << "Header fileversion is \"" << header_info.fileversion << "\" but must be \""
-              << header_info_for_verification.fileversion << "\"!" << std::endl;
-  }
 
-  // Initialize grids
-  // ToDo Make first_idx_adj an optional argument
-  x_translation_grid_.Initialize(grid_origin, x_num_voxels, y_num_voxels, z_num_voxels, voxel_size,
-                                 0);
-  y_translation_grid_.Initialize(grid_origin, x_num_voxels, y_num_voxels, z_num_voxels, voxel_size,
-                                 0);
-  z_translation_grid_.Initialize(grid_origin, x_num_voxels, y_num_voxels, z_num_voxels, voxel_size,
-                                 0);
-
-  GridVals grid_vals_new{};
-
-  for (int x_voxel_idx = 0; x_voxel_idx < x_num_voxels + 1; x_voxel_idx++)
-    for (int y_voxel_idx = 0; y_voxel_idx < y_num_voxels + 1; y_voxel_idx++)
-      for (int z_voxel_idx = 0; z_voxel_idx < z_num_voxels + 1; z_voxel_idx++) {
-        read_value(file, grid_vals_new.f);
-        read_value(file, grid_vals_new.fx);
-        read_value(file, grid_vals_new.fy);
-        read_value(file, grid_vals_new.fz);
-        read_value(file, grid_vals_new.fxy);
-        read_value(file, grid_vals_new.fxz);
-        read_value(file, grid_vals_new.fyz);
-        read_value(file, grid_vals_new.fxyz);
-        x_translation_grid().UpdateVoxelGridVals(x_voxel_idx, y_voxel_idx, z_voxel_idx,
-                                                 grid_vals_new);
-
-        read_value(file, grid_vals_new.f);
-        read_value(file, grid_vals_new.fx);
-        read_value(file, grid_vals_new.fy);
-        read_value(file, grid_vals_new.fz);
-        read_value(file, grid_vals_new.fxy);
-        read_value(file, grid_vals_new.fxz);
-        read_value(file, grid_vals_new.fyz);
-        read_value(file, grid_vals_new.fxyz);
-        y_translation_grid().UpdateVoxelGridVals(x_voxel_idx, y_voxel_idx, z_voxel_idx,
-                                                 grid_vals_new);
-
-        read_value(file, grid_vals_new.f);
-        read_value(file, grid_vals_new.fx);
-        read_value(file, grid_vals_new.fy);
-        read_value(file, grid_vals_new.fz);
-        read_value(file, grid_vals_new.fxy);
-        read_value(file, grid_vals_new.fxz);
-        read_value(file, grid_vals_new.fyz);
-        read_value(file, grid_vals_new.fxyz);
-        z_translation_grid().UpdateVoxelGridVals(x_voxel_idx, y_voxel_idx, z_voxel_idx,
-                                                 grid_vals_new);
+  Eigen::RowVector3d grid_origin{header_info_v2.grid_origin[0], header_info_v2.grid_origin[1],
+                                 header_info_v2.grid_origin[2]};
+  auto initialize_grids = [&](const Eigen::RowVector3d& origin, const int32_t* num_voxels,
+                              std::shared_ptr<const void> owner, const double* grid_vals) {
+    // ToDo Make first_idx_adj an optional argument
+    x_translation_grid_.Initialize(origin, num_voxels[0], num_voxels[1], num_voxels[2],
+                                   header_info_v2.voxel_size, 0, owner, grid_vals, VALS_PER_NODE);
+    y_translation_grid_.Initialize(origin, num_voxels[0], num_voxels[1], num_voxels[2],
+                                   header_info_v2.voxel_size, 0, owner, grid_vals + 8,
+                                   VALS_PER_NODE);
+    z_translation_grid_.Initialize(origin, num_voxels[0], num_voxels[1], num_voxels[2],
+                                   header_info_v2.voxel_size, 0, owner, grid_vals + 16,
+                                   VALS_PER_NODE);
+  };
+
+  if (fileversion == TILED_FILEVERSION) {
+    // Voxels of the bounding box of the points; all voxels if a point is outside of the grid, so
+    // that the error message of the grids refers to the whole transformation domain
+    int first_voxel[3]{0, 0, 0};
+    int last_voxel[3]{header_info_v2.num_voxels[0] - 1, header_info_v2.num_voxels[1] - 1,
+                      header_info_v2.num_voxels[2] - 1};
+    if (only_tiles_of_pts && NumPts() > 0) {
+      double coord_min[3]{x_min(), y_min(), z_min()};
+      double coord_max[3]{x_max(), y_max(), z_max()};
+      int pts_first_voxel[3]{}, pts_last_voxel[3]{};
+      bool pts_are_inside{true};
+      for (int i = 0; i < 3; i++) {
+        pts_first_voxel[i] = static_cast<int>(
+            floor((coord_min[i] - header_info_v2.grid_origin[i]) / header_info_v2.voxel_size));
+        pts_last_voxel[i] = static_cast<int>(
+            floor((coord_max[i] - header_info_v2.grid_origin[i]) / header_info_v2.voxel_size));
+        pts_are_inside &= pts_first_voxel[i] >= 0 && pts_last_voxel[i] <= last_voxel[i];
       }
+      // Padded by one voxel, as the voxels of the points are computed again relative to the origin
+      // of the loaded box, which can round a point on a voxel boundary into the neighbouring voxel
+      if (pts_are_inside) {
+        for (int i = 0; i < 3; i++) {
+          first_voxel[i] = std::max(pts_first_voxel[i] - 1, 0);
+          last_voxel[i] = std::min(pts_last_voxel[i] + 1, last_voxel[i]);
+        }
+      }
+    }
+
+    // Load the tiles which contain these voxels into grids covering them
+    GridValsBox box{
+        ReadTiles(*file, filepath, header_info_v2, header_info_tiles, first_voxel, last_voxel)};
+    for (int i = 0; i < 3; i++) grid_origin(i) += box.first_voxel[i] * header_info_v2.voxel_size;
+    initialize_grids(grid_origin, box.num_voxels, box.grid_vals, box.grid_vals->data());
+    return;
+  }
 
-  // Final check and close file
-  if (!file.good()) {
-    std::cerr << "Error occurred reading file \"" << filepath << "\"!" << std::endl;
+  // Verify data block
+  uint64_t num_nodes{static_cast<uint64_t>(header_info_v2.num_voxels[0] + 1) *
+                     (header_info_v2.num_voxels[1] + 1) * (header_info_v2.num_voxels[2] + 1)};
+  if (header_info_v2.num_vals_per_node != VALS_PER_NODE ||
+      header_info_v2.data_offset % sizeof(double) != 0 ||
+      header_info_v2.data_offset + num_nodes * VALS_PER_NODE * sizeof(double) > file->size()) {
+    std::cerr << "Error importing \"" << filepath << "\"!" << std::endl;
+    std::cerr << "Grid values do not match the grid size of the header!" << std::endl;
     exit(1);
   }
-  file.close();
+
+  // Initialize grids on the mapped grid values
+  const auto* grid_vals{reinterpret_cast<const double*>(file->data() + header_info_v2.data_offset)};
+  initialize_grids(grid_origin, header_info_v2.num_voxels, file, grid_vals);
 }
 
 void PtCloud::InitMatricesForUpdateXt() {
-  auto [X_voxel_idx, Xn_voxel]{x_translation_grid_.GetGridReference(X_)};
+  if (HasRegionOfInterest()) {
+    X_roi_ = X_(idx_roi_, Eigen::all);
+  } else {
+    X_roi_ = X_;
+  }
+  auto [X_voxel_idx, Xn_voxel]{x_translation_grid_.GetGridReference(X_roi_)};
   X_voxel_idx_ = X_voxel_idx;
   Xn_voxel_ = Xn_voxel;
   X_power_ = TranslationGrid::Compute_X_power(Xn_voxel);
 }
 
 void PtCloud::UpdateXt() {
-  auto tx{x_translation_grid_.p(X_, X_power_, X_voxel_idx_)};
-  auto ty{y_translation_grid_.p(X_, X_power_, X_voxel_idx_)};
-  auto tz{z_translation_grid_.p(X_, X_power_, X_voxel_idx_)};
+  auto tx{x_translation_grid_.p(X_roi_, X_power_, X_voxel_idx_)};
+  auto ty{y_translation_grid_.p(X_roi_, X_power_, X_voxel_idx_)};
+  auto tz{z_translation_grid_.p(X_roi_, X_power_, X_voxel_idx_)};
+
+  if (HasRegionOfInterest()) {
+    for (size_t i = 0; i < idx_roi_.size(); i++) {
+      Xt_(idx_roi_[i], 0) = X_roi_(i, 0) + tx(i);
+      Xt_(idx_roi_[i], 1) = X_roi_(i, 1) + ty(i);
+      Xt_(idx_roi_[i], 2) = X_roi_(i, 2) + tz(i);
+    }
+  } else {
+    Xt_ = Eigen::MatrixX3d(NumPts(), 3);
+    Xt_ << X_.col(0) + tx, X_.col(1) + ty, X_.col(2) + tz;
+  }
+}
+
+void PtCloud::SetRegionOfInterest(const std::vector<int>& idx_roi) {
+  if (idx_roi.empty()) {
+    throw std::runtime_error("Region of interest does not contain any points!");
+  }
+  idx_roi_ = idx_roi;
+}
+
+std::vector<int> PtCloud::IdxPtsNearPts(const Eigen::MatrixXd& X_query,
+                                        const double& max_distance) {
+  // Voxels with edge length >= max_distance, i.e. all points within max_distance of a query point
+  // are in the voxel of the query point or in one of its 26 neighbors
+  const int64_t max_voxels_per_axis{1 << 20};
+  Eigen::RowVector3d X_min{x_min(), y_min(), z_min()};
+  Eigen::RowVector3d X_max{x_max(), y_max(), z_max()};
+  double extent{(X_max - X_min).maxCoeff()};
+  double voxel_size{std::max(max_distance, extent / (max_voxels_per_axis - 4))};
+  if (voxel_size <= 0) voxel_size = 1;
+
+  // Voxel indices are shifted by 2 so that all points and their neighbors have positive indices
+  auto voxel_idx = [&](const double& coord, const int& dim) -> int64_t {
+    auto idx{static_cast<int64_t>(floor((coord - X_min(dim)) / voxel_size)) + 2};
+    return std::clamp(idx, int64_t{0}, max_voxels_per_axis - 1);
+  };
+  auto voxel_key = [&](const int64_t& x_idx, const int64_t& y_idx, const int64_t& z_idx) {
+    return (x_idx * max_voxels_per_axis + y_idx) * max_voxels_per_axis + z_idx;
+  };
 
-  Xt_ = Eigen::MatrixX3d(NumPts(), 3);
-  Xt_ << X_.col(0) + tx, X_.col(1) + ty, X_.col(2) + tz;
+  // Dilated mask of voxels with query points
+  std::unordered_set<int64_t> voxel_mask;
+  for (Eigen::Index i = 0; i < X_query.rows(); i++) {
+    int64_t x_idx{voxel_idx(X_query(i, 0), 0)};
+    int64_t y_idx{voxel_idx(X_query(i, 1), 1)};
+    int64_t z_idx{voxel_idx(X_query(i, 2), 2)};
+    for (int dx = -1; dx <= 1; dx++)
+      for (int dy = -1; dy <= 1; dy++)
+        for (int dz = -1; dz <= 1; dz++) {
+          voxel_mask.insert(voxel_key(x_idx + dx, y_idx + dy, z_idx + dz));
+        }
+  }
+
+  std::vector<int> idx_pts;
+  for (int i = 0; i < NumPts(); i++) {
+    if (voxel_mask.count(voxel_key(voxel_idx(X_(i, 0), 0), voxel_idx(X_(i, 1), 1),
+                                   voxel_idx(X_(i, 2), 2))) > 0) {
+      idx_pts.push_back(i);
+    }
+  }
+  return idx_pts;
 }
 
 const Eigen::MatrixXd& PtCloud::X() { return X_; }
@@ -273,6 +583,8 @@ const Eigen::VectorXd& PtCloud::nx() { return nx_; }
 const Eigen::VectorXd& PtCloud::ny() { return ny_; }
 const Eigen::VectorXd& PtCloud::nz() { return nz_; }
 const Eigen::VectorXd& PtCloud::correspondence_id() { return correspondence_id_; }
+const std::vector<int>& PtCloud::idx_roi() { return idx_roi_; }
+bool PtCloud::HasRegionOfInterest() { return !idx_roi_.empty(); }
 
 TranslationGrid& PtCloud::x_translation_grid() { return x_translation_grid_; }
 TranslationGrid& PtCloud::y_translation_grid() { return y_translation_grid_; }
@@ -1,23 +1,64 @@
 #pragma once
 
 #include <Eigen/Dense>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
+#include "mapped_file.hpp"
 #include "translation_grid.hpp"
 
+// Storage of the grid values in tiled transform files
+enum class GridValsQuantization : int32_t {
+  // Double precision values
+  kNone = 0,
+  // 16 bit integers with a scale per tile and per grid value, i.e. per f, fx, ..., fxyz of the x,
+  // y and z grids. A stored grid value deviates by at most half a quantization step, i.e. by
+  // 1/65534 of the maximum absolute value of its kind in its tile.
+  kInt16 = 1
+};
+
+// Parses "none" or "int16"; throws if the quantization is not available
+GridValsQuantization GridValsQuantizationFromString(const std::string& quantization);
+
+// Layout of exported transform files
+struct TransformFileLayout {
+  // Number of voxels per axis of the tiles; 0 writes an untiled file
+  int tile_num_voxels{0};
+  GridValsQuantization quantization{GridValsQuantization::kNone};
+};
+
 class PtCloud {
  public:
   PtCloud(Eigen::MatrixXd X);
 
   void SetNormals(Eigen::VectorXd nx, Eigen::VectorXd ny, Eigen::VectorXd nz);
   void SetCorrespondenceId(Eigen::VectorXd correspondence_id);
+  // Limits "x_min,y_min,z_min,x_max,y_max,z_max" of the translation grids including the buffer
+  // voxels as initialized by InitializeTranslationGrids
+  std::vector<double> GridLimitsWithBuffer(const double& voxel_size, const uint32_t& buffer_voxels,
+                                           const std::vector<double>& grid_limits);
   void InitializeTranslationGrids(const double& voxel_size, const uint32_t& buffer_voxels,
                                   const std::vector<double>& grid_limits);
-  void ImportTranslationGrids(const std::string& filepath);
-  void ExportTranslationGrids(const std::string& filepath);
+  // Imports the translation grids of a transform file. If only_tiles_of_pts is true and the file
+  // is tiled, only the tiles which intersect the bounding box of the points are loaded, i.e. the
+  // grids cover the bounding box but in general not the whole transformation domain.
+  void ImportTranslationGrids(const std::string& filepath, const bool& only_tiles_of_pts = false);
+  // Same for a transform file which is already mapped, e.g. to import the grids for many point
+  // clouds with a single mapping of the file; filepath is only used for error messages
+  void ImportTranslationGrids(const std::shared_ptr<const MappedFile>& file,
+                              const std::string& filepath, const bool& only_tiles_of_pts = false);
+  void ExportTranslationGrids(const std::string& filepath, const TransformFileLayout& layout = {});
   void UpdateXt();
   void InitMatricesForUpdateXt();
+  // Restricts UpdateXt to the points with indices idx_roi, i.e. Xt is only valid for these points.
+  // Must be called before InitMatricesForUpdateXt.
+  void SetRegionOfInterest(const std::vector<int>& idx_roi);
+  // Indices of all points which have a distance <= max_distance to any of the points in X_query.
+  // A voxel mask is used, i.e. a few points with a larger distance may be contained.
+  std::vector<int> IdxPtsNearPts(const Eigen::MatrixXd& X_query, const double& max_distance);
 
   long NumPts();
   double x_min();
@@ -34,6 +75,8 @@ class PtCloud {
   const Eigen::VectorXd& ny();
   const Eigen::VectorXd& nz();
   const Eigen::VectorXd& correspondence_id();
+  const std::vector<int>& idx_roi();
+  bool HasRegionOfInterest();
   TranslationGrid& x_translation_grid();
   TranslationGrid& y_translation_grid();
   TranslationGrid& z_translation_grid();
@@ -50,17 +93,65 @@ class PtCloud {
   // Correspondence id
   Eigen::VectorXd correspondence_id_;
 
+  // Region of interest (all points if empty)
+  std::vector<int> idx_roi_;
+
   // Translation grids
   TranslationGrid x_translation_grid_;
   TranslationGrid y_translation_grid_;
   TranslationGrid z_translation_grid_;
+  Eigen::MatrixX3d X_roi_;
   Eigen::MatrixX3i X_voxel_idx_;
   Eigen::MatrixX3d Xn_voxel_;
   Eigen::Matrix<double, Eigen::Dynamic, 64> X_power_;
 };
 
+// Transform files start with the identifier and the file version. In version 1 the grid geometry
+// follows unaligned and the grid values start at byte 1000. In version 2 HeaderInfoV2 starts at
+// byte 1000 and the grid values start at data_offset, i.e. page-aligned, so that the file can be
+// memory mapped and evaluated in place. In both versions the grid values are stored per node in
+// the order of TranslationGrid::NodeIdx, each with the 8 values of the x, y and z grids.
+//
+// Version 3 files are tiled: the voxels are partitioned into tiles of tile_num_voxels voxels per
+// axis and each tile stores the grid values of all nodes of its voxels, i.e. the nodes on the
+// faces between tiles are stored in both tiles. HeaderInfoTiles follows HeaderInfoV2 and the tile
+// index, a TileIndexEntry per tile, starts at data_offset. Tile (i, j, k) has the index
+// (i * y_num_tiles + j) * z_num_tiles + k. Each tile starts page-aligned and stores the nodes in
+// the order of TranslationGrid::NodeIdx within the tile. With GridValsQuantization::kNone these are
+// VALS_PER_NODE doubles per node, with kInt16 VALS_PER_NODE double scales followed by
+// VALS_PER_NODE int16 values per node, i.e. grid value = int16 value * scale.
 struct HeaderInfo {
   char identifier[10]{"nricp"};
-  int fileversion{1};
+  int fileversion{2};
   const int length{1000};  // bytes
-};
\ No newline at end of file
+};
+
+// File version of tiled transform files
+const int TILED_FILEVERSION{3};
+
+// Number of grid values per node in the transform file
+const int VALS_PER_NODE{24};
+
+// Version 2 header with naturally aligned fields
+struct HeaderInfoV2 {
+  double grid_origin[3]{};
+  int32_t num_voxels[3]{};
+  int32_t num_vals_per_node{VALS_PER_NODE};
+  double voxel_size{};
+  uint64_t data_offset{4096};  // bytes
+};
+
+// Version 3 header following HeaderInfoV2
+struct HeaderInfoTiles {
+  int32_t tile_num_voxels{};
+  int32_t quantization{};  // GridValsQuantization
+  // Maximum absolute deviation of a stored grid value from the estimated one. The interpolated
+  // translations deviate by at most 1.953125 times this value, which is the maximum sum of the
+  // absolute values of the 64 coefficients of a tricubic stencil.
+  double max_quantization_error{};
+};
+
+struct TileIndexEntry {
+  uint64_t offset{};  // bytes
+  uint64_t size{};    // bytes
+};
@@ -0,0 +1,132 @@
+#include "pt_cloud_cache.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "hash.hpp"
+#include "mapped_file.hpp"
+
+namespace {
+
+// Names of the cached columns in the order of the cache file
+std::vector<std::string> CachedColNames(const bool& with_normals,
+                                        const bool& with_correspondence_id) {
+  std::vector<std::string> col_names{"x", "y", "z"};
+  if (with_normals) col_names.insert(col_names.end(), {"nx", "ny", "nz"});
+  if (with_correspondence_id) col_names.emplace_back("correspondence_id");
+  return col_names;
+}
+
+int64_t WriteTime(const std::string& path) {
+  return std::filesystem::last_write_time(path).time_since_epoch().count();
+}
+
+uint64_t HashOfFile(const std::string& path) {
+  MappedFile file{path};
+  return Hash64(file.data(), file.size());
+}
+
+}  // namespace
+
+std::string PtCloudCachePath(const std::string& path) { return path + ".nricpcache"; }
+
+void SavePtCloudCache(const NamedColumnMatrix<Eigen::MatrixXd>& X, const std::string& path,
+                      const bool& with_normals, const bool& with_correspondence_id) {
+  // Header identifies the source file
+  PtCloudCacheHeaderInfo header_info;
+  header_info.with_normals = with_normals;
+  header_info.with_correspondence_id = with_correspondence_id;
+  header_info.num_pts = X.rows();
+  header_info.source_size = std::filesystem::file_size(path);
+  header_info.source_write_time = WriteTime(path);
+  header_info.source_hash = HashOfFile(path);
+
+  // Written to a temporary file first, so that concurrent runs never read a partial cache file
+  std::string cache_path{PtCloudCachePath(path)};
+  std::string tmp_path{cache_path + ".tmp"};
+  {
+    std::ofstream file{tmp_path, std::ios::out | std::ios::binary};
+    if (!file.is_open()) {
+      throw std::runtime_error("Cannot open file \"" + tmp_path + "\"!");
+    }
+    std::vector<char> header(header_info.data_offset, 0);
+    std::memcpy(header.data(), &header_info, sizeof(header_info));
+    file.write(header.data(), header.size());
+    for (const auto& col_name :
+         CachedColNames(header_info.with_normals, header_info.with_correspondence_id)) {
+      file.write(reinterpret_cast<const char*>(X.col(X.namedColIndex(col_name)).data()),
+                 X.rows() * sizeof(double));
+    }
+    if (!file.good()) {
+      throw std::runtime_error("Error occurred writing file \"" + tmp_path + "\"!");
+    }
+  }
+  std::filesystem::rename(tmp_path, cache_path);
+}
+
+bool LoadPtCloudCache(
+    const std::string& path, const bool& with_normals, const bool& with_correspondence_id,
+    const Eigen::Index& batch_num_pts,
+    const std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>& consume_batch) {
+  std::string cache_path{PtCloudCachePath(path)};
+  if (!std::filesystem::exists(cache_path)) return false;
+
+  // A truncated cache file or one of another version is ignored like a stale one, i.e. it is
+  // replaced by the next run of nonrigid-icp-cache
+  MappedFile file{cache_path};
+  PtCloudCacheHeaderInfo header_info;
+  PtCloudCacheHeaderInfo header_info_for_verification;
+  if (file.size() < sizeof(header_info)) return false;
+  std::memcpy(&header_info, file.data(), sizeof(header_info));
+  header_info.identifier[sizeof(header_info.identifier) - 1] = '\0';
+  std::vector<std::string> cached_col_names{
+      CachedColNames(header_info.with_normals, header_info.with_correspondence_id)};
+  if (strcmp(header_info.identifier, header_info_for_verification.identifier) != 0 ||
+      header_info.fileversion != header_info_for_verification.fileversion ||
+      header_info.num_pts < 0 ||
+      header_info.data_offset + cached_col_names.size() * header_info.num_pts * sizeof(double) >
+          file.size()) {
+    return false;
+  }
+
+  // Requested columns are not cached or cache is stale
+  if ((with_normals && !header_info.with_normals) ||
+      (with_correspondence_id && !header_info.with_correspondence_id)) {
+    return false;
+  }
+  if (!std::filesystem::exists(path) ||
+      std::filesystem::file_size(path) != header_info.source_size) {
+    return false;
+  }
+  if (WriteTime(path) != header_info.source_write_time &&
+      HashOfFile(path) != header_info.source_hash) {
+    return false;
+  }
+
+  // Copy the requested columns from the mapped file
+  std::vector<std::string> col_names{CachedColNames(with_normals, with_correspondence_id)};
+  std::vector<const char*> col_data(col_names.size());
+  for (size_t col = 0; col < col_names.size(); col++) {
+    auto cached_col{static_cast<size_t>(
+        std::find(cached_col_names.begin(), cached_col_names.end(), col_names[col]) -
+        cached_col_names.begin())};
+    col_data[col] = file.data() + header_info.data_offset +
+                    cached_col * header_info.num_pts * sizeof(double);
+  }
+  for (Eigen::Index first = 0; first < header_info.num_pts;) {
+    Eigen::Index num{std::min<Eigen::Index>(batch_num_pts, header_info.num_pts - first)};
+    NamedColumnMatrix<Eigen::MatrixXd> X(
+        Eigen::MatrixXd(num, static_cast<Eigen::Index>(col_names.size())), col_names);
+    for (size_t col = 0; col < col_names.size(); col++) {
+      std::memcpy(X.col(col).data(), col_data[col] + first * sizeof(double), num * sizeof(double));
+    }
+    consume_batch(std::move(X));
+    first += num;
+  }
+  return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "named_column_matrix.hpp"
+
+// Binary cache of the columns of a point cloud file, i.e. of x, y, z and optionally of the normals
+// and the correspondence ids. The cache file is stored next to the point cloud file. It starts with
+// PtCloudCacheHeaderInfo, followed by the columns x, y, z, nx, ny, nz, correspondence_id (as far as
+// present) from data_offset on, each with num_pts doubles, i.e. in the column-major order of
+// Eigen::MatrixXd. The header identifies the source file by its size, its last write time and the
+// hash of its content.
+struct PtCloudCacheHeaderInfo {
+  char identifier[12]{"nricpcache"};
+  int32_t fileversion{1};
+  int32_t with_normals{0};
+  int32_t with_correspondence_id{0};
+  int64_t num_pts{0};
+  uint64_t source_size{0};
+  int64_t source_write_time{0};
+  uint64_t source_hash{0};
+  uint64_t data_offset{4096};  // bytes
+};
+
+// Path of the cache file of a point cloud file
+std::string PtCloudCachePath(const std::string& path);
+
+// Saves the columns x, y, z and optionally nx, ny, nz and correspondence_id of X, see
+// ExtractMatrix, to the cache file of the point cloud file path
+void SavePtCloudCache(const NamedColumnMatrix<Eigen::MatrixXd>& X, const std::string& path,
+                      const bool& with_normals, const bool& with_correspondence_id);
+
+// Loads the columns of the point cloud file path from its cache file in batches of at most
+// batch_num_pts points, which are passed to consume_batch in the order of the file. Returns false
+// if there is no cache file, if it is truncated or of another version, if it does not contain the
+// requested columns or if it is stale. A cache file is fresh if the size of the point cloud file is
+// unchanged and either its last write time or the hash of its content is unchanged, i.e. the point
+// cloud file is only read if it was touched.
+bool LoadPtCloudCache(
+    const std::string& path, const bool& with_normals, const bool& with_correspondence_id,
+    const Eigen::Index& batch_num_pts,
+    const std::function<void(NamedColumnMatrix<Eigen::MatrixXd>&&)>& consume_batch);
@@ -0,0 +1,142 @@
+#include "schwarz_preconditioner.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "memory_usage.hpp"
+#include "parallel.hpp"
+
+void SchwarzPreconditioner::SetGridSize(const int& x_num_voxels, const int& y_num_voxels,
+                                        const int& z_num_voxels) {
+  x_num_voxels_ = x_num_voxels;
+  y_num_voxels_ = y_num_voxels;
+  z_num_voxels_ = z_num_voxels;
+}
+
+void SchwarzPreconditioner::SetTiling(const int& tile_num_nodes, const int& overlap) {
+  if (tile_num_nodes < 1 || overlap < 0) {
+    throw std::runtime_error("Tiles must have at least 1 node and a non-negative overlap!");
+  }
+  tile_num_nodes_ = tile_num_nodes;
+  overlap_ = overlap;
+}
+
+int SchwarzPreconditioner::num_tiles() const { return static_cast<int>(tiles_.size()); }
+
+size_t SchwarzPreconditioner::memory() const {
+  size_t memory{0};  // returned
+  for (const auto& tile : tiles_) {
+    memory += MemoryUsage(tile.unknowns) + tile.is_owned.capacity() / 8 + MemoryUsage(tile.ldlt);
+  }
+  return memory;
+}
+
+void SchwarzPreconditioner::InitializeTiles() {
+  int num_nodes[3]{x_num_voxels_ + 1, y_num_voxels_ + 1, z_num_voxels_ + 1};
+  int num_tiles[3];
+  for (int axis = 0; axis < 3; axis++) {
+    num_tiles[axis] = (num_nodes[axis] + tile_num_nodes_ - 1) / tile_num_nodes_;
+  }
+  int num_unknowns_per_grid{8 * num_nodes[0] * num_nodes[1] * num_nodes[2]};
+
+  tiles_ = std::vector<Tile>(num_tiles[0] * num_tiles[1] * num_tiles[2]);
+  int tile_idx{0};
+  for (int tx = 0; tx < num_tiles[0]; tx++)
+    for (int ty = 0; ty < num_tiles[1]; ty++)
+      for (int tz = 0; tz < num_tiles[2]; tz++) {
+        int tile[3]{tx, ty, tz};
+        int first[3], last[3], first_extended[3], last_extended[3];
+        for (int axis = 0; axis < 3; axis++) {
+          first[axis] = tile[axis] * tile_num_nodes_;
+          last[axis] = std::min(first[axis] + tile_num_nodes_, num_nodes[axis]);
+          first_extended[axis] = std::max(first[axis] - overlap_, 0);
+          last_extended[axis] = std::min(last[axis] + overlap_, num_nodes[axis]);
+        }
+
+        Tile& t{tiles_[tile_idx++]};
+        for (int g = 0; g < 3; g++)
+          for (int x = first_extended[0]; x < last_extended[0]; x++)
+            for (int y = first_extended[1]; y < last_extended[1]; y++)
+              for (int z = first_extended[2]; z < last_extended[2]; z++) {
+                int node{(x * num_nodes[1] + y) * num_nodes[2] + z};
+                bool is_owned{x >= first[0] && x < last[0] && y >= first[1] && y < last[1] &&
+                              z >= first[2] && z < last[2]};
+                for (int param = 0; param < 8; param++) {
+                  t.unknowns.push_back(g * num_unknowns_per_grid + 8 * node + param);
+                  t.is_owned.push_back(is_owned);
+                }
+              }
+      }
+
+  tiles_x_num_voxels_ = x_num_voxels_;
+  tiles_y_num_voxels_ = y_num_voxels_;
+  tiles_z_num_voxels_ = z_num_voxels_;
+  tiles_tile_num_nodes_ = tile_num_nodes_;
+  tiles_overlap_ = overlap_;
+}
+
+void SchwarzPreconditioner::Setup(const Eigen::Index& size, const int* outer, const int* inner,
+                                  const double* values) {
+  if (size != 3 * 8 * (x_num_voxels_ + 1) * (y_num_voxels_ + 1) * (z_num_voxels_ + 1)) {
+    throw std::runtime_error("Size of the normal equations does not match the grid size!");
+  }
+  if (tiles_x_num_voxels_ != x_num_voxels_ || tiles_y_num_voxels_ != y_num_voxels_ ||
+      tiles_z_num_voxels_ != z_num_voxels_ || tiles_tile_num_nodes_ != tile_num_nodes_ ||
+      tiles_overlap_ != overlap_) {
+    InitializeTiles();
+  }
+
+  // The local systems are extracted and factorized in parallel; each chunk of tiles uses its own
+  // map from global to local unknowns
+  std::vector<char> succeeded(tiles_.size(), 0);
+  ParallelFor(
+      0, num_tiles(),
+      [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+        std::vector<int> local_idx(size, -1);
+        std::vector<Eigen::Triplet<double>> triplets;
+        for (int64_t tile_idx = first; tile_idx < last; tile_idx++) {
+          Tile& tile{tiles_[tile_idx]};
+          int num_local{static_cast<int>(tile.unknowns.size())};
+          for (int i = 0; i < num_local; i++) local_idx[tile.unknowns[i]] = i;
+
+          triplets.clear();
+          for (int j = 0; j < num_local; j++) {
+            for (int k = outer[tile.unknowns[j]]; k < outer[tile.unknowns[j] + 1]; k++) {
+              if (local_idx[inner[k]] >= 0) {
+                triplets.emplace_back(local_idx[inner[k]], j, values[k]);
+              }
+            }
+          }
+          Eigen::SparseMatrix<double> A_local(num_local, num_local);
+          A_local.setFromTriplets(triplets.begin(), triplets.end());
+          tile.ldlt.compute(A_local);
+          succeeded[tile_idx] = tile.ldlt.info() == Eigen::Success;
+
+          for (int i = 0; i < num_local; i++) local_idx[tile.unknowns[i]] = -1;
+        }
+      },
+      1);
+
+  info_ = std::all_of(succeeded.begin(), succeeded.end(), [](const char& s) { return s != 0; })
+              ? Eigen::Success
+              : Eigen::NumericalIssue;
+}
+
+void SchwarzPreconditioner::Apply(const Eigen::VectorXd& b, Eigen::VectorXd& x) const {
+  // Each unknown is owned by exactly one tile, i.e. the tiles write disjoint entries of x
+  ParallelFor(
+      0, num_tiles(),
+      [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+        for (int64_t tile_idx = first; tile_idx < last; tile_idx++) {
+          const Tile& tile{tiles_[tile_idx]};
+          int num_local{static_cast<int>(tile.unknowns.size())};
+          Eigen::VectorXd b_local(num_local);
+          for (int i = 0; i < num_local; i++) b_local(i) = b(tile.unknowns[i]);
+          Eigen::VectorXd x_local{tile.ldlt.solve(b_local)};
+          for (int i = 0; i < num_local; i++) {
+            if (tile.is_owned[i]) x(tile.unknowns[i]) = x_local(i);
+          }
+        }
+      },
+      1);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <Eigen/Sparse>
+#include <Eigen/SparseCholesky>
+#include <vector>
+
+// Restricted additive Schwarz preconditioner for the normal equations of the x, y and z
+// translation grids. The node lattice is partitioned into tiles of tile_num_nodes nodes per axis,
+// which are extended by overlap nodes in each direction. The local system of each extended tile
+// is the restriction of the normal equations to its unknowns and is factorized with a sparse LDLT
+// decomposition. One application of the preconditioner solves all local systems in parallel and
+// assembles the result from the solutions at the nodes of the (non-overlapping) tiles. The
+// preconditioner is not symmetric, i.e. it must be used with a nonsymmetric Krylov method such as
+// BiCGSTAB, which iterates until the tile solutions are consistent.
+class SchwarzPreconditioner {
+ public:
+  SchwarzPreconditioner() = default;
+
+  // Number of voxels of the translation grids, must be set before compute
+  void SetGridSize(const int& x_num_voxels, const int& y_num_voxels, const int& z_num_voxels);
+  // Number of nodes per axis of the tiles and number of overlapping nodes
+  void SetTiling(const int& tile_num_nodes, const int& overlap);
+
+  template <typename MatrixType>
+  SchwarzPreconditioner& analyzePattern(const MatrixType& /*A*/) {
+    return *this;
+  }
+
+  template <typename MatrixType>
+  SchwarzPreconditioner& factorize(const MatrixType& A) {
+    Setup(A.rows(), A.outerIndexPtr(), A.innerIndexPtr(), A.valuePtr());
+    return *this;
+  }
+
+  template <typename MatrixType>
+  SchwarzPreconditioner& compute(const MatrixType& A) {
+    return factorize(A);
+  }
+
+  template <typename Rhs>
+  Eigen::VectorXd solve(const Rhs& b) const {
+    Eigen::VectorXd x(b.size());
+    Apply(b, x);
+    return x;
+  }
+
+  Eigen::ComputationInfo info() { return info_; }
+
+  int num_tiles() const;
+  // Memory of the tiles and their decompositions in bytes
+  size_t memory() const;
+
+ private:
+  struct Tile {
+    // Sorted unknowns of the extended tile
+    std::vector<int> unknowns{};
+    // For each unknown of the extended tile: true if its node belongs to the tile itself
+    std::vector<bool> is_owned{};
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> ldlt{};
+  };
+
+  void Setup(const Eigen::Index& size, const int* outer, const int* inner, const double* values);
+  void InitializeTiles();
+  void Apply(const Eigen::VectorXd& b, Eigen::VectorXd& x) const;
+
+  int x_num_voxels_{0};
+  int y_num_voxels_{0};
+  int z_num_voxels_{0};
+  int tile_num_nodes_{16};
+  int overlap_{1};
+  // Lattice and tiling for which tiles_ was initialized
+  int tiles_x_num_voxels_{-1};
+  int tiles_y_num_voxels_{-1};
+  int tiles_z_num_voxels_{-1};
+  int tiles_tile_num_nodes_{-1};
+  int tiles_overlap_{-1};
+  std::vector<Tile> tiles_{};
+  Eigen::ComputationInfo info_{Eigen::Success};
+};
@@ -0,0 +1,189 @@
+#include "statistics.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "parallel.hpp"
+
+// Vectors up to this size are handled by a serial nth_element on a copy
+const int64_t MAX_SIZE_FOR_SERIAL_SELECTION{1 << 15};
+const int NUM_SELECTION_HISTOGRAM_BINS{4096};
+const int NUM_APPROXIMATE_HISTOGRAM_BINS{1 << 16};
+
+namespace {
+
+struct Moments {
+  int64_t num{0};
+  double mean{0};
+  double m2{0};  // sum of squared differences from the mean
+  double min{std::numeric_limits<double>::infinity()};
+  double max{-std::numeric_limits<double>::infinity()};
+};
+
+// Combines the moments of two disjoint subsets (Chan et al.)
+Moments CombineMoments(const Moments& a, const Moments& b) {
+  if (a.num == 0) return b;
+  if (b.num == 0) return a;
+  Moments ab{};
+  ab.num = a.num + b.num;
+  double delta{b.mean - a.mean};
+  ab.mean = a.mean + delta * static_cast<double>(b.num) / static_cast<double>(ab.num);
+  ab.m2 = a.m2 + b.m2 +
+          delta * delta * static_cast<double>(a.num) * static_cast<double>(b.num) /
+              static_cast<double>(ab.num);
+  ab.min = std::min(a.min, b.min);
+  ab.max = std::max(a.max, b.max);
+  return ab;
+}
+
+Moments ComputeMoments(const Eigen::VectorXd& v) {
+  std::vector<Moments> chunk_moments(NumParallelChunks(0, v.size()));
+  ParallelFor(0, v.size(), [&](const int64_t& first, const int64_t& last, const int& chunk_idx) {
+    Moments moments{};
+    for (int64_t i = first; i < last; i++) {
+      // Welford's online update
+      moments.num++;
+      double delta{v(i) - moments.mean};
+      moments.mean += delta / static_cast<double>(moments.num);
+      moments.m2 += delta * (v(i) - moments.mean);
+      moments.min = std::min(moments.min, v(i));
+      moments.max = std::max(moments.max, v(i));
+    }
+    chunk_moments[chunk_idx] = moments;
+  });
+
+  Moments moments{};
+  for (const auto& m : chunk_moments) moments = CombineMoments(moments, m);
+  return moments;
+}
+
+// Histogram of value(i) for i in [0, num) with num_bins bins between min_val and max_val
+template <typename ValueFunction>
+std::vector<int64_t> ComputeHistogram(const int64_t& num, ValueFunction value,
+                                      const double& min_val, const double& max_val,
+                                      const int& num_bins) {
+  double bin_width{(max_val - min_val) / num_bins};
+  auto bin_idx = [&](const double& val) {
+    return std::clamp(static_cast<int>((val - min_val) / bin_width), 0, num_bins - 1);
+  };
+
+  std::vector<std::vector<int64_t>> chunk_histograms(NumParallelChunks(0, num),
+                                                     std::vector<int64_t>(num_bins, 0));
+  ParallelFor(0, num, [&](const int64_t& first, const int64_t& last, const int& chunk_idx) {
+    auto& histogram{chunk_histograms[chunk_idx]};
+    for (int64_t i = first; i < last; i++) histogram[bin_idx(value(i))]++;
+  });
+
+  std::vector<int64_t> histogram(num_bins, 0);
+  for (const auto& chunk_histogram : chunk_histograms)
+    for (int b = 0; b < num_bins; b++) histogram[b] += chunk_histogram[b];
+  return histogram;
+}
+
+// Exact k-th smallest value(i) for i in [0, num); all values must be in [min_val, max_val]
+template <typename ValueFunction>
+double SelectExact(const int64_t& num, ValueFunction value, const int64_t& k, const double& min_val,
+                   const double& max_val) {
+  if (num <= MAX_SIZE_FOR_SERIAL_SELECTION || !(max_val > min_val)) {
+    if (!(max_val > min_val)) return min_val;
+    std::vector<double> values(num);
+    for (int64_t i = 0; i < num; i++) values[i] = value(i);
+    std::nth_element(values.begin(), values.begin() + k, values.end());
+    return values[k];
+  }
+
+  // Find the histogram bin which contains the k-th value ...
+  const int num_bins{NUM_SELECTION_HISTOGRAM_BINS};
+  auto histogram{ComputeHistogram(num, value, min_val, max_val, num_bins)};
+  int bin{0};
+  int64_t num_before_bin{0};
+  while (num_before_bin + histogram[bin] <= k) {
+    num_before_bin += histogram[bin];
+    bin++;
+  }
+
+  // ... and select within the values of this bin only
+  double bin_width{(max_val - min_val) / num_bins};
+  std::vector<std::vector<double>> chunk_values(NumParallelChunks(0, num));
+  ParallelFor(0, num, [&](const int64_t& first, const int64_t& last, const int& chunk_idx) {
+    for (int64_t i = first; i < last; i++) {
+      double val{value(i)};
+      if (std::clamp(static_cast<int>((val - min_val) / bin_width), 0, num_bins - 1) == bin) {
+        chunk_values[chunk_idx].push_back(val);
+      }
+    }
+  });
+  std::vector<double> values;
+  values.reserve(histogram[bin]);
+  for (const auto& c : chunk_values) values.insert(values.end(), c.begin(), c.end());
+  auto k_in_bin{k - num_before_bin};
+  std::nth_element(values.begin(), values.begin() + k_in_bin, values.end());
+  return values[k_in_bin];
+}
+
+}  // namespace
+
+Statistics ComputeStatistics(const Eigen::VectorXd& v, const StatisticsMode& mode) {
+  Statistics statistics{};
+  if (v.size() == 0) return statistics;
+
+  auto moments{ComputeMoments(v)};
+  statistics.mean = moments.mean;
+  statistics.std = sqrt(moments.m2 / (static_cast<double>(moments.num) - 1));
+
+  // Rank of the median, i.e. the upper median for an even number of values
+  int64_t k{v.size() / 2};
+
+  if (mode == StatisticsMode::kExact) {
+    statistics.median = SelectExact(
+        v.size(), [&](const int64_t& i) { return v(i); }, k, moments.min, moments.max);
+    double median{statistics.median};
+    statistics.mad = SelectExact(
+        v.size(), [&](const int64_t& i) { return std::abs(v(i) - median); }, k, 0,
+        std::max(moments.max - median, median - moments.min));
+  } else {
+    if (!(moments.max > moments.min)) {
+      statistics.median = moments.min;
+      statistics.mad = 0;
+      return statistics;
+    }
+
+    const int num_bins{NUM_APPROXIMATE_HISTOGRAM_BINS};
+    auto histogram{ComputeHistogram(
+        v.size(), [&](const int64_t& i) { return v(i); }, moments.min, moments.max, num_bins)};
+    std::vector<int64_t> num_before_bin(num_bins + 1, 0);
+    for (int b = 0; b < num_bins; b++) num_before_bin[b + 1] = num_before_bin[b] + histogram[b];
+    double bin_width{(moments.max - moments.min) / num_bins};
+
+    // Number of values < val, interpolated linearly within the bins
+    auto cdf = [&](const double& val) {
+      double pos{std::clamp((val - moments.min) / bin_width, 0.0, static_cast<double>(num_bins))};
+      int bin{std::min(static_cast<int>(pos), num_bins - 1)};
+      return num_before_bin[bin] + (pos - bin) * histogram[bin];
+    };
+
+    // Smallest val with cdf(val) >= target, by bisection
+    auto inverse = [&](auto function, double lower, double upper, const double& target) {
+      for (int i = 0; i < 64 && upper - lower > bin_width * 1e-6; i++) {
+        double mid{0.5 * (lower + upper)};
+        (function(mid) < target ? lower : upper) = mid;
+      }
+      return 0.5 * (lower + upper);
+    };
+
+    double target{static_cast<double>(k) + 0.5};
+    statistics.median = inverse(cdf, moments.min, moments.max, target);
+    double median{statistics.median};
+    statistics.mad = inverse([&](const double& r) { return cdf(median + r) - cdf(median - r); },
+                             0, std::max(moments.max - median, median - moments.min), target);
+  }
+
+  return statistics;
+}
+
+double Median(const Eigen::VectorXd& v) { return ComputeStatistics(v).median; }
+
+double MAD(const Eigen::VectorXd& v) { return ComputeStatistics(v).mad; }
+
+double Std(const Eigen::VectorXd& v) { return ComputeStatistics(v).std; }
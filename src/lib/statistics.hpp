@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <cmath>
+
+enum class StatisticsMode {
+  kExact,
+  // Median and MAD are interpolated from a histogram with NUM_APPROXIMATE_HISTOGRAM_BINS bins
+  // between min(v) and max(v), i.e. their error is below (max(v)-min(v))/num_bins
+  kApproximate
+};
+
+struct Statistics {
+  double mean{NAN};
+  double std{NAN};
+  double median{NAN};
+  double mad{NAN};
+};
+
+// Computes all statistics with parallel passes over v: one pass for mean, std, min and max, and
+// histogram based passes for the selection of median and MAD
+Statistics ComputeStatistics(const Eigen::VectorXd& v,
+                             const StatisticsMode& mode = StatisticsMode::kExact);
+
+double Median(const Eigen::VectorXd& v);
+
+// Median of absolute differences (mad) with respect to the median
+double MAD(const Eigen::VectorXd& v);
+
+double Std(const Eigen::VectorXd& v);
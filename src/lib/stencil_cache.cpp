@@ -0,0 +1,113 @@
+#include "stencil_cache.hpp"
+
+#include "memory_usage.hpp"
+#include "parallel.hpp"
+
+void StencilCache::SetMemoryBudget(const size_t& memory_budget) {
+  size_t bytes_per_point{STENCIL_SIZE * sizeof(float) + sizeof(std::array<int, 3>) +
+                         2 * sizeof(int)};
+  max_num_cached_points_ = memory_budget / bytes_per_point;
+  slot_of_point_.clear();
+  cached_stencils_.clear();
+  cached_voxels_.clear();
+}
+
+bool StencilCache::enabled() const { return max_num_cached_points_ > 0; }
+
+void StencilCache::Update(const TranslationGrid& translation_grid,
+                          const std::vector<int>& pc_mov_idx, const Eigen::MatrixX3d& X) {
+  Eigen::RowVector3i num_voxels{translation_grid.x_num_voxels(), translation_grid.y_num_voxels(),
+                                translation_grid.z_num_voxels()};
+  if (translation_grid.grid_origin() != grid_origin_ ||
+      translation_grid.voxel_size() != voxel_size_ || num_voxels != num_voxels_) {
+    grid_origin_ = translation_grid.grid_origin();
+    voxel_size_ = translation_grid.voxel_size();
+    num_voxels_ = num_voxels;
+    slot_of_point_.clear();
+    cached_stencils_.clear();
+    cached_voxels_.clear();
+  }
+
+  // Look up the cached points
+  int num{static_cast<int>(pc_mov_idx.size())};
+  correspondence_slots_.assign(num, -1);
+  std::vector<int> missing{};
+  for (int i = 0; i < num; i++) {
+    auto it{slot_of_point_.find(pc_mov_idx[i])};
+    if (it != slot_of_point_.end()) {
+      correspondence_slots_[i] = it->second;
+    } else {
+      missing.push_back(i);
+    }
+  }
+  num_hits_ = num - static_cast<int>(missing.size());
+
+  // Compute the stencils of all other points
+  int num_missing{static_cast<int>(missing.size())};
+  std::vector<float> missing_stencils(static_cast<size_t>(num_missing) * STENCIL_SIZE);
+  std::vector<std::array<int, 3>> missing_voxels(num_missing);
+  const auto& inv_A{translation_grid.inv_A()};
+  ParallelFor(0, num_missing,
+              [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+                Eigen::MatrixX3d X_missing(last - first, 3);
+                for (int64_t k = first; k < last; k++) X_missing.row(k - first) = X.row(missing[k]);
+                auto [X_voxel_idx, Xn_voxel]{translation_grid.GetGridReference(X_missing)};
+                Eigen::Matrix<double, Eigen::Dynamic, 64> C{
+                    TranslationGrid::Compute_X_power(Xn_voxel) * inv_A};
+                for (int64_t k = first; k < last; k++) {
+                  for (int j = 0; j < STENCIL_SIZE; j++) {
+                    missing_stencils[k * STENCIL_SIZE + j] = static_cast<float>(C(k - first, j));
+                  }
+                  missing_voxels[k] = {X_voxel_idx(k - first, 0), X_voxel_idx(k - first, 1),
+                                       X_voxel_idx(k - first, 2)};
+                }
+              });
+
+  // Add them to the cache as long as it has free slots; a point may occur more than once
+  overflow_stencils_.clear();
+  overflow_voxels_.clear();
+  for (int k = 0; k < num_missing; k++) {
+    int i{missing[k]};
+    auto it{slot_of_point_.find(pc_mov_idx[i])};
+    if (it != slot_of_point_.end()) {
+      correspondence_slots_[i] = it->second;
+      continue;
+    }
+    const float* missing_stencil{missing_stencils.data() + static_cast<size_t>(k) * STENCIL_SIZE};
+    if (cached_voxels_.size() < max_num_cached_points_) {
+      int slot{static_cast<int>(cached_voxels_.size())};
+      cached_stencils_.insert(cached_stencils_.end(), missing_stencil,
+                              missing_stencil + STENCIL_SIZE);
+      cached_voxels_.push_back(missing_voxels[k]);
+      slot_of_point_.emplace(pc_mov_idx[i], slot);
+      correspondence_slots_[i] = slot;
+    } else {
+      correspondence_slots_[i] = -1 - static_cast<int>(overflow_voxels_.size());
+      overflow_stencils_.insert(overflow_stencils_.end(), missing_stencil,
+                                missing_stencil + STENCIL_SIZE);
+      overflow_voxels_.push_back(missing_voxels[k]);
+    }
+  }
+}
+
+const float* StencilCache::stencil(const int& i) const {
+  int slot{correspondence_slots_[i]};
+  return slot >= 0 ? cached_stencils_.data() + static_cast<size_t>(slot) * STENCIL_SIZE
+                   : overflow_stencils_.data() + static_cast<size_t>(-1 - slot) * STENCIL_SIZE;
+}
+
+Eigen::RowVector3i StencilCache::voxel_idx(const int& i) const {
+  int slot{correspondence_slots_[i]};
+  const auto& voxel{slot >= 0 ? cached_voxels_[slot] : overflow_voxels_[-1 - slot]};
+  return {voxel[0], voxel[1], voxel[2]};
+}
+
+int StencilCache::num_cached_points() const { return static_cast<int>(cached_voxels_.size()); }
+const int& StencilCache::num_hits() const { return num_hits_; }
+
+size_t StencilCache::memory() const {
+  return MemoryUsage(cached_stencils_) + MemoryUsage(cached_voxels_) +
+         MemoryUsage(overflow_stencils_) + MemoryUsage(overflow_voxels_) +
+         MemoryUsage(correspondence_slots_) +
+         slot_of_point_.size() * (sizeof(std::pair<const int, int>) + 2 * sizeof(void*));
+}
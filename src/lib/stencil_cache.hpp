@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Eigen/Dense>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "translation_grid.hpp"
+
+// Cache of the tricubic stencils of movable points, i.e. of the 64 coefficients
+// c = X_power * inv_A in the order of TranslationGrid::Get_f and of the voxel of each point. J is
+// evaluated at the untransformed coordinates of the movable points, i.e. the stencil of a point
+// does not change between iterations; only the set of matched points changes. Stencils are stored
+// as float, i.e. with a relative precision of about 1e-7.
+class StencilCache {
+ public:
+  // Memory budget for the cached stencils in bytes; 0 disables the cache
+  void SetMemoryBudget(const size_t& memory_budget);
+  bool enabled() const;
+
+  // Provides the stencils of the correspondences at the untransformed movable points X with
+  // indices pc_mov_idx. Stencils of points seen before are taken from the cache. All others are
+  // computed in parallel chunks and added to the cache while the memory budget allows it. The
+  // cache is cleared if the geometry of the grid changes.
+  void Update(const TranslationGrid& translation_grid, const std::vector<int>& pc_mov_idx,
+              const Eigen::MatrixX3d& X);
+
+  // Stencil and voxel of correspondence i of the last call of Update
+  const float* stencil(const int& i) const;
+  Eigen::RowVector3i voxel_idx(const int& i) const;
+
+  // Getters
+  int num_cached_points() const;
+  // Memory of the cached and the overflow stencils in bytes
+  size_t memory() const;
+  // Number of stencils of the last call of Update which were taken from the cache
+  const int& num_hits() const;
+
+ private:
+  static const int STENCIL_SIZE{64};
+
+  size_t max_num_cached_points_{0};
+  // Geometry of the grid for which the stencils were computed
+  Eigen::RowVector3d grid_origin_{};
+  double voxel_size_{0};
+  Eigen::RowVector3i num_voxels_{Eigen::RowVector3i::Zero()};
+
+  // Slot of each cached movable point
+  std::unordered_map<int, int> slot_of_point_{};
+  std::vector<float> cached_stencils_{};
+  std::vector<std::array<int, 3>> cached_voxels_{};
+
+  // Stencils of the last call of Update which did not fit into the cache
+  std::vector<float> overflow_stencils_{};
+  std::vector<std::array<int, 3>> overflow_voxels_{};
+  // For each correspondence of the last call of Update: its slot in the cache (>= 0) or
+  // -1 - its index in the overflow stencils
+  std::vector<int> correspondence_slots_{};
+  int num_hits_{0};
+};
@@ -1,10 +1,39 @@
 #include "translation_grid.hpp"
 
+#include <algorithm>
 #include <stdexcept>
 
+#include "parallel.hpp"
+#include "stencil_cache.hpp"
+
 void TranslationGrid::Initialize(const Eigen::RowVector3d& grid_origin, const int& x_num_voxels,
                                  const int& y_num_voxels, const int& z_num_voxels,
                                  const double& voxel_size, const int& first_idx_adj) {
+  InitializeGeometry(grid_origin, x_num_voxels, y_num_voxels, z_num_voxels, voxel_size,
+                     first_idx_adj);
+  grid_vals_.assign(num_grid_vals_, 0.0);
+  external_grid_vals_owner_.reset();
+  external_grid_vals_ = nullptr;
+}
+
+void TranslationGrid::Initialize(const Eigen::RowVector3d& grid_origin, const int& x_num_voxels,
+                                 const int& y_num_voxels, const int& z_num_voxels,
+                                 const double& voxel_size, const int& first_idx_adj,
+                                 std::shared_ptr<const void> owner, const double* grid_vals,
+                                 const int& stride) {
+  InitializeGeometry(grid_origin, x_num_voxels, y_num_voxels, z_num_voxels, voxel_size,
+                     first_idx_adj);
+  grid_vals_.clear();
+  grid_vals_.shrink_to_fit();
+  external_grid_vals_owner_ = std::move(owner);
+  external_grid_vals_ = grid_vals;
+  external_grid_vals_stride_ = stride;
+}
+
+void TranslationGrid::InitializeGeometry(const Eigen::RowVector3d& grid_origin,
+                                         const int& x_num_voxels, const int& y_num_voxels,
+                                         const int& z_num_voxels, const double& voxel_size,
+                                         const int& first_idx_adj) {
   grid_origin_ = grid_origin;
   voxel_size_ = voxel_size;
 
@@ -12,36 +41,9 @@ void TranslationGrid::Initialize(const Eigen::RowVector3d& grid_origin, const in
   y_num_voxels_ = y_num_voxels;
   z_num_voxels_ = z_num_voxels;
 
-  // clang-format off
-  grid_vals_ = std::vector<std::vector<std::vector<GridVals>>>
-      (x_num_voxels+1,std::vector<std::vector<GridVals>>
-      (y_num_voxels+1,std::vector<GridVals>
-      (z_num_voxels+1, GridVals{})));
-
-  grid_idx_adj_ = std::vector<std::vector<std::vector<GridIdxAdj>>>
-      (x_num_voxels+1,std::vector<std::vector<GridIdxAdj>>
-      (y_num_voxels+1,std::vector<GridIdxAdj>
-      (z_num_voxels+1, GridIdxAdj{})));
-  // clang-format on
-
-  int idx_adj{first_idx_adj};
-  for (int x_voxel_idx = 0; x_voxel_idx < x_num_voxels + 1; x_voxel_idx++)
-    for (int y_voxel_idx = 0; y_voxel_idx < y_num_voxels + 1; y_voxel_idx++)
-      for (int z_voxel_idx = 0; z_voxel_idx < z_num_voxels + 1; z_voxel_idx++) {
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f = idx_adj;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx = idx_adj + 1;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy = idx_adj + 2;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz = idx_adj + 3;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy = idx_adj + 4;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz = idx_adj + 5;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz = idx_adj + 6;
-        grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz = idx_adj + 7;
-        idx_adj += 8;
-      }
-  min_idx_adj_ = first_idx_adj;
-  max_idx_adj_ = idx_adj - 1;
-
   num_grid_vals_ = (x_num_voxels + 1) * (y_num_voxels + 1) * (z_num_voxels + 1) * 8;
+  min_idx_adj_ = first_idx_adj;
+  max_idx_adj_ = first_idx_adj + num_grid_vals_ - 1;
 
   // clang-format off
   const int inv_A_array[64][64] =
@@ -118,7 +120,7 @@ void TranslationGrid::Initialize(const Eigen::RowVector3d& grid_origin, const in
 }
 
 std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> TranslationGrid::GetGridReference(
-    const Eigen::MatrixX3d& X) {
+    const Eigen::MatrixX3d& X) const {
   int64_t num_obs{X.rows()};
 
   Eigen::MatrixX3i X_voxel_idx(num_obs, 3);  // returned
@@ -168,39 +170,24 @@ std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> TranslationGrid::GetGridReference
   return {X_voxel_idx, Xn_voxel};
 }
 
-std::tuple<Vector64d, Vector64i> TranslationGrid::Get_f(const Eigen::RowVector3i& X_voxel_idx) {
+int TranslationGrid::NodeIdx(const int& x_node_idx, const int& y_node_idx,
+                             const int& z_node_idx) const {
+  return (x_node_idx * (y_num_voxels_ + 1) + y_node_idx) * (z_num_voxels_ + 1) + z_node_idx;
+}
+
+std::tuple<Vector64d, Vector64i> TranslationGrid::Get_f(
+    const Eigen::RowVector3i& X_voxel_idx) const {
   Vector64d f_vals{};     // returned
   Vector64i f_idx_adj{};  // returned
 
-  Vector8i dx_voxel_idx, dy_voxel_idx, dz_voxel_idx;
-  dx_voxel_idx << 0, 1, 0, 1, 0, 1, 0, 1;
-  dy_voxel_idx << 0, 0, 1, 1, 0, 0, 1, 1;
-  dz_voxel_idx << 0, 0, 0, 0, 1, 1, 1, 1;
-
   for (int i = 0; i < 8; i++) {
-    // clang-format off
-    int x_voxel_idx{X_voxel_idx(0)+dx_voxel_idx(i)};
-    int y_voxel_idx{X_voxel_idx(1)+dy_voxel_idx(i)};
-    int z_voxel_idx{X_voxel_idx(2)+dz_voxel_idx(i)};
-
-    f_vals(8*0+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f;
-    f_vals(8*1+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx;
-    f_vals(8*2+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy;
-    f_vals(8*3+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz;
-    f_vals(8*4+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy;
-    f_vals(8*5+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz;
-    f_vals(8*6+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz;
-    f_vals(8*7+i) = grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz;
-
-    f_idx_adj(8*0+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f;
-    f_idx_adj(8*1+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx;
-    f_idx_adj(8*2+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy;
-    f_idx_adj(8*3+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz;
-    f_idx_adj(8*4+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy;
-    f_idx_adj(8*5+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz;
-    f_idx_adj(8*6+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz;
-    f_idx_adj(8*7+i) = grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz;
-    // clang-format on
+    int node_idx{NodeIdx(X_voxel_idx(0) + (i & 1), X_voxel_idx(1) + ((i >> 1) & 1),
+                         X_voxel_idx(2) + ((i >> 2) & 1))};
+    const double* node_grid_vals{NodeGridVals(node_idx)};
+    for (int p = 0; p < 8; p++) {
+      f_vals(8 * p + i) = node_grid_vals[p];
+      f_idx_adj(8 * p + i) = min_idx_adj_ + 8 * node_idx + p;
+    }
   }
 
   return {f_vals, f_idx_adj};
@@ -258,60 +245,91 @@ Eigen::Matrix<double, Eigen::Dynamic, 64> TranslationGrid::Compute_X_power(
 }
 
 std::vector<Eigen::Triplet<double>> TranslationGrid::J(const Eigen::MatrixX3d& X) {
-  auto [X_voxel_idx, Xn_voxel]{GetGridReference(X)};
-  auto X_power{Compute_X_power(Xn_voxel)};
+  std::vector<Eigen::Triplet<double>> triplets(X.rows() * 64);
+  J(X, Eigen::VectorXd::Ones(X.rows()), triplets.data());
+  return triplets;
+}
 
-  std::vector<Eigen::Triplet<double>> triplets;
-  triplets.reserve(X.rows() * 64);
+void TranslationGrid::J(const Eigen::MatrixX3d& X, const Eigen::VectorXd& row_scale,
+                        Eigen::Triplet<double>* triplets) const {
+  ParallelFor(0, X.rows(), [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+    auto [X_voxel_idx, Xn_voxel]{GetGridReference(X.middleRows(first, last - first))};
+    auto X_power{Compute_X_power(Xn_voxel)};
 
-  Vector64d coeff_vals{};
-  Vector64i coeff_rows{};
+    Vector64d coeff_vals{};
 
-  for (int i = 0; i < X.rows(); i++) {
-    coeff_vals = X_power.row(i) * inv_A_;
-    coeff_rows.setConstant(i);
-    auto [f_vals, coeff_cols]{Get_f(X_voxel_idx.row(i))};
-    for (int j = 0; j < 64; j++) {
-      triplets.emplace_back(coeff_rows(j), coeff_cols(j), coeff_vals(j));
+    for (int64_t i = first; i < last; i++) {
+      coeff_vals = (X_power.row(i - first) * inv_A_).transpose() * row_scale(i);
+      auto [f_vals, coeff_cols]{Get_f(X_voxel_idx.row(i - first))};
+      for (int j = 0; j < 64; j++) {
+        triplets[64 * i + j] = Eigen::Triplet<double>(i, coeff_cols(j), coeff_vals(j));
+      }
     }
-  }
+  });
+}
 
-  return triplets;
+void TranslationGrid::J(const StencilCache& stencil_cache, const Eigen::VectorXd& row_scale,
+                        Eigen::Triplet<double>* triplets) const {
+  ParallelFor(0, row_scale.size(),
+              [&](const int64_t& first, const int64_t& last, const int& /*chunk*/) {
+                for (int64_t i = first; i < last; i++) {
+                  const float* stencil{stencil_cache.stencil(i)};
+                  auto [f_vals, coeff_cols]{Get_f(stencil_cache.voxel_idx(i))};
+                  for (int j = 0; j < 64; j++) {
+                    triplets[64 * i + j] =
+                        Eigen::Triplet<double>(i, coeff_cols(j), stencil[j] * row_scale(i));
+                  }
+                }
+              });
 }
 
 void TranslationGrid::UpdateAllGridValsFromVector(const Eigen::VectorXd& grid_vals_new) {
-  for (int x_voxel_idx = 0; x_voxel_idx < x_num_voxels_ + 1; x_voxel_idx++)
-    for (int y_voxel_idx = 0; y_voxel_idx < y_num_voxels_ + 1; y_voxel_idx++)
-      for (int z_voxel_idx = 0; z_voxel_idx < z_num_voxels_ + 1; z_voxel_idx++) {
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz);
-        grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz =
-            grid_vals_new(grid_idx_adj_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz);
-      }
+  MakeGridValsOwned();
+  std::copy(grid_vals_new.data() + min_idx_adj_,
+            grid_vals_new.data() + min_idx_adj_ + num_grid_vals_, grid_vals_.begin());
+}
+
+void TranslationGrid::WriteAllGridValsToVector(Eigen::VectorXd& grid_vals) const {
+  int num_nodes{num_grid_vals_ / 8};
+  for (int node_idx = 0; node_idx < num_nodes; node_idx++) {
+    const double* node_grid_vals{NodeGridVals(node_idx)};
+    std::copy(node_grid_vals, node_grid_vals + 8, grid_vals.data() + min_idx_adj_ + 8 * node_idx);
+  }
 }
 
 void TranslationGrid::UpdateVoxelGridVals(const int& x_voxel_idx, const int& y_voxel_idx,
                                           const int& z_voxel_idx, const GridVals grid_vals_new) {
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].f = grid_vals_new.f;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fx = grid_vals_new.fx;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fy = grid_vals_new.fy;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fz = grid_vals_new.fz;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxy = grid_vals_new.fxy;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxz = grid_vals_new.fxz;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fyz = grid_vals_new.fyz;
-  grid_vals_[x_voxel_idx][y_voxel_idx][z_voxel_idx].fxyz = grid_vals_new.fxyz;
+  MakeGridValsOwned();
+  double* node_grid_vals{grid_vals_.data() + 8 * NodeIdx(x_voxel_idx, y_voxel_idx, z_voxel_idx)};
+  node_grid_vals[0] = grid_vals_new.f;
+  node_grid_vals[1] = grid_vals_new.fx;
+  node_grid_vals[2] = grid_vals_new.fy;
+  node_grid_vals[3] = grid_vals_new.fz;
+  node_grid_vals[4] = grid_vals_new.fxy;
+  node_grid_vals[5] = grid_vals_new.fxz;
+  node_grid_vals[6] = grid_vals_new.fyz;
+  node_grid_vals[7] = grid_vals_new.fxyz;
+}
+
+const double* TranslationGrid::NodeGridVals(const int& node_idx) const {
+  if (external_grid_vals_ != nullptr) {
+    return external_grid_vals_ + static_cast<int64_t>(node_idx) * external_grid_vals_stride_;
+  }
+  return grid_vals_.data() + static_cast<int64_t>(node_idx) * 8;
+}
+
+bool TranslationGrid::HasExternalGridVals() const { return external_grid_vals_ != nullptr; }
+
+void TranslationGrid::MakeGridValsOwned() {
+  if (external_grid_vals_ == nullptr) return;
+  grid_vals_.resize(num_grid_vals_);
+  int num_nodes{num_grid_vals_ / 8};
+  for (int node_idx = 0; node_idx < num_nodes; node_idx++) {
+    const double* node_grid_vals{NodeGridVals(node_idx)};
+    std::copy(node_grid_vals, node_grid_vals + 8, grid_vals_.data() + 8 * node_idx);
+  }
+  external_grid_vals_owner_.reset();
+  external_grid_vals_ = nullptr;
 }
 
 const Eigen::RowVector3d& TranslationGrid::grid_origin() const { return grid_origin_; }
@@ -322,6 +340,4 @@ const int& TranslationGrid::z_num_voxels() const { return z_num_voxels_; }
 const int& TranslationGrid::num_grid_vals() const { return num_grid_vals_; }
 const int& TranslationGrid::min_idx_adj() const { return min_idx_adj_; }
 const int& TranslationGrid::max_idx_adj() const { return max_idx_adj_; }
-const std::vector<std::vector<std::vector<GridVals>>>& TranslationGrid::grid_vals() const {
-  return grid_vals_;
-}
+const Eigen::Matrix<double, 64, 64>& TranslationGrid::inv_A() const { return inv_A_; }
@@ -2,9 +2,12 @@
 
 #include <Eigen/Dense>
 #include <Eigen/Sparse>
+#include <memory>
 #include <tuple>
 #include <vector>
 
+class StencilCache;
+
 typedef Eigen::Matrix<double, 64, 1> Vector64d;
 typedef Eigen::Matrix<int, 64, 1> Vector64i;
 typedef Eigen::Matrix<int, 8, 1> Vector8i;
@@ -20,22 +23,21 @@ struct GridVals {
   double fxyz{0};
 };
 
-struct GridIdxAdj {
-  int f{0};
-  int fx{0};
-  int fy{0};
-  int fz{0};
-  int fxy{0};
-  int fxz{0};
-  int fyz{0};
-  int fxyz{0};
-};
-
+// The grid values are stored per node in the order of GridVals, either in a vector owned by the
+// grid or in external storage, e.g. a memory mapped transform file, which is evaluated in place
 class TranslationGrid {
  public:
+  // Initializes the grid with zero grid values
   void Initialize(const Eigen::RowVector3d& grid_origin, const int& x_num_voxels,
                   const int& y_num_voxels, const int& z_num_voxels, const double& voxel_size,
                   const int& first_idx_adj);
+  // Initializes the grid with the external grid values grid_vals: the values of node i are
+  // grid_vals[i*stride] to grid_vals[i*stride+7]. owner keeps the storage alive. The external
+  // values are only read; the first update of the grid values copies them to owned storage.
+  void Initialize(const Eigen::RowVector3d& grid_origin, const int& x_num_voxels,
+                  const int& y_num_voxels, const int& z_num_voxels, const double& voxel_size,
+                  const int& first_idx_adj, std::shared_ptr<const void> owner,
+                  const double* grid_vals, const int& stride);
   Eigen::VectorXd p(const Eigen::MatrixX3d& X);
   // This version of p() can be used to save computation time if >1 translation grid is used, e.g.
   // for x, y, z
@@ -43,12 +45,30 @@ class TranslationGrid {
                     const Eigen::Matrix<double, Eigen::Dynamic, 64>& X_power,
                     const Eigen::MatrixX3i& X_voxel_idx);
   std::vector<Eigen::Triplet<double>> J(const Eigen::MatrixX3d& X);
+  // Writes the 64 triplets of each row i of J, scaled by row_scale(i), to triplets[64*i] to
+  // triplets[64*i+63]; the rows are processed in parallel chunks
+  void J(const Eigen::MatrixX3d& X, const Eigen::VectorXd& row_scale,
+         Eigen::Triplet<double>* triplets) const;
+  // Version of J which takes the stencils and voxels of the rows from stencil_cache, see
+  // StencilCache::Update, instead of computing them
+  void J(const StencilCache& stencil_cache, const Eigen::VectorXd& row_scale,
+         Eigen::Triplet<double>* triplets) const;
   void UpdateAllGridValsFromVector(const Eigen::VectorXd& grid_vals_new);
+  // Inverse of UpdateAllGridValsFromVector, i.e. writes the grid values to their positions in
+  // grid_vals
+  void WriteAllGridValsToVector(Eigen::VectorXd& grid_vals) const;
   void UpdateVoxelGridVals(const int& x_voxel_idx, const int& y_voxel_idx, const int& z_voxel_idx,
                            const GridVals grid_vals_new);
   static Eigen::Matrix<double, Eigen::Dynamic, 64> Compute_X_power(
       const Eigen::MatrixX3d& Xn_voxel);
-  std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> GetGridReference(const Eigen::MatrixX3d& X);
+  std::tuple<Eigen::MatrixX3i, Eigen::MatrixX3d> GetGridReference(
+      const Eigen::MatrixX3d& X) const;
+  // Linear index of a grid node. The unknowns of a node are stored at min_idx_adj() + 8 * NodeIdx
+  // in the order f, fx, fy, fz, fxy, fxz, fyz, fxyz.
+  int NodeIdx(const int& x_node_idx, const int& y_node_idx, const int& z_node_idx) const;
+  // The 8 grid values of node node_idx in the order of GridVals
+  const double* NodeGridVals(const int& node_idx) const;
+  bool HasExternalGridVals() const;
 
   // Getters
   const Eigen::RowVector3d& grid_origin() const;
@@ -59,15 +79,24 @@ class TranslationGrid {
   const int& num_grid_vals() const;
   const int& min_idx_adj() const;
   const int& max_idx_adj() const;
-  const std::vector<std::vector<std::vector<GridVals>>>& grid_vals() const;
+  // Maps X_power to the 64 coefficients of the grid values of a voxel, see Get_f for their order
+  const Eigen::Matrix<double, 64, 64>& inv_A() const;
 
  private:
-  std::tuple<Vector64d, Vector64i> Get_f(const Eigen::RowVector3i& X_voxel_idx);
+  std::tuple<Vector64d, Vector64i> Get_f(const Eigen::RowVector3i& X_voxel_idx) const;
+  void InitializeGeometry(const Eigen::RowVector3d& grid_origin, const int& x_num_voxels,
+                          const int& y_num_voxels, const int& z_num_voxels,
+                          const double& voxel_size, const int& first_idx_adj);
+  // Copies external grid values to owned storage
+  void MakeGridValsOwned();
 
   Eigen::RowVector3d grid_origin_;
   double voxel_size_;
-  std::vector<std::vector<std::vector<GridVals>>> grid_vals_;
-  std::vector<std::vector<std::vector<GridIdxAdj>>> grid_idx_adj_;
+  // Owned grid values, 8 per node; empty if external grid values are used
+  std::vector<double> grid_vals_;
+  std::shared_ptr<const void> external_grid_vals_owner_{};
+  const double* external_grid_vals_{nullptr};
+  int external_grid_vals_stride_{8};
   Eigen::Matrix<double, 64, 64> inv_A_;
   int x_num_voxels_;
   int y_num_voxels_;
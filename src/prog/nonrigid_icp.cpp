@@ -6,6 +6,7 @@
 
 #include "src/lib/correspondences.hpp"
 #include "src/lib/io_utils.hpp"
+#include "src/lib/kd_tree.hpp"
 #include "src/lib/named_column_matrix.hpp"
 #include "src/lib/optimization.hpp"
 #include "src/lib/profiler.hpp"
@@ -24,26 +25,53 @@ struct IterationResults {
   int it{};
   OptimizationResults optimization_results{};
   CorrespondencesResults correspondences_results{};
+  // Fraction of the correspondences which were not matched in the previous iteration
+  double fraction_changed_correspondences{1};
 };
 
 struct Params {
   std::string fixed;
   std::string movable;
   std::string transform;
+  int transform_tile_voxels;
+  std::string transform_quantization;
   double voxel_size;
   std::vector<double> grid_limits;
   uint32_t buffer_voxels;
   std::string matching_mode;
+  std::string fixed_index;
   uint32_t num_correspondences;
   double max_euclidean_distance;
+  double max_displacement;
+  bool crop_fixed;
+  std::string sample_fixed;
+  bool approximate_statistics;
   uint32_t num_iterations;
+  uint32_t max_iterations;
+  double convergence_std_change;
+  double convergence_rms_update;
+  double convergence_changed_correspondences;
+  int anderson;
   std::vector<double> weights;
+  std::string assembly;
+  std::string matrix_format;
+  double stencil_cache_mb;
+  std::string solver;
+  double solver_tolerance;
+  bool warm_start;
+  bool inexact_solve;
+  bool active_set;
+  int schwarz_tile_nodes;
+  int schwarz_overlap;
   std::string debug_dir;
   bool suppress_logging;
   bool profiling;
 };
 
 Params ParseUserInputs(int argc, char** argv);
+bool HasConvergenceCriteria(const Params& params);
+bool IsConverged(const Params& params, const IterationResults& iteration_results,
+                 const IterationResults& previous_iteration_results);
 
 void ReportIterationResults(const IterationResults& iteration_results);
 
@@ -62,15 +90,34 @@ int main(int argc, char** argv) {
     if (!params.suppress_logging) {
       std::cout << "Create point cloud objects\n";
     }
-    auto X_fix =
-        ImportFileToMatrix(params.fixed, true, params.matching_mode == "id" ? true : false);
     auto X_mov =
         ImportFileToMatrix(params.movable, true, params.matching_mode == "id" ? true : false);
-
+    auto pc_mov{PtCloud(X_mov(Eigen::all, {X_mov.namedColIndex("x"), X_mov.namedColIndex("y"),
+                                           X_mov.namedColIndex("z")}))};
+
+    // Only fixed points near the domain of the translation grids can become correspondences
+    ImportOptions fixed_import_options{};
+    if (params.crop_fixed) {
+      auto grid_limits_with_buffer{pc_mov.GridLimitsWithBuffer(
+          params.voxel_size, params.buffer_voxels, params.grid_limits)};
+      double margin{params.max_euclidean_distance + std::max(params.max_displacement, 0.0)};
+      fixed_import_options.crop = BoundingBox{
+          {grid_limits_with_buffer[0] - margin, grid_limits_with_buffer[1] - margin,
+           grid_limits_with_buffer[2] - margin},
+          {grid_limits_with_buffer[3] + margin, grid_limits_with_buffer[4] + margin,
+           grid_limits_with_buffer[5] + margin}};
+    }
+    // Only the sampled fixed points can become correspondences in modes "nn" and "id"
+    if (params.sample_fixed != "none") {
+      fixed_import_options.num_samples = params.num_correspondences;
+      if (params.sample_fixed == "voxel") {
+        fixed_import_options.sampling_voxel_size = params.voxel_size;
+      }
+    }
+    auto X_fix = ImportFileToMatrix(params.fixed, true, params.matching_mode == "id" ? true : false,
+                                    fixed_import_options);
     auto pc_fix{PtCloud(X_fix(Eigen::all, {X_fix.namedColIndex("x"), X_fix.namedColIndex("y"),
                                            X_fix.namedColIndex("z")}))};
-    auto pc_mov{PtCloud(X_mov(Eigen::all, {X_fix.namedColIndex("x"), X_fix.namedColIndex("y"),
-                                           X_fix.namedColIndex("z")}))};
 
     pc_fix.SetNormals(X_fix.namedCol("nx"), X_fix.namedCol("ny"), X_fix.namedCol("nz"));
     pc_mov.SetNormals(X_mov.namedCol("nx"), X_mov.namedCol("ny"), X_mov.namedCol("nz"));
@@ -89,7 +136,6 @@ int main(int argc, char** argv) {
       std::cout << "Initialize x/y/z translation grids for movable point cloud\n";
     }
     pc_mov.InitializeTranslationGrids(params.voxel_size, params.buffer_voxels, params.grid_limits);
-    pc_mov.InitMatricesForUpdateXt();
     if (!params.suppress_logging) {
       std::cout << "Each translation grid (including buffer voxels) has the properties:\n";
       std::cout << fmt::format(
@@ -116,16 +162,67 @@ int main(int argc, char** argv) {
     if (params.profiling) profiler.Stop("A.02 Initialization of translation grids");
 
     if (params.profiling) profiler.Start("A.03 Selection of correspondences");
-    if (!params.suppress_logging) {
-      std::cout << "Selection of correspondences in fixed point cloud\n";
-    }
     Correspondences correspondences{pc_fix, pc_mov};
-    correspondences.SelectPointsByRandomSampling(params.num_correspondences);
-    auto idx_pc_fix{correspondences.GetSelectedPoints()};
-    if (!params.suppress_logging) {
-      std::cout << fmt::format("Selected {:d} points in fixed point cloud\n",
-                               correspondences.num());
+    if (params.approximate_statistics) {
+      correspondences.SetStatisticsMode(StatisticsMode::kApproximate);
+    }
+    std::unique_ptr<KdTree> pc_fix_index{};
+    std::vector<int> idx_pc_fix{};
+    std::vector<int> idx_pc_mov{};
+    if (params.matching_mode == "nn_fixed") {
+      if (!params.suppress_logging) {
+        std::cout << "Indexing of fixed point cloud\n";
+      }
+      pc_fix_index = std::make_unique<KdTree>(pc_fix.X());
+      if (params.fixed_index != "" && pc_fix_index->Load(params.fixed_index)) {
+        if (!params.suppress_logging) {
+          std::cout << fmt::format("  Loaded kd tree from \"{}\"\n", params.fixed_index);
+        }
+      } else {
+        pc_fix_index->Build();
+        if (params.fixed_index != "") {
+          pc_fix_index->Save(params.fixed_index);
+          if (!params.suppress_logging) {
+            std::cout << fmt::format("  Saved kd tree to \"{}\"\n", params.fixed_index);
+          }
+        }
+      }
+
+      if (!params.suppress_logging) {
+        std::cout << "Selection of correspondences in movable point cloud\n";
+      }
+      correspondences.SelectMovablePointsByRandomSampling(params.num_correspondences);
+      idx_pc_mov = correspondences.GetSelectedMovablePoints();
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("Selected {:d} points in movable point cloud\n",
+                                 idx_pc_mov.size());
+      }
+    } else {
+      if (!params.suppress_logging) {
+        std::cout << "Selection of correspondences in fixed point cloud\n";
+      }
+      correspondences.SelectPointsByRandomSampling(params.num_correspondences);
+      idx_pc_fix = correspondences.GetSelectedPoints();
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("Selected {:d} points in fixed point cloud\n",
+                                 correspondences.num());
+      }
+    }
+
+    // Only the selected movable points can become correspondences in mode "nn_fixed", and only
+    // the movable points near the selected fixed points in mode "nn"
+    if (params.matching_mode == "nn_fixed") {
+      pc_mov.SetRegionOfInterest(idx_pc_mov);
+    } else if (params.matching_mode == "nn" && params.max_displacement >= 0) {
+      pc_mov.SetRegionOfInterest(
+          pc_mov.IdxPtsNearPts(pc_fix.X()(idx_pc_fix, Eigen::all),
+                               params.max_euclidean_distance + params.max_displacement));
     }
+    if (!params.suppress_logging && pc_mov.HasRegionOfInterest()) {
+      std::cout << fmt::format("Region of interest contains {:d} points of movable point cloud\n",
+                               pc_mov.idx_roi().size());
+    }
+    pc_mov.InitMatricesForUpdateXt();
     if (params.profiling) profiler.Stop("A.03 Selection of correspondences");
 
     auto debug_mode = (params.debug_dir != "");
@@ -133,19 +230,56 @@ int main(int argc, char** argv) {
     if (!params.suppress_logging) {
       std::cout << "Start iterative point cloud matching\n";
     }
+    OptimizationSettings optimization_settings{};
+    optimization_settings.assembly =
+        params.assembly == "jacobian" ? Assembly::kJacobian : Assembly::kDirect;
+    optimization_settings.matrix_format =
+        params.matrix_format == "bsr" ? MatrixFormat::kBSR : MatrixFormat::kCSC;
+    optimization_settings.stencil_cache_memory =
+        static_cast<size_t>(params.stencil_cache_mb * 1024 * 1024);
+    optimization_settings.solver_type = SolverTypeFromString(params.solver);
+    optimization_settings.warm_start = params.warm_start;
+    optimization_settings.solver_tolerance = params.solver_tolerance;
+    optimization_settings.inexact_solve = params.inexact_solve;
+    optimization_settings.active_set = params.active_set;
+    optimization_settings.schwarz_tile_num_nodes = params.schwarz_tile_nodes;
+    optimization_settings.schwarz_overlap = params.schwarz_overlap;
+    optimization_settings.anderson_history_size = params.anderson;
+    Optimization optimization{optimization_settings};
     IterationResults iteration_results{};
-    for (uint32_t it = 0; it < params.num_iterations; it++) {
+    IterationResults previous_iteration_results{};
+    std::vector<int> previous_idx_pc_fix{};
+    std::vector<int> previous_idx_pc_mov{};
+    auto has_convergence_criteria{HasConvergenceCriteria(params)};
+    auto num_iterations{has_convergence_criteria ? params.max_iterations : params.num_iterations};
+    std::string stop_reason{has_convergence_criteria ? "max_iterations reached"
+                                                     : "num_iterations reached"};
+    for (uint32_t it = 0; it < num_iterations; it++) {
       iteration_results.it = it + 1;
 
       if (params.profiling) profiler.Start("A.04 Matching");
-      correspondences.SetSelectedPoints(idx_pc_fix);
       if (params.matching_mode == "nn") {
+        correspondences.SetSelectedPoints(idx_pc_fix);
         correspondences.MatchPointsByNearestNeighbor();
+      } else if (params.matching_mode == "nn_fixed") {
+        correspondences.SetSelectedMovablePoints(idx_pc_mov);
+        correspondences.MatchPointsByNearestNeighborInFixedPointCloud(*pc_fix_index);
       } else if (params.matching_mode == "id") {
+        correspondences.SetSelectedPoints(idx_pc_fix);
         correspondences.MatchPointsByCorrespondenceId();
       }
       correspondences.RejectMaxEuclideanDistanceCriteria(params.max_euclidean_distance);
       correspondences.RejectStdMadCriteria();
+      if (has_convergence_criteria) {
+        auto idx_pc_fix_matched{correspondences.GetSelectedPoints()};
+        auto idx_pc_mov_matched{correspondences.GetSelectedMovablePoints()};
+        iteration_results.fraction_changed_correspondences =
+            it == 0 ? 1
+                    : FractionOfChangedCorrespondences(previous_idx_pc_fix, previous_idx_pc_mov,
+                                                       idx_pc_fix_matched, idx_pc_mov_matched);
+        previous_idx_pc_fix = std::move(idx_pc_fix_matched);
+        previous_idx_pc_mov = std::move(idx_pc_mov_matched);
+      }
 
       if (debug_mode) {
         char it_string[100];
@@ -163,8 +297,7 @@ int main(int argc, char** argv) {
       if (params.profiling) profiler.Stop("A.04 Matching");
 
       if (params.profiling) profiler.Start("A.05 Optimization");
-      Optimization optimization{};
-      iteration_results.optimization_results = Optimization::Solve(correspondences, params.weights);
+      iteration_results.optimization_results = optimization.Solve(correspondences, params.weights);
       if (params.profiling) profiler.Stop("A.05 Optimization");
 
       if (iteration_results.optimization_results.success) {
@@ -176,6 +309,17 @@ int main(int argc, char** argv) {
       } else {
         throw std::runtime_error("Optimization was not successful!");
       }
+
+      if (has_convergence_criteria && it > 0 &&
+          IsConverged(params, iteration_results, previous_iteration_results)) {
+        stop_reason = "converged";
+        break;
+      }
+      previous_iteration_results = iteration_results;
+    }
+    if (!params.suppress_logging) {
+      std::cout << fmt::format("Stopped after {:d} iterations: {}\n", iteration_results.it,
+                               stop_reason);
     }
 
     if (params.profiling) profiler.Start("A.06 Export of translation grids");
@@ -183,7 +327,11 @@ int main(int argc, char** argv) {
       std::cout << fmt::format("Export of estimated translation grids to \"{}\"\n",
                                params.transform);
     }
-    pc_mov.ExportTranslationGrids(params.transform);
+    TransformFileLayout transform_file_layout{};
+    transform_file_layout.tile_num_voxels = params.transform_tile_voxels;
+    transform_file_layout.quantization =
+        GridValsQuantizationFromString(params.transform_quantization);
+    pc_mov.ExportTranslationGrids(params.transform, transform_file_layout);
     if (params.profiling) profiler.Stop("A.06 Export of translation grids");
 
     if (!params.suppress_logging) {
@@ -219,6 +367,17 @@ Params ParseUserInputs(int argc, char** argv) {
     "the movable point cloud. The executable \"nonrigid-icp-transform\" can be used to transform a "
     "point cloud with this transform file.",
     cxxopts::value<std::string>())
+    ("transform_tile_voxels",
+    "Number of voxels per axis of the tiles of the transform file. The executable "
+    "\"nonrigid-icp-transform\" loads only the tiles which intersect the transformed point cloud. "
+    "The value 0 writes an untiled transform file.",
+    cxxopts::value<int>()->default_value("0"))
+    ("transform_quantization",
+    "Storage of the grid values of a tiled transform file. Available are \"none\" (double "
+    "precision) and \"int16\" (16 bit integers with a scale per tile and grid value type). With "
+    "\"int16\" the transformed points deviate by less than 3e-5 times the largest absolute grid "
+    "value of the tile.",
+    cxxopts::value<std::string>()->default_value("none"))
     ("v,voxel_size",
     "Voxel size of translation grids",
     cxxopts::value<double>()->default_value("1"))
@@ -231,21 +390,125 @@ Params ParseUserInputs(int argc, char** argv) {
     "Number of voxels to be used as buffer around the translation grids",
     cxxopts::value<uint32_t>()->default_value("2"))
     ("a,matching_mode",
-    "Matching mode for correspondences. Available modes are \"nn\" (nearest neighbor) and \"id\" "
+    "Matching mode for correspondences. Available modes are \"nn\" (nearest neighbor of points "
+    "selected in fixed point cloud), \"nn_fixed\" (nearest neighbor of points selected in "
+    "movable point cloud, searched in an index of the fixed point cloud) and \"id\" "
     "(correspondence_id).",
     cxxopts::value<std::string>()->default_value("nn"))
+    ("fixed_index",
+    "Path to kd tree index file of the fixed point cloud for matching mode \"nn_fixed\". The "
+    "index is loaded from this file if it was built for the same fixed point cloud, otherwise it "
+    "is built and saved to this file. Keeping this file next to the fixed point cloud allows "
+    "repeated runs to skip building the index.",
+    cxxopts::value<std::string>()->default_value(""))
     ("n,num_correspondences",
     "Number of correspondences",
     cxxopts::value<uint32_t>()->default_value("10000"))
     ("e,max_euclidean_distance",
     "Maximum euclidean distance between corresponding points",
     cxxopts::value<double>()->default_value("1"))
+    ("max_displacement",
+    "Expected maximum displacement between the point clouds for matching mode \"nn\". If >= 0, "
+    "only movable points within max_euclidean_distance+max_displacement of the selected fixed "
+    "points are transformed and indexed in each iteration. A negative value disables this "
+    "restriction.",
+    cxxopts::value<double>()->default_value("-1"))
+    ("crop_fixed",
+    "Import only the points of the fixed point cloud within the domain of the translation grids "
+    "extended by max_euclidean_distance (plus max_displacement if >= 0), i.e. drop all fixed "
+    "points which cannot become correspondences. Reduces memory and import time if the point "
+    "clouds overlap only partially.",
+    cxxopts::value<bool>()->default_value("false"))
+    ("sample_fixed",
+    "Sampling of the fixed point cloud during the import for matching modes \"nn\" and \"id\", "
+    "i.e. only num_correspondences sampled points are kept in memory and are used as selected "
+    "fixed points. Available modes are \"none\" (all points are imported), \"random\" (each "
+    "point is sampled with the same probability) and \"voxel\" (the samples are distributed "
+    "evenly over the occupied voxels of size voxel_size).",
+    cxxopts::value<std::string>()->default_value("none"))
+    ("approximate_statistics",
+    "Approximate median and MAD of the correspondence distances with a histogram instead of "
+    "exact selection. Recommended for millions of correspondences.",
+    cxxopts::value<bool>()->default_value("false"))
     ("i,num_iterations",
     "Number of iterations",
     cxxopts::value<uint32_t>()->default_value("5"))
+    ("max_iterations",
+    "Maximum number of iterations if convergence criteria are given. The iterations stop as soon "
+    "as all given convergence criteria are met; num_iterations is ignored.",
+    cxxopts::value<uint32_t>()->default_value("15"))
+    ("convergence_std_change",
+    "Convergence criterion: maximum relative change of the std of the point-to-plane distances "
+    "after the optimization compared to the previous iteration. A negative value disables this "
+    "criterion.",
+    cxxopts::value<double>()->default_value("-1"))
+    ("convergence_rms_update",
+    "Convergence criterion: maximum root mean square of the change of the estimated grid values "
+    "in an iteration. A negative value disables this criterion.",
+    cxxopts::value<double>()->default_value("-1"))
+    ("convergence_changed_correspondences",
+    "Convergence criterion: maximum fraction of correspondences which were not matched in the "
+    "previous iteration, i.e. 0 requires a stable set of correspondences. A negative value "
+    "disables this criterion.",
+    cxxopts::value<double>()->default_value("-1"))
+    ("anderson",
+    "Number of previous iterations used for the Anderson acceleration of the iterations, which "
+    "extrapolates the grid values from the history of their updates. The value 0 disables the "
+    "acceleration.",
+    cxxopts::value<int>()->default_value("0"))
     ("w,weights",
     "Weights of zero observations as list for \"f,fx/fy/fz,fxy/fxz/fyz,fxyz\"",
     cxxopts::value<std::vector<double>>()->default_value("1,1,1,1"))
+    ("assembly",
+    "Assembly of the normal equations. Available modes are \"direct\" (accumulation of the "
+    "stencils of the correspondences into a sparsity pattern which is reused across iterations) "
+    "and \"jacobian\" (sparse products of the Jacobian).",
+    cxxopts::value<std::string>()->default_value("direct"))
+    ("matrix_format",
+    "Storage of the normal equations for assembly \"direct\". Available formats are \"csc\" "
+    "(compressed sparse columns) and \"bsr\" (3x3 blocks of the x, y and z grids with a shared "
+    "sparsity pattern, requires solver \"cg\").",
+    cxxopts::value<std::string>()->default_value("csc"))
+    ("stencil_cache_mb",
+    "Memory budget in MB of a cache of the stencils of the matched movable points, which are "
+    "reused in later iterations. The stencils are stored in single precision. The value 0 "
+    "disables the cache.",
+    cxxopts::value<double>()->default_value("0"))
+    ("solver",
+    "Solver for the normal equations. Available solvers are \"bicgstab\", \"cg\" (conjugate "
+    "gradient), \"mf_cg\" (matrix-free conjugate gradient, i.e. the normal equations are not "
+    "assembled), \"mg_cg\" (conjugate gradient with geometric multigrid preconditioner), "
+    "\"schwarz\" (BiCGSTAB with restricted additive Schwarz preconditioner, i.e. the systems of "
+    "overlapping tiles of the grids are solved in parallel), \"mixed_cg\" (conjugate gradient in "
+    "single precision with iterative refinement in double precision, reports the inner "
+    "iterations and the refinement steps as outer iterations), \"ldlt\" (sparse LDLT "
+    "decomposition) and \"cholmod\" (supernodal Cholesky decomposition, only if compiled with "
+    "CHOLMOD). The ordering and symbolic analysis of the direct solvers are reused for all "
+    "iterations with the same sparsity pattern.",
+    cxxopts::value<std::string>()->default_value("bicgstab"))
+    ("solver_tolerance",
+    "Relative residual at which the iterative solvers stop. The value 0 selects the default of "
+    "Eigen, i.e. machine precision.",
+    cxxopts::value<double>()->default_value("0"))
+    ("warm_start",
+    "Start the iterative solvers from the grid values of the previous iteration instead of zero",
+    cxxopts::value<bool>()->default_value("false"))
+    ("inexact_solve",
+    "Use a loose solver tolerance in early iterations which tightens as the std of the "
+    "point-to-plane distances stabilizes, i.e. max(solver_tolerance, min(1e-2, 0.1 * relative "
+    "change of std))",
+    cxxopts::value<bool>()->default_value("false"))
+    ("active_set",
+    "Solve only for the unknowns of the grid nodes of voxels which contain correspondences. All "
+    "other unknowns are only constrained by their zero observations and are set to zero. Not "
+    "available for solvers \"mg_cg\" and \"schwarz\".",
+    cxxopts::value<bool>()->default_value("false"))
+    ("schwarz_tile_nodes",
+    "Number of grid nodes per axis of the tiles of solver \"schwarz\"",
+    cxxopts::value<int>()->default_value("16"))
+    ("schwarz_overlap",
+    "Number of grid nodes by which the tiles of solver \"schwarz\" overlap their neighbours",
+    cxxopts::value<int>()->default_value("1"))
     ("d,debug_dir",
     "Directory for debug output for correspondences.",
     cxxopts::value<std::string>()->default_value(""))
@@ -277,31 +540,113 @@ Params ParseUserInputs(int argc, char** argv) {
   params.fixed = result["fixed"].as<std::string>();
   params.movable = result["movable"].as<std::string>();
   params.transform = result["transform"].as<std::string>();
+  params.transform_tile_voxels = result["transform_tile_voxels"].as<int>();
+  params.transform_quantization = result["transform_quantization"].as<std::string>();
   params.voxel_size = result["voxel_size"].as<double>();
   params.grid_limits = result["grid_limits"].as<std::vector<double>>();
   params.buffer_voxels = result["buffer_voxels"].as<uint32_t>();
   params.matching_mode = result["matching_mode"].as<std::string>();
+  params.fixed_index = result["fixed_index"].as<std::string>();
   params.num_correspondences = result["num_correspondences"].as<uint32_t>();
   params.max_euclidean_distance = result["max_euclidean_distance"].as<double>();
+  params.max_displacement = result["max_displacement"].as<double>();
+  params.crop_fixed = result["crop_fixed"].as<bool>();
+  params.sample_fixed = result["sample_fixed"].as<std::string>();
+  params.approximate_statistics = result["approximate_statistics"].as<bool>();
   params.num_iterations = result["num_iterations"].as<uint32_t>();
+  params.max_iterations = result["max_iterations"].as<uint32_t>();
+  params.convergence_std_change = result["convergence_std_change"].as<double>();
+  params.convergence_rms_update = result["convergence_rms_update"].as<double>();
+  params.convergence_changed_correspondences =
+      result["convergence_changed_correspondences"].as<double>();
+  params.anderson = result["anderson"].as<int>();
   params.weights = result["weights"].as<std::vector<double>>();
+  params.assembly = result["assembly"].as<std::string>();
+  params.matrix_format = result["matrix_format"].as<std::string>();
+  params.stencil_cache_mb = result["stencil_cache_mb"].as<double>();
+  params.solver = result["solver"].as<std::string>();
+  params.solver_tolerance = result["solver_tolerance"].as<double>();
+  params.warm_start = result["warm_start"].as<bool>();
+  params.inexact_solve = result["inexact_solve"].as<bool>();
+  params.active_set = result["active_set"].as<bool>();
+  params.schwarz_tile_nodes = result["schwarz_tile_nodes"].as<int>();
+  params.schwarz_overlap = result["schwarz_overlap"].as<int>();
   params.debug_dir = result["debug_dir"].as<std::string>();
   params.suppress_logging = result["suppress_logging"].as<bool>();
   params.profiling = result["profiling"].as<bool>();
 
   if (params.matching_mode == "id") {
     params.num_iterations = 1;
+    params.max_iterations = 1;
     if (!params.suppress_logging) {
       std::cout << fmt::format("Set num_iterations to {:d} as matching mode \"{}\" was selected.\n",
                                params.num_iterations, params.matching_mode.c_str());
     }
   }
 
-  if (params.matching_mode != "nn" && params.matching_mode != "id") {
+  if (params.matching_mode != "nn" && params.matching_mode != "nn_fixed" &&
+      params.matching_mode != "id") {
     std::string error_string = "Matching mode \"" + params.matching_mode + "\" is not available!";
     throw std::runtime_error(error_string);
   }
 
+  if (params.sample_fixed != "none" && params.sample_fixed != "random" &&
+      params.sample_fixed != "voxel") {
+    std::string error_string = "Sampling mode \"" + params.sample_fixed + "\" is not available!";
+    throw std::runtime_error(error_string);
+  }
+
+  if (params.sample_fixed != "none" && params.matching_mode == "nn_fixed") {
+    throw std::runtime_error("Option sample_fixed is not available for matching mode "
+                             "\"nn_fixed\"!");
+  }
+
+  if (params.assembly != "direct" && params.assembly != "jacobian") {
+    std::string error_string = "Assembly \"" + params.assembly + "\" is not available!";
+    throw std::runtime_error(error_string);
+  }
+
+  if (params.matrix_format != "csc" && params.matrix_format != "bsr") {
+    std::string error_string = "Matrix format \"" + params.matrix_format + "\" is not available!";
+    throw std::runtime_error(error_string);
+  }
+
+  SolverTypeFromString(params.solver);  // throws if solver is not available
+
+  if (params.transform_tile_voxels < 0) {
+    throw std::runtime_error("Option transform_tile_voxels must not be negative!");
+  }
+
+  // throws if quantization is not available
+  if (GridValsQuantizationFromString(params.transform_quantization) !=
+          GridValsQuantization::kNone &&
+      params.transform_tile_voxels == 0) {
+    throw std::runtime_error("Option transform_quantization requires a tiled transform file, see "
+                             "option transform_tile_voxels!");
+  }
+
+  if (params.matrix_format == "bsr" && (params.assembly != "direct" || params.solver != "cg")) {
+    throw std::runtime_error("Matrix format \"bsr\" requires assembly \"direct\" and solver "
+                             "\"cg\"!");
+  }
+
+  if (params.stencil_cache_mb < 0) {
+    throw std::runtime_error("Option stencil_cache_mb must not be negative!");
+  }
+
+  if (params.active_set && (params.solver == "mg_cg" || params.solver == "schwarz")) {
+    throw std::runtime_error("Option active_set is not available for solver \"" + params.solver +
+                             "\"!");
+  }
+
+  if (params.anderson < 0) {
+    throw std::runtime_error("Option anderson must not be negative!");
+  }
+
+  if (params.schwarz_tile_nodes < 1 || params.schwarz_overlap < 0) {
+    throw std::runtime_error("schwarz_tile_nodes must be >= 1 and schwarz_overlap >= 0!");
+  }
+
   if (params.debug_dir != "") {
     // Add trailing slash if not present
     if (params.debug_dir.back() != '/') {
@@ -319,18 +664,60 @@ Params ParseUserInputs(int argc, char** argv) {
 }
 
 void ReportIterationResults(const IterationResults& iteration_results) {
+  const auto& optimization_results{iteration_results.optimization_results};
   if (iteration_results.it == 1) {
-    spdlog::info("{:>4} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}", "it", "num_corr",
-                 "num_obs", "num_unkn", "mean(dp)", "mean(dp)", "std(dp)", "std(dp)");
-    spdlog::info("{:37} {:>10} {:>10} {:>10} {:>10}", "", "before", "after", "before", "after");
+    spdlog::info(
+        "{:>4} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} "
+        "{:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}",
+        "it", "num_corr", "num_obs", "num_unkn", "mean(dp)", "mean(dp)", "std(dp)", "std(dp)",
+        "solver", "solver", "solver", "time", "time", "time", "nnz(N)", "vTPv", "memory",
+        "anderson", "anderson");
+    spdlog::info(
+        "{:37} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10} {:>32} "
+        "{:>10} {:>10}",
+        "", "before", "after", "before", "after", "iter", "outer", "error", "assembly", "compute",
+        "solve", "", "history", "restarts");
+    spdlog::info("{:>125} {:>10} {:>10} {:>10} {:>10} {:>10}", "[s]", "[s]", "[s]", "", "",
+                 "[MB]");
   }
   spdlog::info(
-      "{:4d} {:10d} {:10d} {:10d} {:10.3f} {:10.3f} {:10.3f} {:10.3f}", iteration_results.it,
-      iteration_results.correspondences_results.num,
-      iteration_results.optimization_results.num_observations,
-      iteration_results.optimization_results.num_unknowns,
+      "{:4d} {:10d} {:10d} {:10d} {:10.3f} {:10.3f} {:10.3f} {:10.3f} {:10d} {:10d} {:10.1e} "
+      "{:10.3f} {:10.3f} {:10.3f} {:10d} {:10.3e} {:10.1f} {:10d} {:10d}",
+      iteration_results.it, iteration_results.correspondences_results.num,
+      optimization_results.num_observations, optimization_results.num_unknowns,
       iteration_results.correspondences_results.mean_point_to_plane_dists_before_optimization,
       iteration_results.correspondences_results.mean_point_to_plane_dists_after_optimization,
       iteration_results.correspondences_results.std_point_to_plane_dists_before_optimization,
-      iteration_results.correspondences_results.std_point_to_plane_dists_after_optimization);
-}
\ No newline at end of file
+      iteration_results.correspondences_results.std_point_to_plane_dists_after_optimization,
+      optimization_results.solver_iterations, optimization_results.solver_outer_iterations,
+      optimization_results.solver_error, optimization_results.assembly_time,
+      optimization_results.compute_time, optimization_results.solve_time,
+      optimization_results.num_nonzeros, optimization_results.vTPv,
+      optimization_results.memory / (1024.0 * 1024.0), optimization_results.anderson_num_history,
+      optimization_results.anderson_num_restarts);
+}
+
+bool HasConvergenceCriteria(const Params& params) {
+  return params.convergence_std_change >= 0 || params.convergence_rms_update >= 0 ||
+         params.convergence_changed_correspondences >= 0;
+}
+
+bool IsConverged(const Params& params, const IterationResults& iteration_results,
+                 const IterationResults& previous_iteration_results) {
+  if (params.convergence_std_change >= 0) {
+    auto previous_std{previous_iteration_results.correspondences_results
+                          .std_point_to_plane_dists_after_optimization};
+    auto std{iteration_results.correspondences_results.std_point_to_plane_dists_after_optimization};
+    if (std::abs(std - previous_std) > params.convergence_std_change * previous_std) return false;
+  }
+  if (params.convergence_rms_update >= 0 &&
+      iteration_results.optimization_results.rms_update > params.convergence_rms_update) {
+    return false;
+  }
+  if (params.convergence_changed_correspondences >= 0 &&
+      iteration_results.fraction_changed_correspondences >
+          params.convergence_changed_correspondences) {
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,90 @@
+#include <fmt/format.h>
+
+#include <cxxopts.hpp>
+#include <iostream>
+
+#include "src/lib/io_utils.hpp"
+#include "src/lib/pt_cloud_cache.hpp"
+#include "src/lib/timer.hpp"
+
+struct Params {
+  std::vector<std::string> pc_in;
+  bool suppress_logging;
+};
+
+Params ParseUserInputs(int argc, char** argv);
+
+int main(int argc, char** argv) {
+  try {
+    Params params = ParseUserInputs(argc, argv);
+
+    Timer timer;
+    if (!params.suppress_logging) {
+      std::cout << "Start of \"nonrigid-icp-cache\"\n";
+    }
+
+    for (const auto& pc_in : params.pc_in) {
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("Cache point cloud \"{}\" in \"{}\"\n", pc_in,
+                                 PtCloudCachePath(pc_in));
+      }
+      auto X = CachePointcloud(pc_in);
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("  Cached {:d} points with {:d} fields\n", X.rows(), X.cols());
+      }
+    }
+
+    if (!params.suppress_logging) {
+      std::cout << fmt::format("Finished \"nonrigid-icp-cache\" in {}!\n", timer);
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Caught exception: " << e.what() << std::endl;
+    return 1;
+  } catch (...) {
+    std::cerr << "Caught unknown exception." << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
+
+Params ParseUserInputs(int argc, char** argv) {
+  cxxopts::Options options("nonrigid-icp-cache",
+                           "Binary cache of point clouds for the executables \"nonrigid-icp\" and "
+                           "\"nonrigid-icp-transform\", which read the cache instead of the point "
+                           "cloud as long as the point cloud file is unchanged");
+
+  // clang-format off
+  options.add_options()
+  ("i,pc_in",
+   "Paths to point clouds, separated by commas. The cache of a point cloud is saved next to it "
+   "with the additional extension \".nricpcache\" and contains x, y, z and, if present, the "
+   "normals and the correspondence ids.",
+   cxxopts::value<std::vector<std::string>>())
+  ("s,suppress_logging",
+   "Suppress log output",
+   cxxopts::value<bool>()->default_value("false"))
+  ("h,help",
+   "Print usage");
+  // clang-format on
+
+  // Show help if no arguments are provided
+  if (argc == 1) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  auto result = options.parse(argc, argv);
+
+  if (result.count("help")) {
+    std::cout << options.help() << std::endl;
+    exit(0);
+  }
+
+  // Save to params
+  Params params{};
+  params.pc_in = result["pc_in"].as<std::vector<std::string>>();
+  params.suppress_logging = result["suppress_logging"].as<bool>();
+
+  return params;
+}
@@ -3,8 +3,10 @@
 #include <algorithm>
 #include <cxxopts.hpp>
 #include <iostream>
+#include <memory>
 
 #include "src/lib/io_utils.hpp"
+#include "src/lib/mapped_file.hpp"
 #include "src/lib/profiler.hpp"
 #include "src/lib/pt_cloud.hpp"
 #include "src/lib/timer.hpp"
@@ -14,11 +16,16 @@ struct Params {
   std::string pc_out;
   std::string transform;
   long chunk_size;
+  bool streaming;
   bool suppress_logging;
   bool profiling;
 };
 
 Params ParseUserInputs(int argc, char** argv);
+// Transforms the points X_chunk with the mapped transform file; of tiled transform files only the
+// tiles which intersect the chunk are loaded
+void TransformChunk(const std::shared_ptr<const MappedFile>& transform_file,
+                    const std::string& transform, Eigen::MatrixX3d& X_chunk);
 
 int main(int argc, char** argv) {
   try {
@@ -31,58 +38,81 @@ int main(int argc, char** argv) {
       std::cout << "Start of \"nonrigid-icp-transform\"\n";
     }
 
-    if (params.profiling) profiler.Start("A.01 Read input point cloud");
-    if (!params.suppress_logging) {
-      std::cout << fmt::format("Read input point cloud \"{}\"\n", params.pc_in);
-    }
-    auto X = ImportFileToMatrix(params.pc_in, false, false);
-    if (!params.suppress_logging) {
-      std::cout << fmt::format("  Input point cloud has {:d} points\n", X.rows());
-    }
-    if (params.profiling) profiler.Stop("A.01 Read input point cloud");
-
-    // Iterate over chunks of the point cloud
-    if (params.profiling) profiler.Start("A.02 Transformation of point cloud");
     using Index = Eigen::Index;
-    Index total_rows = X.rows();
     Index chunk_size = static_cast<Index>(params.chunk_size);
     if (chunk_size <= 0) {
       std::cerr << fmt::format("Chunk size must be positive (got {:d})\n", params.chunk_size);
       return 1;
     }
-    Index num_chunks = (total_rows + chunk_size - 1) / chunk_size;  // ceil division
-    for (Index i = 0; i < total_rows; i += chunk_size) {
+
+    // The transform file is mapped once for all chunks
+    auto transform_file{std::make_shared<const MappedFile>(params.transform)};
+
+    if (params.streaming) {
+      // Stream the point cloud chunk by chunk from the reader to the writer
+      if (params.profiling) profiler.Start("A.01 Streamed transformation of point cloud");
       if (!params.suppress_logging) {
-        std::cout << fmt::format("Transforming point cloud chunk {:d}/{:d} ...\n",
-                                 static_cast<long long>(i / chunk_size + 1),
-                                 static_cast<long long>(num_chunks));
+        std::cout << fmt::format("Stream point cloud \"{}\" to \"{}\"\n", params.pc_in,
+                                 params.pc_out);
       }
+      long long chunk{0};
+      auto transform_chunk = [&](Eigen::MatrixX3d& X_chunk) {
+        if (!params.suppress_logging) {
+          std::cout << fmt::format("Transforming point cloud chunk {:d} ...\n", ++chunk);
+        }
+        TransformChunk(transform_file, params.transform, X_chunk);
+      };
+      auto num_points{
+          StreamTransformFile(params.pc_in, params.pc_out, chunk_size, transform_chunk)};
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("  Point cloud has {:d} points\n", num_points);
+      }
+      if (params.profiling) profiler.Stop("A.01 Streamed transformation of point cloud");
+    } else {
+      if (params.profiling) profiler.Start("A.01 Read input point cloud");
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("Read input point cloud \"{}\"\n", params.pc_in);
+      }
+      auto X = ImportFileToMatrix(params.pc_in, false, false);
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("  Input point cloud has {:d} points\n", X.rows());
+      }
+      if (params.profiling) profiler.Stop("A.01 Read input point cloud");
+
+      // Iterate over chunks of the point cloud
+      if (params.profiling) profiler.Start("A.02 Transformation of point cloud");
+      Index total_rows = X.rows();
+      Index num_chunks = (total_rows + chunk_size - 1) / chunk_size;  // ceil division
+      for (Index i = 0; i < total_rows; i += chunk_size) {
+        if (!params.suppress_logging) {
+          std::cout << fmt::format("Transforming point cloud chunk {:d}/{:d} ...\n",
+                                   static_cast<long long>(i / chunk_size + 1),
+                                   static_cast<long long>(num_chunks));
+        }
+
+        // Row indices
+        Index first_row = i;
+        // (std::min) to avoid macro issues
+        Index last_row = (std::min)(i + chunk_size, total_rows);
+        auto row_indices = Eigen::seq(first_row, last_row - 1);
+
+        // Transform points in chunk
+        Eigen::MatrixX3d X_chunk{
+            X(row_indices, {X.namedColIndex("x"), X.namedColIndex("y"), X.namedColIndex("z")})};
+        TransformChunk(transform_file, params.transform, X_chunk);
+
+        // Update points
+        X(row_indices, Eigen::all) = X_chunk;
+      }
+      if (params.profiling) profiler.Stop("A.02 Transformation of point cloud");
 
-      // Row indices
-      Index first_row = i;
-      Index last_row = (std::min)(i + chunk_size, total_rows);  // (std::min) to avoid macro issues
-      auto row_indices = Eigen::seq(first_row, last_row - 1);
-
-      // Transform points in chunk
-      auto pc_mov_chunk{PtCloud(
-          X(row_indices, {X.namedColIndex("x"), X.namedColIndex("y"), X.namedColIndex("z")}))};
-      // TODO Currently the translation grid is read from file for each chunk. Read once and pass to
-      // function.
-      pc_mov_chunk.ImportTranslationGrids(params.transform);
-      pc_mov_chunk.InitMatricesForUpdateXt();
-      pc_mov_chunk.UpdateXt();
-
-      // Update points
-      X(row_indices, Eigen::all) = pc_mov_chunk.Xt();
-    }
-    if (params.profiling) profiler.Stop("A.02 Transformation of point cloud");
-
-    if (params.profiling) profiler.Start("A.03 Write point cloud");
-    if (!params.suppress_logging) {
-      std::cout << fmt::format("Write transformed point cloud to file: \"{}\"\n", params.pc_out);
+      if (params.profiling) profiler.Start("A.03 Write point cloud");
+      if (!params.suppress_logging) {
+        std::cout << fmt::format("Write transformed point cloud to file: \"{}\"\n", params.pc_out);
+      }
+      SaveMatrixToFile(X, params.pc_in, params.pc_out);
+      if (params.profiling) profiler.Stop("A.03 Write point cloud");
     }
-    SaveMatrixToFile(X, params.pc_in, params.pc_out);
-    if (params.profiling) profiler.Stop("A.03 Write point cloud");
 
     if (!params.suppress_logging) {
       std::cout << fmt::format("Finished \"nonrigid-icp-transform\" in {}!\n", timer);
@@ -119,6 +149,11 @@ Params ParseUserInputs(int argc, char** argv) {
   ("c,chunk_size",
    "Number of points per chunk used for transforming the input point cloud",
    cxxopts::value<long>()->default_value("1000000"))
+  ("streaming",
+   "Stream the point cloud chunk by chunk from the reader to the writer, i.e. each point is read "
+   "once and the memory does not depend on the size of the point cloud. Requires a file format "
+   "whose reader and writer support streaming, e.g. las, laz or txt.",
+   cxxopts::value<bool>()->default_value("false"))
   ("s,suppress_logging",
    "Suppress log output",
    cxxopts::value<bool>()->default_value("false"))
@@ -148,8 +183,18 @@ Params ParseUserInputs(int argc, char** argv) {
   params.pc_out = result["pc_out"].as<std::string>();
   params.transform = result["transform"].as<std::string>();
   params.chunk_size = result["chunk_size"].as<long>();
+  params.streaming = result["streaming"].as<bool>();
   params.suppress_logging = result["suppress_logging"].as<bool>();
   params.profiling = result["profiling"].as<bool>();
 
   return params;
 }
+
+void TransformChunk(const std::shared_ptr<const MappedFile>& transform_file,
+                    const std::string& transform, Eigen::MatrixX3d& X_chunk) {
+  PtCloud pc_mov_chunk{X_chunk};
+  pc_mov_chunk.ImportTranslationGrids(transform_file, transform, true);
+  pc_mov_chunk.InitMatricesForUpdateXt();
+  pc_mov_chunk.UpdateXt();
+  X_chunk = pc_mov_chunk.Xt();
+}
@@ -0,0 +1,64 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/cache
+rm -rf $results
+mkdir -p $results
+
+# The point clouds are copied, so that their cache files are written to the results
+cp pcfix.txt pcmov.txt $results/
+
+apply_transformation() {
+    nonrigid-icp-transform \
+        --pc_in $results/pcmov.txt \
+        --pc_out "$1" \
+        --transform $results/pcmov.nricp \
+        --suppress_logging
+}
+
+echo "estimate and apply transformation without cache"
+estimate_transformation $results/pcfix.txt $results/pcmov.txt $results/pcmov.nricp
+apply_transformation $results/pcmov_transformed.txt
+
+echo "estimate and apply transformation with cache"
+nonrigid-icp-cache --pc_in $results/pcfix.txt,$results/pcmov.txt --suppress_logging
+test -f $results/pcfix.txt.nricpcache
+test -f $results/pcmov.txt.nricpcache
+estimate_transformation $results/pcfix.txt $results/pcmov.txt $results/pcmov_cached.nricp
+cmp $results/pcmov.nricp $results/pcmov_cached.nricp
+apply_transformation $results/pcmov_transformed_cached.txt
+cmp $results/pcmov_transformed.txt $results/pcmov_transformed_cached.txt
+
+# Swapping two points keeps the size of the point cloud file; with its last write time restored,
+# the cache is still considered fresh, i.e. the coordinates of the output prove that the cache is
+# read (the other fields are taken from the point cloud file when the output is written)
+echo "apply transformation with cache of point cloud with restored last write time"
+cp -p $results/pcmov.txt $results/pcmov_original.txt
+sed -i '2{h;d};3{G}' $results/pcmov.txt
+touch -r $results/pcmov_original.txt $results/pcmov.txt
+apply_transformation $results/pcmov_transformed_cached.txt
+cmp <(cut -d , -f 1-3 $results/pcmov_transformed.txt) \
+    <(cut -d , -f 1-3 $results/pcmov_transformed_cached.txt)
+
+# With a new last write time, the hash of the content shows that the cache is stale
+echo "apply transformation with stale cache"
+sed '2{h;d};3{G}' $results/pcmov_transformed.txt > $results/pcmov_transformed_swapped.txt
+touch $results/pcmov.txt
+apply_transformation $results/pcmov_transformed_stale.txt
+cmp $results/pcmov_transformed_swapped.txt $results/pcmov_transformed_stale.txt
+
+# An invalid cache file is ignored like a stale one
+echo "apply transformation with truncated cache"
+nonrigid-icp-cache --pc_in $results/pcmov.txt --suppress_logging
+truncate -s 100 $results/pcmov.txt.nricpcache
+apply_transformation $results/pcmov_transformed_truncated.txt
+cmp $results/pcmov_transformed_swapped.txt $results/pcmov_transformed_truncated.txt
@@ -0,0 +1,103 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/import
+rm -rf $results
+mkdir -p $results
+
+# Text and ply files are parsed natively; the cache of nonrigid-icp-cache is written from the point
+# cloud as read by PDAL, i.e. a run with the cache imports the point cloud with PDAL
+cp pcfix.txt pcmov.txt pcfix.ply pcmov.ply $results/
+awk 'BEGIN { OFS = "," } { $1 = $1; print }' pcmov.txt > $results/pcmov-comma.txt
+
+echo "estimate transformation with native import of ply files"
+estimate_transformation $results/pcfix.ply $results/pcmov.ply $results/pcmov_native.nricp
+
+for pc in pcmov.txt pcmov-comma.txt pcmov.ply; do
+    echo "apply transformation to $pc with native import"
+    nonrigid-icp-transform \
+        --pc_in $results/$pc \
+        --pc_out $results/native_$pc \
+        --transform $results/pcmov_native.nricp \
+        --suppress_logging
+
+    echo "apply transformation to $pc with PDAL import"
+    nonrigid-icp-cache --pc_in $results/$pc --suppress_logging
+    nonrigid-icp-transform \
+        --pc_in $results/$pc \
+        --pc_out $results/pdal_$pc \
+        --transform $results/pcmov_native.nricp \
+        --suppress_logging
+    cmp $results/native_$pc $results/pdal_$pc
+done
+
+echo "estimate transformation with PDAL import of ply files"
+nonrigid-icp-cache --pc_in $results/pcfix.ply --suppress_logging
+estimate_transformation $results/pcfix.ply $results/pcmov.ply $results/pcmov_pdal.nricp
+cmp $results/pcmov_native.nricp $results/pcmov_pdal.nricp
+
+# A crop box which contains all fixed points must not change the transformation, neither for the
+# native import of text and ply files nor for the streamed import of las files with PDAL. The crop
+# box is the domain of the grids extended by max_euclidean_distance and max_displacement.
+for extension in txt ply las; do
+    echo "estimate transformation with and without cropping of pcfix.$extension"
+    estimate_transformation pcfix.$extension pcmov.txt $results/pcmov_uncropped_$extension.nricp \
+        --max_displacement 10000
+    estimate_transformation pcfix.$extension pcmov.txt $results/pcmov_cropped_$extension.nricp \
+        --max_displacement 10000 \
+        --crop_fixed
+    cmp $results/pcmov_uncropped_$extension.nricp $results/pcmov_cropped_$extension.nricp
+
+    echo "estimate transformation with crop box outside of pcfix.$extension"
+    if estimate_transformation pcfix.$extension pcmov.txt $results/pcmov_outside.nricp \
+        --grid_limits 0,0,0,100,100,100 \
+        --crop_fixed 2> $results/crop_error_$extension.log; then
+        echo "Crop box outside of pcfix.$extension did not fail" >&2
+        exit 1
+    fi
+    grep -q "has no points within the crop box" $results/crop_error_$extension.log
+done
+
+# The sampling of the fixed point cloud only depends on the order of the points, i.e. it must give
+# the same samples for the native import of a text file and the import from its cache, and for the
+# streamed import of a las file with PDAL and the import from its cache
+echo "write caches of fixed point clouds"
+cp pcfix.las $results/
+nonrigid-icp-cache --pc_in $results/pcfix.txt,$results/pcfix.las --suppress_logging
+test -f $results/pcfix.txt.nricpcache
+test -f $results/pcfix.las.nricpcache
+for sample_fixed in random voxel; do
+    for extension in txt las; do
+        echo "estimate transformation with $sample_fixed sampling of pcfix.$extension"
+        estimate_transformation pcfix.$extension pcmov.txt \
+            $results/pcmov_${sample_fixed}_$extension.nricp \
+            --sample_fixed $sample_fixed
+        echo "estimate transformation with $sample_fixed sampling of cached pcfix.$extension"
+        estimate_transformation $results/pcfix.$extension pcmov.txt \
+            $results/pcmov_${sample_fixed}_cached_$extension.nricp \
+            --sample_fixed $sample_fixed
+        cmp $results/pcmov_${sample_fixed}_$extension.nricp \
+            $results/pcmov_${sample_fixed}_cached_$extension.nricp
+    done
+done
+
+# A point cloud with fewer points than num_correspondences is kept completely
+echo "estimate transformation with small fixed point cloud"
+head -n 5001 pcfix.txt > $results/pcfix-small.txt
+estimate_transformation $results/pcfix-small.txt pcmov.txt $results/pcmov_small.nricp
+for sample_fixed in random voxel; do
+    echo "estimate transformation with $sample_fixed sampling of small fixed point cloud"
+    estimate_transformation $results/pcfix-small.txt pcmov.txt \
+        $results/pcmov_small_$sample_fixed.nricp \
+        --sample_fixed $sample_fixed
+    cmp $results/pcmov_small.nricp $results/pcmov_small_$sample_fixed.nricp
+done
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/nn-fixed
+rm -rf $results
+mkdir -p $results
+
+estimate_nn_fixed_transformation() {
+    local fixed="$1" name="$2"
+    estimate_transformation $fixed pcmov.txt $results/pcmov-$name.nricp \
+        --matching_mode nn_fixed \
+        --fixed_index $results/pcfix.kdtree \
+        --suppress_logging=false > $results/pcmov-$name.log
+}
+
+echo "estimate transformation: build and save kd tree"
+estimate_nn_fixed_transformation pcfix.txt saved
+grep -q "Saved kd tree" $results/pcmov-saved.log
+test -f $results/pcfix.kdtree
+cp $results/pcfix.kdtree $results/pcfix-saved.kdtree
+
+echo "estimate transformation: load kd tree"
+estimate_nn_fixed_transformation pcfix.txt loaded
+grep -q "Loaded kd tree" $results/pcmov-loaded.log
+cmp $results/pcmov-saved.nricp $results/pcmov-loaded.nricp
+
+# Moving a single point keeps the number of points, i.e. only the hash of the points shows that the
+# kd tree was built for another point cloud
+echo "estimate transformation: rebuild kd tree of changed fixed point cloud"
+awk 'NR == 2 { $1 = sprintf("%.3f", $1 + 0.001) } { print }' pcfix.txt > $results/pcfix-changed.txt
+estimate_nn_fixed_transformation $results/pcfix-changed.txt changed
+grep -q "Saved kd tree" $results/pcmov-changed.log
+if cmp -s $results/pcfix-saved.kdtree $results/pcfix.kdtree; then
+    echo "File \"$results/pcfix.kdtree\" was not rewritten" >&2
+    exit 1
+fi
@@ -0,0 +1,141 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/solvers
+rm -rf $results
+mkdir -p $results
+
+# All modes solve the same normal equations to machine precision, i.e. the estimated grid values
+# must agree up to rounding errors
+MAX_ABS_DIFF=1e-10
+
+estimate_solver_transformation() {
+    local name="$1"
+    shift
+    echo "estimate transformation: $name"
+    estimate_transformation pcfix.txt pcmov.txt $results/pcmov-$name.nricp "$@"
+}
+
+# Like estimate_solver_transformation, but the log of nonrigid-icp is written to
+# $results/pcmov-$name.log
+estimate_logged_transformation() {
+    local name="$1"
+    shift
+    echo "estimate transformation: $name"
+    estimate_transformation pcfix.txt pcmov.txt $results/pcmov-$name.nricp \
+        --suppress_logging=false "$@" > $results/pcmov-$name.log
+}
+
+# Prints a column of the iteration report (1: it, 8: std(dp) after, 16: vTPv, 18 and 19: history
+# size and restarts of the Anderson acceleration) of iteration it from a log of nonrigid-icp
+report_value() {
+    local log="$1" it="$2" column="$3"
+    awk -v it="$it" -v column="$column" '/\[info\]/ && $4 == it { print $(column + 3) }' "$log"
+}
+
+# Fails if a column of the iteration report of iteration it differs between two logs by more than
+# max_abs_diff
+assert_reports_equal() {
+    local log1="$1" log2="$2" it="$3" column="$4" max_abs_diff="$5"
+    awk -v value1="$(report_value "$log1" "$it" "$column")" \
+        -v value2="$(report_value "$log2" "$it" "$column")" \
+        -v max_abs_diff="$max_abs_diff" \
+        -v name="column $column of iteration $it of \"$log1\" and \"$log2\"" '
+        BEGIN {
+            d = value1 - value2
+            if (d < 0) d = -d
+            printf "Difference of %s: %g\n", name, d
+            exit !(value1 != "" && value2 != "" && d <= max_abs_diff)
+        }'
+}
+
+estimate_solver_transformation direct --assembly direct
+estimate_solver_transformation jacobian --assembly jacobian
+assert_transforms_equal $results/pcmov-direct.nricp $results/pcmov-jacobian.nricp $MAX_ABS_DIFF
+
+# Solver "cholmod" is only available if compiled with CHOLMOD
+for solver in cg ldlt mf_cg mg_cg schwarz mixed_cg; do
+    estimate_solver_transformation $solver --solver $solver
+    assert_transforms_equal $results/pcmov-direct.nricp $results/pcmov-$solver.nricp $MAX_ABS_DIFF
+done
+
+# Matrix format "bsr" requires solver "cg"
+estimate_solver_transformation bsr --solver cg --matrix_format bsr
+assert_transforms_equal $results/pcmov-cg.nricp $results/pcmov-bsr.nricp $MAX_ABS_DIFF
+
+# The active set removes only unknowns which are not coupled to any correspondence, i.e. their
+# estimates of the full system are zero as well
+estimate_solver_transformation active_set --active_set
+assert_transforms_equal $results/pcmov-direct.nricp $results/pcmov-active_set.nricp $MAX_ABS_DIFF
+estimate_solver_transformation active_set_cg --active_set --solver cg
+assert_transforms_equal $results/pcmov-direct.nricp $results/pcmov-active_set_cg.nricp $MAX_ABS_DIFF
+
+# The stencil cache is filled in the first iteration and read in the second one. Its stencils are
+# stored as float, i.e. N and n differ from the default by about 1e-7 relative, which allows a
+# difference of the grid values of up to 1e-6. The second budget is smaller than the stencils of
+# the correspondences, i.e. most stencils are kept in the overflow of the cache.
+estimate_solver_transformation direct_2it --num_iterations 2
+for stencil_cache_mb in 100 0.01; do
+    estimate_solver_transformation stencil_cache_$stencil_cache_mb \
+        --num_iterations 2 \
+        --stencil_cache_mb $stencil_cache_mb
+    assert_transforms_equal $results/pcmov-direct_2it.nricp \
+        $results/pcmov-stencil_cache_$stencil_cache_mb.nricp 1e-6
+done
+
+# A maximum displacement larger than the grid keeps all movable points in each iteration, i.e. the
+# correspondences and hence the transform file are the same as without the restriction
+estimate_solver_transformation max_displacement --num_iterations 2 --max_displacement 10000
+cmp $results/pcmov-direct_2it.nricp $results/pcmov-max_displacement.nricp
+
+# The approximate median and MAD differ from the exact ones by less than 1/65536 of the range of the
+# point-to-plane distances, i.e. at most the few correspondences this close to the rejection bound
+# may be rejected differently. Each of them only changes the grid values of its voxel slightly, for
+# which a tolerance of 1e-3 is allowed; without such correspondences the grid values are identical.
+estimate_solver_transformation approximate_statistics --approximate_statistics
+assert_transforms_equal $results/pcmov-direct.nricp $results/pcmov-approximate_statistics.nricp 1e-3
+
+# The Anderson acceleration extrapolates the grid values from the previous iterations, i.e. it
+# changes the path of the iterations and with it the correspondences. Instead of the grid values,
+# the std of the point-to-plane distances after the last iteration is compared at the precision of
+# the iteration report.
+estimate_logged_transformation 3it --num_iterations 3
+estimate_logged_transformation anderson --num_iterations 3 --anderson 3
+# In the second iteration, the history either holds the first iteration or has been restarted
+test $(($(report_value $results/pcmov-anderson.log 2 18) + \
+        $(report_value $results/pcmov-anderson.log 2 19))) -eq 1
+assert_reports_equal $results/pcmov-3it.log $results/pcmov-anderson.log 3 8 1e-3
+
+# The inexact solve stops the solver at a relative residual of max(solver_tolerance, min(1e-2,
+# 0.1 * relative change of std)), i.e. at up to 1e-2. The correspondences of the later iterations
+# and hence the grid values then differ from those of the default solver by far more than the
+# rounding errors, which is why, like above, the std of the point-to-plane distances after the last
+# iteration is compared instead. Additionally, the solver error of each iteration must respect the
+# upper bound of the schedule.
+estimate_logged_transformation inexact_solve --num_iterations 3 --solver cg --warm_start \
+    --inexact_solve
+for it in 1 2 3; do
+    awk -v error="$(report_value $results/pcmov-inexact_solve.log $it 11)" \
+        'BEGIN { exit !(error != "" && error <= 1e-2) }'
+done
+assert_reports_equal $results/pcmov-3it.log $results/pcmov-inexact_solve.log 3 8 1e-3
+# With convergence criteria, the iterations stop as soon as all of them are met
+max_iterations=10
+estimate_logged_transformation converged \
+    --max_iterations $max_iterations \
+    --convergence_std_change 0.1 \
+    --convergence_rms_update 0.1 \
+    --convergence_changed_correspondences 0.5
+num_iterations=$(sed -n 's/^Stopped after \([0-9]*\) iterations: converged$/\1/p' \
+    $results/pcmov-converged.log)
+echo "Converged after ${num_iterations:-no} iterations"
+test "${num_iterations:-$max_iterations}" -lt $max_iterations
@@ -0,0 +1,45 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/streaming
+rm -rf $results
+mkdir -p $results
+
+echo "estimate transformation"
+estimate_transformation pcfix.txt pcmov.txt $results/pcmov.nricp
+
+# The streamed and the loaded point cloud are transformed in the same chunks, i.e. the outputs must
+# be identical
+for extension in txt las; do
+    echo "apply transformation to $extension file with and without streaming"
+    nonrigid-icp-transform \
+        --pc_in pcmov.$extension \
+        --pc_out $results/pcmov_transformed.$extension \
+        --transform $results/pcmov.nricp \
+        --chunk_size 10000 \
+        --suppress_logging
+    nonrigid-icp-transform \
+        --pc_in pcmov.$extension \
+        --pc_out $results/pcmov_transformed_streamed.$extension \
+        --transform $results/pcmov.nricp \
+        --chunk_size 10000 \
+        --streaming \
+        --suppress_logging
+done
+cmp $results/pcmov_transformed.txt $results/pcmov_transformed_streamed.txt
+
+# The headers of las files may differ, e.g. in their creation date
+for name in pcmov_transformed pcmov_transformed_streamed; do
+    pdal translate $results/$name.las $results/$name-las.txt \
+        --writers.text.precision=4
+done
+cmp $results/pcmov_transformed-las.txt $results/pcmov_transformed_streamed-las.txt
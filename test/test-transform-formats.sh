@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+
+set -eu
+set -o pipefail
+
+source "$(dirname "$0")/utils.sh"
+
+cd test-nordbahn
+
+export PATH="../../bin:$PATH"
+export LD_LIBRARY_PATH=/usr/local/vcpkg/installed/x64-linux/lib
+
+results=results/transform-formats
+rm -rf $results
+mkdir -p $results
+
+echo "estimate transformation: untiled transform file (version 2)"
+estimate_transformation pcfix.txt pcmov.txt $results/pcmov-v2.nricp
+
+nonrigid-icp-transform \
+    --pc_in pcmov.txt \
+    --pc_out $results/pcmov-v2.txt \
+    --transform $results/pcmov-v2.nricp \
+    --suppress_logging
+
+echo "apply transformation: transform file version 1"
+convert_transform_to_v1 $results/pcmov-v2.nricp $results/pcmov-v1.nricp
+nonrigid-icp-transform \
+    --pc_in pcmov.txt \
+    --pc_out $results/pcmov-v1.txt \
+    --transform $results/pcmov-v1.nricp \
+    --suppress_logging
+cmp $results/pcmov-v1.txt $results/pcmov-v2.txt
+
+# Tiled transform files (version 3) are transformed chunk by chunk, i.e. only the tiles of each
+# chunk are loaded
+for quantization in none int16; do
+    echo "estimate transformation: tiled transform file (version 3) with quantization $quantization"
+    estimate_transformation pcfix.txt pcmov.txt $results/pcmov-v3-$quantization.nricp \
+        --transform_tile_voxels 8 \
+        --transform_quantization $quantization
+
+    nonrigid-icp-transform \
+        --pc_in pcmov.txt \
+        --pc_out $results/pcmov-v3-$quantization.txt \
+        --transform $results/pcmov-v3-$quantization.nricp \
+        --chunk_size 10000 \
+        --suppress_logging
+done
+# The coordinates are written with 4 decimals, i.e. their rounding may differ by one unit
+assert_pointclouds_equal $results/pcmov-v3-none.txt $results/pcmov-v2.txt 2e-4
+assert_pointclouds_equal $results/pcmov-v3-int16.txt $results/pcmov-v2.txt 1e-3
@@ -0,0 +1,101 @@
+#!/usr/bin/env bash
+
+# Helper functions of the test scripts, to be sourced
+
+# Fails if any of the files does not exist
+assert_files_exist() {
+    local file
+    for file in "$@"; do
+        if [ ! -f "$file" ]; then
+            echo "File \"$file\" does not exist" >&2
+            return 1
+        fi
+    done
+}
+
+# Fails if two text point clouds differ in their header or number of points, or if any of their
+# values differ by more than max_abs_diff
+assert_pointclouds_equal() {
+    local pc1="$1" pc2="$2" max_abs_diff="$3"
+    assert_files_exist "$pc1" "$pc2" || return 1
+    if [ "$(head -n 1 "$pc1")" != "$(head -n 1 "$pc2")" ]; then
+        echo "Headers of \"$pc1\" and \"$pc2\" differ" >&2
+        return 1
+    fi
+    if [ "$(wc -l < "$pc1")" != "$(wc -l < "$pc2")" ]; then
+        echo "Numbers of points of \"$pc1\" and \"$pc2\" differ" >&2
+        return 1
+    fi
+    paste -d ' ' <(tail -n +2 "$pc1" | tr ',' ' ') <(tail -n +2 "$pc2" | tr ',' ' ') |
+        awk -v max_abs_diff="$max_abs_diff" -v name="\"$pc1\" and \"$pc2\"" '
+            {
+                n = NF / 2
+                for (i = 1; i <= n; i++) {
+                    d = $i - $(i + n)
+                    if (d < 0) d = -d
+                    if (d > max) max = d
+                }
+            }
+            END {
+                printf "Maximum difference of %s: %g\n", name, max
+                exit !(max <= max_abs_diff)
+            }'
+}
+
+# Fails if the grid values of two untiled transform files (file version 2) differ by more than
+# max_abs_diff
+assert_transforms_equal() {
+    local transform1="$1" transform2="$2" max_abs_diff="$3"
+    assert_files_exist "$transform1" "$transform2" || return 1
+    if [ "$(stat -c %s "$transform1")" != "$(stat -c %s "$transform2")" ]; then
+        echo "Sizes of \"$transform1\" and \"$transform2\" differ" >&2
+        return 1
+    fi
+    # The grid values are stored as doubles from byte 4096 on
+    paste -d ' ' <(od -A n -t f8 -v -j 4096 "$transform1" | tr -s ' ' '\n' | sed '/^$/d') \
+                 <(od -A n -t f8 -v -j 4096 "$transform2" | tr -s ' ' '\n' | sed '/^$/d') |
+        awk -v max_abs_diff="$max_abs_diff" -v name="\"$transform1\" and \"$transform2\"" '
+            {
+                d = $1 - $2
+                if (d < 0) d = -d
+                if (d > max) max = d
+            }
+            END {
+                printf "Maximum difference of grid values of %s: %g\n", name, max
+                exit !(max <= max_abs_diff)
+            }'
+}
+
+# Converts an untiled transform file of file version 2 to file version 1, i.e. to the format of
+# earlier releases with the unaligned header fields directly after the file version
+convert_transform_to_v1() {
+    local transform_v2="$1" transform_v1="$2"
+    {
+        head -c 10 "$transform_v2"                                 # identifier
+        printf '\x01\x00\x00\x00'                                  # file version 1
+        dd if="$transform_v2" bs=1 skip=1000 count=36 2> /dev/null # grid origin, number of voxels
+        dd if="$transform_v2" bs=1 skip=1040 count=8 2> /dev/null  # voxel size
+    } > "$transform_v1"
+    truncate -s 1000 "$transform_v1"
+    tail -c +4097 "$transform_v2" >> "$transform_v1"
+}
+
+# Estimates the transformation of the movable to the fixed point cloud with the parameters of the
+# Nordbahn dataset and one iteration. Further arguments are passed to nonrigid-icp; as the last
+# occurrence of an option counts, they may also override these parameters, e.g. --num_iterations 2.
+estimate_transformation() {
+    local fixed="$1" movable="$2" transform="$3"
+    shift 3
+    nonrigid-icp \
+        --fixed "$fixed" \
+        --movable "$movable" \
+        --transform "$transform" \
+        --voxel_size 25 \
+        --grid_limits 24880,354170,110,25955,354595,235 \
+        --buffer_voxels 1 \
+        --matching_mode nn \
+        --num_iterations 1 \
+        --weights "0.1,0.1,0.1,0.1" \
+        --suppress_logging \
+        "$@"
+}